@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bulk.hpp"
+#include "db.hpp"
+#include "processor.hpp"
+#include "search.hpp"
+#include "table.hpp"
+#include "vm.hpp"
+
+//
+// Stress benchmarks for the storage engine.
+// Build with -DMINI_SQLITE_BUILD_BENCH=ON.
+//
+
+using Clock = std::chrono::steady_clock;
+
+void print_result(const std::string &name, uint64_t count, Clock::duration elapsed)
+{
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << name << ": " << count << " ops in " << seconds << " s, "
+              << (uint64_t)(count / seconds) << " ops/s" << std::endl;
+}
+
+// the row "<key> user<key> user<key>@example.com" of the default columns
+void make_row(const Schema &schema, uint32_t key, Row &row)
+{
+    char username[COLUMN_USERNAME_SIZE + 1];
+    char email[COLUMN_EMAIL_SIZE + 1];
+    std::snprintf(username, sizeof(username), "user%u", key);
+    std::snprintf(email, sizeof(email), "user%u@example.com", key);
+    row.id = key;
+    row.record_size = 0;
+    schema.append_value(row, 0, username);
+    schema.append_value(row, 1, email);
+}
+
+// insert <count> rows with sequential or shuffled keys, <batch_size> rows per statement
+int bench_insert(const std::string &filename, uint32_t count, const std::string &order, uint32_t batch_size)
+{
+    if (batch_size == 0)
+    {
+        std::cerr << "Batch size must be positive." << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<uint32_t> keys(count);
+    std::iota(keys.begin(), keys.end(), 1);
+    if (order == "random")
+    {
+        std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+    }
+    else if (order != "sequential")
+    {
+        std::cerr << "Unknown key order: " << order << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Database db(filename);
+    TextSink sink(std::cout);
+    VirtualMachine vm(&db, &sink);
+    Statement statement(StatementType::INSERT);
+    const Schema &schema = db.get_table()->get_schema();
+
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < count; i += batch_size)
+    {
+        // batches are sorted like the parser sorts them
+        uint32_t batch_end = std::min(count, i + batch_size);
+        std::sort(keys.begin() + i, keys.begin() + batch_end);
+        statement.rows_to_insert.resize(batch_end - i);
+        for (uint32_t j = i; j < batch_end; j++)
+        {
+            make_row(schema, keys[j], statement.rows_to_insert[j - i]);
+        }
+        if (vm.execute(statement) != ExecuteResult::SUCCESS)
+        {
+            std::cerr << "Insert failed for key " << keys[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    print_result("insert " + order + " batch " + std::to_string(batch_size), count, Clock::now() - start);
+    return EXIT_SUCCESS;
+}
+
+// bulk load <count> rows with sequential keys at the given fill factor
+int bench_bulk(const std::string &filename, uint32_t count, double fill_factor)
+{
+    Database db(filename);
+    Table &table = *db.get_table();
+    Row row;
+
+    auto start = Clock::now();
+    BulkLoader loader(table, fill_factor);
+    for (uint32_t key = 1; key <= count; key++)
+    {
+        make_row(table.get_schema(), key, row);
+        loader.add(row);
+    }
+    loader.finish();
+    table.pager->flush_all();
+    print_result("bulk", count, Clock::now() - start);
+    return EXIT_SUCCESS;
+}
+
+// select every row of an existing database, formatted and thrown away
+int bench_select(const std::string &filename)
+{
+    Database db(filename);
+    Table &table = *db.get_table();
+    std::ofstream null_stream("/dev/null");
+    TextSink sink(null_stream);
+    VirtualMachine vm(&db, &sink);
+    Statement statement(StatementType::SELECT);
+    statement.low_id = 0;
+    statement.high_id = UINT32_MAX;
+    statement.limit = UINT64_MAX;
+
+    uint64_t count = 0;
+    for (Cursor cursor(table); !cursor.is_end_of_table(); cursor.advance())
+    {
+        count++;
+    }
+
+    auto start = Clock::now();
+    vm.execute(statement);
+    print_result("select", count, Clock::now() - start);
+    return EXIT_SUCCESS;
+}
+
+//
+// Count the rows of random id ranges of an existing database from
+// the row counts, and seek to random offsets, against counting every
+// row of the table with a cursor once.
+//
+int bench_count(const std::string &filename, uint64_t count)
+{
+    Database db(filename);
+    Table &table = *db.get_table();
+    std::mt19937 rng(42);
+
+    auto start = Clock::now();
+    uint64_t row_count = 0;
+    for (Cursor cursor(table); !cursor.is_end_of_table(); cursor.advance())
+    {
+        row_count++;
+    }
+    print_result("scan count", row_count, Clock::now() - start);
+    if (row_count == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    uint32_t max_id;
+    {
+        Cursor cursor(table);
+        cursor.find_rank(row_count - 1);
+        max_id = table.pager->get_leaf(cursor.get_page_num()).get_key(cursor.get_cell_num());
+    }
+
+    uint64_t checksum = 0;
+    start = Clock::now();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint32_t low_id = rng() % (max_id + 1);
+        uint32_t high_id = low_id + rng() % (max_id - low_id + 1);
+        checksum += table.count_rows_before(high_id + 1) - table.count_rows_before(low_id);
+    }
+    print_result("range count", count, Clock::now() - start);
+    std::cout << "rows counted: " << checksum << std::endl;
+
+    Cursor cursor(table);
+    start = Clock::now();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        cursor.find_rank(rng() % row_count);
+        checksum += cursor.get_cell_num();
+    }
+    print_result("offset seek", count, Clock::now() - start);
+    return checksum == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// export every row of an existing database into a file
+int bench_export(const std::string &filename, const std::string &export_filename, const std::string &format)
+{
+    if (format != "binary" && format != "text")
+    {
+        std::cerr << "Unknown export format: " << format << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Database db(filename);
+    Table &table = *db.get_table();
+    TextSink sink(std::cout);
+    VirtualMachine vm(&db, &sink);
+    Statement statement(StatementType::EXPORT);
+    statement.filename = export_filename;
+    statement.format = format == "text" ? ExportFormat::TEXT : ExportFormat::BINARY;
+    statement.low_id = 0;
+    statement.high_id = UINT32_MAX;
+    statement.limit = UINT64_MAX;
+
+    uint64_t count = 0;
+    for (Cursor cursor(table); !cursor.is_end_of_table(); cursor.advance())
+    {
+        count++;
+    }
+
+    auto start = Clock::now();
+    if (vm.execute(statement) != ExecuteResult::SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    print_result("export " + format, count, Clock::now() - start);
+    return EXIT_SUCCESS;
+}
+
+// parse <count> insert statements, lines are taken round robin from a pregenerated block
+int bench_parse(uint64_t count)
+{
+    constexpr uint32_t BLOCK_LINES = 1 << 20;
+    std::string block;
+    std::vector<std::pair<size_t, size_t>> lines; // (offset, size)
+    lines.reserve(BLOCK_LINES);
+    char line[128];
+    for (uint32_t key = 1; key <= BLOCK_LINES; key++)
+    {
+        int size = std::snprintf(line, sizeof(line), "insert %u user%u user%u@example.com", key, key, key);
+        lines.emplace_back(block.size(), size);
+        block.append(line, size);
+    }
+
+    CommandProcessor processor;
+    InputBuffer input_buffer;
+    Statement statement;
+    Schema schema = Schema::get_default();
+    uint64_t checksum = 0;
+
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const auto &[offset, size] = lines[i % BLOCK_LINES];
+        input_buffer.buffer.assign(block, offset, size);
+        if (processor.parse(input_buffer, statement, schema) != ParseResult::SUCCESS)
+        {
+            std::cerr << "Could not parse: " << input_buffer.buffer << std::endl;
+            return EXIT_FAILURE;
+        }
+        checksum += statement.rows_to_insert[0].id;
+    }
+    Clock::duration elapsed = Clock::now() - start;
+    print_result("parse", count, elapsed);
+    std::cout << "ns per statement: " << std::chrono::duration<double, std::nano>(elapsed).count() / count
+              << " (checksum " << checksum << ")" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// the search of nodes with interleaved key and value cells, before keys had an array of their own
+uint32_t lower_bound_cells(const char *cells, uint32_t num_cells, uint32_t key)
+{
+    uint32_t min_index = 0;
+    uint32_t one_past_max_index = num_cells;
+    while (one_past_max_index != min_index)
+    {
+        uint32_t index = (min_index + one_past_max_index) / 2;
+        uint32_t key_at_index;
+        memcpy(&key_at_index, cells + index * 2 * sizeof(uint32_t), sizeof(uint32_t));
+        if (key_at_index < key)
+        {
+            min_index = index + 1;
+        }
+        else
+        {
+            one_past_max_index = index;
+        }
+    }
+    return min_index;
+}
+
+//
+// search <count> random keys in nodes of a leaf's and a full internal
+// node's number of keys, spread over NODES pages, with the interleaved
+// cell search and both dense array ones. Every search of a round looks
+// for the same keys, the checksums have to match.
+//
+int bench_search(uint64_t count)
+{
+    constexpr uint32_t NODES = 256;
+    std::mt19937 rng(42);
+    std::cout << "dense search: " << get_search_implementation() << std::endl;
+
+    for (uint32_t num_keys : {94u, INTERNAL_NODE_MAX_CELLS})
+    {
+        std::vector<char> cells(NODES * PAGE_SIZE);
+        std::vector<char> keys(NODES * PAGE_SIZE);
+        for (uint32_t node = 0; node < NODES; node++)
+        {
+            uint32_t key = 0;
+            for (uint32_t i = 0; i < num_keys; i++)
+            {
+                key += 1 + rng() % 16;
+                memcpy(&cells[node * PAGE_SIZE + i * 2 * sizeof(uint32_t)], &key, sizeof(uint32_t));
+                memcpy(&keys[node * PAGE_SIZE + i * sizeof(uint32_t)], &key, sizeof(uint32_t));
+            }
+        }
+        std::vector<std::pair<uint32_t, uint32_t>> probes(1 << 16); // (node, key)
+        for (auto &probe : probes)
+        {
+            probe = {rng() % NODES, rng() % (num_keys * 17)};
+        }
+
+        auto run = [&](const std::string &name, const std::vector<char> &data, auto search)
+        {
+            uint64_t checksum = 0;
+            auto start = Clock::now();
+            for (uint64_t i = 0; i < count; i++)
+            {
+                const auto &[node, key] = probes[i % probes.size()];
+                checksum += search(data.data() + node * PAGE_SIZE, num_keys, key);
+            }
+            Clock::duration elapsed = Clock::now() - start;
+            print_result(name + " (" + std::to_string(num_keys) + " keys)", count, elapsed);
+            std::cout << "ns per search: " << std::chrono::duration<double, std::nano>(elapsed).count() / count
+                      << " (checksum " << checksum << ")" << std::endl;
+        };
+        run("interleaved binary", cells, lower_bound_cells);
+        run("dense scalar", keys, lower_bound_keys_scalar);
+        run("dense vector", keys, lower_bound_keys);
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc == 5 || argc == 6) && std::strcmp(argv[1], "insert") == 0)
+    {
+        uint32_t batch_size = argc == 6 ? std::strtoul(argv[5], nullptr, 10) : 1;
+        return bench_insert(argv[2], std::strtoul(argv[3], nullptr, 10), argv[4], batch_size);
+    }
+    if ((argc == 4 || argc == 5) && std::strcmp(argv[1], "bulk") == 0)
+    {
+        double fill_factor = argc == 5 ? std::strtod(argv[4], nullptr) : DEFAULT_BULK_FILL_FACTOR;
+        return bench_bulk(argv[2], std::strtoul(argv[3], nullptr, 10), fill_factor);
+    }
+    if (argc == 3 && std::strcmp(argv[1], "parse") == 0)
+    {
+        return bench_parse(std::strtoull(argv[2], nullptr, 10));
+    }
+    if (argc == 3 && std::strcmp(argv[1], "search") == 0)
+    {
+        return bench_search(std::strtoull(argv[2], nullptr, 10));
+    }
+    if (argc == 3 && std::strcmp(argv[1], "select") == 0)
+    {
+        return bench_select(argv[2]);
+    }
+    if (argc == 4 && std::strcmp(argv[1], "count") == 0)
+    {
+        return bench_count(argv[2], std::strtoull(argv[3], nullptr, 10));
+    }
+    if ((argc == 4 || argc == 5) && std::strcmp(argv[1], "export") == 0)
+    {
+        return bench_export(argv[2], argv[3], argc == 5 ? argv[4] : "binary");
+    }
+
+    std::cerr << "Usage: " << argv[0] << " insert <database_filename> <count> <sequential|random> [batch_size]" << std::endl
+              << "       " << argv[0] << " bulk <database_filename> <count> [fill_factor]" << std::endl
+              << "       " << argv[0] << " parse <count>" << std::endl
+              << "       " << argv[0] << " search <count>" << std::endl
+              << "       " << argv[0] << " select <database_filename>" << std::endl
+              << "       " << argv[0] << " count <database_filename> <count>" << std::endl
+              << "       " << argv[0] << " export <database_filename> <export_filename> [binary|text]" << std::endl;
+    return EXIT_FAILURE;
+}
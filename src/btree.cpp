@@ -1,206 +1,295 @@
-#include <iostream>
-#include <string>
+#include <cstring>
+#include <stdexcept>
 
 #include "btree.hpp"
+#include "search.hpp"
 
-void Row::print()
+Node::Node(char *page_data, bool *dirty)
+    : page_data(page_data), dirty(dirty)
 {
-    std::cout << this->id
-              << " "
-              << std::string(std::begin(this->username), std::end(this->username))
-              << " "
-              << std::string(std::begin(this->email), std::end(this->email))
-              << std::endl;
 }
 
-LeafNodeCell::LeafNodeCell(uint32_t *key, Row *value)
-    : key(key), value(value)
+// fields are not necessarily aligned within the page,
+// memcpy lets the compiler emit a plain (unaligned) load/store
+uint32_t Node::read_u32(uint32_t offset) const
 {
+    uint32_t value;
+    memcpy(&value, this->page_data + offset, sizeof(uint32_t));
+    return value;
 }
 
-uint32_t LeafNodeCell::get_key()
+void Node::write_u32(uint32_t offset, uint32_t value)
 {
-    return *this->key;
+    memcpy(this->page_data + offset, &value, sizeof(uint32_t));
+    this->mark_dirty();
 }
 
-void LeafNodeCell::set_key(uint32_t key)
+char *Node::get_data() const
 {
-    *this->key = key;
+    return this->page_data;
 }
 
-Row *LeafNodeCell::get_value()
+void Node::mark_dirty()
 {
-    return this->value;
+    *this->dirty = true;
 }
 
-void LeafNodeCell::set_value(const Row &row)
+NodeType Node::get_node_type() const
 {
-    // = *this->value = row;
-    // copying the elements one by one may avoid copying padding
-    memcpy(this->value, &row, LEAF_NODE_VALUE_SIZE);
+    NodeType node_type;
+    memcpy(&node_type, this->page_data + NODE_TYPE_OFFSET, NODE_TYPE_SIZE);
+    return node_type;
 }
 
-LeafNodeCell *LeafNodeCell::get_address()
+bool Node::is_root() const
 {
-    return (LeafNodeCell *)this->key;
+    return this->page_data[IS_ROOT_OFFSET] != 0;
 }
 
-Node::Node(NodeType *nodeType, bool *isRoot, uint32_t *parent_num)
-    : nodeType(nodeType), isRoot(isRoot), parent_num(parent_num)
+void Node::set_root(bool isRoot)
 {
+    this->page_data[IS_ROOT_OFFSET] = isRoot;
+    this->mark_dirty();
 }
 
-NodeType Node::get_node_type()
+uint32_t Node::get_parent() const
 {
-    return *this->nodeType;
+    return this->read_u32(PARENT_NUM_OFFSET);
 }
 
-bool Node::is_root()
+void Node::set_parent(uint32_t page_num)
 {
-    return *this->isRoot;
+    this->write_u32(PARENT_NUM_OFFSET, page_num);
 }
 
-void Node::set_root(bool isRoot)
+LeafNode::LeafNode(char *page_data, bool *dirty)
+    : Node(page_data, dirty)
 {
-    *this->isRoot = isRoot;
 }
 
-uint32_t LeafNode::get_max_key()
+LeafNode::LeafNode(const Node &node)
+    : Node(node)
 {
-    return this->get_cell(this->get_num_cells() - 1)->get_key();
 }
 
-uint32_t InternalNode::get_max_key()
+uint32_t LeafNode::get_max_key() const
 {
-    return this->get_key_at_cell(this->get_num_keys() - 1);
+    return this->get_key(this->get_num_cells() - 1);
 }
 
-uint32_t Node::get_parent()
+uint32_t LeafNode::get_num_cells() const
 {
-    return *this->parent_num;
+    return this->read_u32(LEAF_NODE_NUM_CELLS_OFFSET);
 }
 
-void Node::set_parent(uint32_t page_num)
+uint32_t LeafNode::get_next_leaf() const
 {
-    *this->parent_num = page_num;
+    return this->read_u32(LEAF_NODE_NEXT_LEAF_OFFSET);
 }
 
-LeafNode::LeafNode(NodeType *nodeType, uint32_t *next_leaf_num, bool *isRoot, uint32_t *parent_num, uint32_t *num_cells)
-    : Node(nodeType, isRoot, parent_num), num_cells(num_cells), next_leaf_num(next_leaf_num)
+void LeafNode::set_next_leaf_num(uint32_t next_leaf_num)
 {
+    this->write_u32(LEAF_NODE_NEXT_LEAF_OFFSET, next_leaf_num);
 }
 
-LeafNode::~LeafNode()
+uint32_t LeafNode::get_key(uint32_t index) const
 {
-    for (auto &cell : this->cells)
-    {
-        delete cell;
-    }
+    return this->read_u32(LEAF_NODE_KEYS_OFFSET + index * LEAF_NODE_KEY_SIZE);
 }
 
-uint32_t LeafNode::get_num_cells()
+uint32_t LeafNode::find_cell(uint32_t key, uint32_t first) const
 {
-    return *num_cells;
+    const char *keys = this->page_data + LEAF_NODE_KEYS_OFFSET + first * LEAF_NODE_KEY_SIZE;
+    return first + lower_bound_keys(keys, this->get_num_cells() - first, key);
 }
 
-void LeafNode::set_num_cells(uint32_t num_cells)
+// the record offsets follow the last key
+char *LeafNode::get_record_offsets() const
 {
-    *this->num_cells = num_cells;
+    return this->page_data + LEAF_NODE_KEYS_OFFSET + this->get_num_cells() * LEAF_NODE_KEY_SIZE;
 }
 
-void LeafNode::set_next_leaf_num(uint32_t next_leaf_num)
+uint32_t LeafNode::get_record_offset(uint32_t index) const
 {
-    *this->next_leaf_num = next_leaf_num;
+    uint32_t location;
+    memcpy(&location, this->get_record_offsets() + index * LEAF_NODE_RECORD_OFFSET_SIZE, LEAF_NODE_RECORD_OFFSET_SIZE);
+    return location & LEAF_NODE_RECORD_OFFSET_MASK;
 }
 
-LeafNodeCell *LeafNode::get_cell(uint32_t index)
+uint32_t LeafNode::get_record_size(uint32_t index) const
 {
-    return this->cells[index];
+    uint32_t location;
+    memcpy(&location, this->get_record_offsets() + index * LEAF_NODE_RECORD_OFFSET_SIZE, LEAF_NODE_RECORD_OFFSET_SIZE);
+    return location >> LEAF_NODE_RECORD_SIZE_SHIFT;
 }
 
-uint32_t LeafNode::get_next_leaf()
+void LeafNode::set_record_location(uint32_t index, uint32_t record_offset, uint32_t record_size)
 {
-    return *this->next_leaf_num;
+    uint32_t location = record_offset | record_size << LEAF_NODE_RECORD_SIZE_SHIFT;
+    memcpy(this->get_record_offsets() + index * LEAF_NODE_RECORD_OFFSET_SIZE, &location, LEAF_NODE_RECORD_OFFSET_SIZE);
 }
 
-void LeafNode::set_cell(uint32_t index, LeafNodeCell *cell)
+void LeafNode::get_row(uint32_t index, Row &row) const
 {
-    this->cells[index] = cell;
+    row.id = this->get_key(index);
+    row.record_size = this->get_record_size(index);
+    memcpy(row.record, this->page_data + this->get_record_offset(index), row.record_size);
 }
 
-void LeafNode::set_cell(uint32_t index, uint32_t key, const Row &row)
+uint32_t LeafNode::get_cell_size(const Row &row)
 {
-    LeafNodeCell *cell = this->cells[index];
-    cell->set_key(key);
-    cell->set_value(row);
+    return LEAF_NODE_SLOT_SIZE + row.record_size;
 }
 
-void LeafNode::copy_cell(uint32_t dst_index, uint32_t src_index)
+uint32_t LeafNode::get_cell_size(uint32_t index) const
 {
-    memcpy(this->get_cell(dst_index)->get_address(), this->get_cell(src_index)->get_address(), LEAF_NODE_CELL_SIZE);
+    return LEAF_NODE_SLOT_SIZE + this->get_record_size(index);
 }
 
-InternalNodeCell::InternalNodeCell(uint32_t *key, uint32_t *value)
-    : key(key), value(value)
+// bytes taken by slots and records, gaps not included
+uint32_t LeafNode::get_used_space() const
 {
+    return this->get_num_cells() * LEAF_NODE_SLOT_SIZE + this->read_u32(LEAF_NODE_CONTENT_SIZE_OFFSET) -
+           this->read_u32(LEAF_NODE_FRAGMENTED_SIZE_OFFSET);
 }
 
-InternalNodeCell *InternalNodeCell::get_address()
+bool LeafNode::has_room(uint32_t cell_size) const
 {
-    return (InternalNodeCell *)this->key;
+    return this->get_used_space() + cell_size <= LEAF_NODE_SPACE_FOR_CELLS;
 }
 
-uint32_t InternalNodeCell::get_key()
+//
+// Open a slot at index for the key and reserve record_size bytes
+// in front of the records, compacting first if the gap between the
+// slot arrays and the records is too small. Returns the record.
+// The record offsets move one key further, those from index on
+// two, the tail goes first so nothing is overwritten before it moved.
+//
+char *LeafNode::make_room(uint32_t index, uint32_t key, uint32_t record_size)
 {
-    return *this->key;
+    uint32_t num_cells = this->get_num_cells();
+    uint32_t slots_end = LEAF_NODE_KEYS_OFFSET + (num_cells + 1) * LEAF_NODE_SLOT_SIZE;
+    if (slots_end + record_size > PAGE_SIZE - this->read_u32(LEAF_NODE_CONTENT_SIZE_OFFSET))
+    {
+        this->compact();
+    }
+    uint32_t content_size = this->read_u32(LEAF_NODE_CONTENT_SIZE_OFFSET) + record_size;
+    uint32_t record_offset = PAGE_SIZE - content_size;
+
+    char *keys = this->page_data + LEAF_NODE_KEYS_OFFSET;
+    char *record_offsets = this->get_record_offsets();
+    memmove(record_offsets + (index + 1) * LEAF_NODE_RECORD_OFFSET_SIZE + LEAF_NODE_KEY_SIZE,
+            record_offsets + index * LEAF_NODE_RECORD_OFFSET_SIZE, (num_cells - index) * LEAF_NODE_RECORD_OFFSET_SIZE);
+    memmove(record_offsets + LEAF_NODE_KEY_SIZE, record_offsets, index * LEAF_NODE_RECORD_OFFSET_SIZE);
+    memmove(keys + (index + 1) * LEAF_NODE_KEY_SIZE, keys + index * LEAF_NODE_KEY_SIZE, (num_cells - index) * LEAF_NODE_KEY_SIZE);
+    memcpy(keys + index * LEAF_NODE_KEY_SIZE, &key, LEAF_NODE_KEY_SIZE);
+    this->write_u32(LEAF_NODE_NUM_CELLS_OFFSET, num_cells + 1);
+    this->set_record_location(index, record_offset, record_size);
+    this->write_u32(LEAF_NODE_CONTENT_SIZE_OFFSET, content_size);
+    return this->page_data + record_offset;
 }
 
-void InternalNodeCell::set_key(uint32_t key)
+void LeafNode::insert_cell(uint32_t index, uint32_t key, const Row &row)
 {
-    *this->key = key;
+    char *record = this->make_room(index, key, row.record_size);
+    memcpy(record, row.record, row.record_size);
 }
 
-uint32_t InternalNodeCell::get_value()
+// the record is copied as it is, src_node must be another page
+void LeafNode::insert_cell(uint32_t index, const LeafNode &src_node, uint32_t src_index)
 {
-    return *this->value;
+    uint32_t record_size = src_node.get_record_size(src_index);
+    char *record = this->make_room(index, src_node.get_key(src_index), record_size);
+    memcpy(record, src_node.page_data + src_node.get_record_offset(src_index), record_size);
 }
 
-void InternalNodeCell::set_value(uint32_t child_num)
+void LeafNode::remove_cells(uint32_t first, uint32_t last)
 {
-    *this->value = child_num;
+    uint32_t num_cells = this->get_num_cells();
+    if (last - first == num_cells)
+    {
+        this->clear();
+        return;
+    }
+
+    uint32_t removed_size = 0;
+    for (uint32_t i = first; i < last; i++)
+    {
+        removed_size += this->get_record_size(i);
+    }
+    // keys close up first, then the record offsets follow them
+    uint32_t removed = last - first;
+    char *keys = this->page_data + LEAF_NODE_KEYS_OFFSET;
+    char *record_offsets = this->get_record_offsets();
+    char *new_record_offsets = record_offsets - removed * LEAF_NODE_KEY_SIZE;
+    memmove(keys + first * LEAF_NODE_KEY_SIZE, keys + last * LEAF_NODE_KEY_SIZE, (num_cells - last) * LEAF_NODE_KEY_SIZE);
+    memmove(new_record_offsets, record_offsets, first * LEAF_NODE_RECORD_OFFSET_SIZE);
+    memmove(new_record_offsets + first * LEAF_NODE_RECORD_OFFSET_SIZE, record_offsets + last * LEAF_NODE_RECORD_OFFSET_SIZE,
+            (num_cells - last) * LEAF_NODE_RECORD_OFFSET_SIZE);
+    this->write_u32(LEAF_NODE_NUM_CELLS_OFFSET, num_cells - removed);
+    this->write_u32(LEAF_NODE_FRAGMENTED_SIZE_OFFSET, this->read_u32(LEAF_NODE_FRAGMENTED_SIZE_OFFSET) + removed_size);
 }
 
-InternalNode::InternalNode(NodeType *nodeType, bool *isRoot, uint32_t *parent_num, uint32_t *num_keys, uint32_t *right_child_num)
-    : Node(nodeType, isRoot, parent_num)
+void LeafNode::clear()
 {
-    this->num_keys = num_keys;
-    this->right_child = right_child_num;
+    this->write_u32(LEAF_NODE_NUM_CELLS_OFFSET, 0);
+    this->write_u32(LEAF_NODE_CONTENT_SIZE_OFFSET, 0);
+    this->write_u32(LEAF_NODE_FRAGMENTED_SIZE_OFFSET, 0);
 }
 
-InternalNode::~InternalNode()
+//
+// Repack the records against the end of the page in slot order,
+// which drops the gaps. Records are copied out first as they may
+// overlap their new place.
+//
+void LeafNode::compact()
 {
-    for (auto &cell : this->cells)
+    char records[PAGE_SIZE];
+    uint32_t num_cells = this->get_num_cells();
+    uint32_t content_size = 0;
+    for (uint32_t i = 0; i < num_cells; i++)
     {
-        delete cell;
+        uint32_t record_size = this->get_record_size(i);
+        content_size += record_size;
+        memcpy(records + PAGE_SIZE - content_size, this->page_data + this->get_record_offset(i), record_size);
+        this->set_record_location(i, PAGE_SIZE - content_size, record_size);
     }
+    memcpy(this->page_data + PAGE_SIZE - content_size, records + PAGE_SIZE - content_size, content_size);
+    this->write_u32(LEAF_NODE_CONTENT_SIZE_OFFSET, content_size);
+    this->write_u32(LEAF_NODE_FRAGMENTED_SIZE_OFFSET, 0);
+}
+
+InternalNode::InternalNode(char *page_data, bool *dirty)
+    : Node(page_data, dirty)
+{
 }
 
-uint32_t InternalNode::get_num_keys()
+InternalNode::InternalNode(const Node &node)
+    : Node(node)
+{
+}
+
+uint32_t InternalNode::get_num_keys() const
+{
+    return this->read_u32(INTERNAL_NODE_NUM_KEYS_OFFSET);
+}
+
+void InternalNode::set_num_keys(uint32_t num_keys)
 {
-    return *this->num_keys;
+    this->write_u32(INTERNAL_NODE_NUM_KEYS_OFFSET, num_keys);
 }
 
-uint32_t InternalNode::get_right_child()
+uint32_t InternalNode::get_right_child() const
 {
-    return *this->right_child;
+    return this->read_u32(INTERNAL_NODE_RIGHT_CHILD_OFFSET);
 }
 
-InternalNodeCell *InternalNode::get_cell(uint32_t index)
+void InternalNode::set_right_child(uint32_t child_num)
 {
-    return this->cells[index];
+    this->write_u32(INTERNAL_NODE_RIGHT_CHILD_OFFSET, child_num);
 }
 
-uint32_t InternalNode::get_child_at_cell(uint32_t cell_num)
+uint32_t InternalNode::get_child_at_cell(uint32_t cell_num) const
 {
     uint32_t num_keys = this->get_num_keys();
     if (cell_num > num_keys)
@@ -213,78 +302,87 @@ uint32_t InternalNode::get_child_at_cell(uint32_t cell_num)
     }
     else
     {
-        return this->get_cell(cell_num)->get_value();
+        return this->read_u32(INTERNAL_NODE_CHILDREN_OFFSET + cell_num * INTERNAL_NODE_CHILD_SIZE);
     }
 }
 
-uint32_t InternalNode::get_key_at_cell(uint32_t index)
+uint32_t InternalNode::get_key_at_cell(uint32_t index) const
 {
-    return this->get_cell(index)->get_key();
+    return this->read_u32(INTERNAL_NODE_KEYS_OFFSET + index * INTERNAL_NODE_KEY_SIZE);
 }
 
-void InternalNode::set_num_keys(uint32_t num_keys)
+void InternalNode::set_key_at_cell(uint32_t index, uint32_t key)
 {
-    *this->num_keys = num_keys;
+    this->write_u32(INTERNAL_NODE_KEYS_OFFSET + index * INTERNAL_NODE_KEY_SIZE, key);
 }
 
-void InternalNode::set_right_child(uint32_t child_num)
+void InternalNode::set_cell(uint32_t index, uint32_t key, uint32_t child_num)
 {
-    *this->right_child = child_num;
+    this->write_u32(INTERNAL_NODE_KEYS_OFFSET + index * INTERNAL_NODE_KEY_SIZE, key);
+    this->write_u32(INTERNAL_NODE_CHILDREN_OFFSET + index * INTERNAL_NODE_CHILD_SIZE, child_num);
 }
 
-void InternalNode::set_cell(uint32_t index, InternalNodeCell *cell)
+void InternalNode::update_key(uint32_t old_key, uint32_t new_key)
 {
-    this->cells[index] = cell;
+    // find old node that contains old key
+    // update the old key to new key
+    // the right child has no key in its parent
+    uint32_t old_child_index = this->find_child(old_key);
+    if (old_child_index < this->get_num_keys())
+    {
+        this->set_key_at_cell(old_child_index, new_key);
+    }
 }
 
-void InternalNode::set_cell(uint32_t index, uint32_t key, uint32_t child_num)
+uint32_t InternalNode::get_row_count(uint32_t index) const
 {
-    InternalNodeCell *cell = this->cells[index];
-    cell->set_key(key);
-    cell->set_value(child_num);
+    return this->read_u32(INTERNAL_NODE_ROW_COUNTS_OFFSET + index * INTERNAL_NODE_ROW_COUNT_SIZE);
 }
 
-void InternalNode::update_key(uint32_t old_key, uint32_t new_key)
+void InternalNode::set_row_count(uint32_t index, uint32_t row_count)
 {
-    // find old node that contains old key
-    // update the old key to new key
-    uint32_t old_child_index = this->find_child(old_key);
-    this->get_cell(old_child_index)->set_key(new_key);
+    this->write_u32(INTERNAL_NODE_ROW_COUNTS_OFFSET + index * INTERNAL_NODE_ROW_COUNT_SIZE, row_count);
+}
+
+uint64_t InternalNode::get_row_count_before(uint32_t index) const
+{
+    uint64_t row_count = 0;
+    for (uint32_t i = 0; i < index; i++)
+    {
+        row_count += this->get_row_count(i);
+    }
+    return row_count;
+}
+
+uint64_t InternalNode::get_total_row_count() const
+{
+    return this->get_row_count_before(this->get_num_keys() + 1);
 }
 
 void InternalNode::copy_cell(uint32_t dst_index, uint32_t src_index)
 {
-    memcpy(this->get_cell(dst_index)->get_address(), this->get_cell(src_index)->get_address(), INTERNAL_NODE_CELL_SIZE);
+    this->set_cell(dst_index, this->get_key_at_cell(src_index), this->get_child_at_cell(src_index));
+    this->set_row_count(dst_index, this->get_row_count(src_index));
 }
 
 //
 // Return the index of the child which should contain
 // the given key.
 //
-uint32_t InternalNode::find_child(uint32_t key)
+uint32_t InternalNode::find_child(uint32_t key) const
 {
-    uint32_t num_keys = this->get_num_keys();
-
-    //
-    // Binary search
-    //
-    
-    uint32_t min_index = 0;
-    uint32_t max_index = num_keys; // there is one more child than key
+    return lower_bound_keys(this->page_data + INTERNAL_NODE_KEYS_OFFSET, this->get_num_keys(), key);
+}
 
-    while (min_index != max_index)
+// a rank past the last row ends in the right child, past its rows
+uint32_t InternalNode::find_child_by_rank(uint64_t &rank) const
+{
+    uint32_t num_keys = this->get_num_keys();
+    uint32_t index = 0;
+    while (index < num_keys && rank >= this->get_row_count(index))
     {
-        uint32_t index = (min_index + max_index) / 2;
-        uint32_t key_to_right = this->get_key_at_cell(index);
-        if (key_to_right >= key)
-        {
-            max_index = index;
-        }
-        else
-        {
-            min_index = index + 1;
-        }
+        rank -= this->get_row_count(index);
+        index++;
     }
-
-    return min_index;
-}
\ No newline at end of file
+    return index;
+}
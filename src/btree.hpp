@@ -1,47 +1,40 @@
 #pragma once
 
+#include <cstdint>
+
 //
 // Row
+// The id is the key of a row, the values of the other columns are
+// encoded one after the other into its record by the schema of the
+// table, see schema.hpp. Leaves store the record as it is. The
+// default columns, username and email, fill a record completely.
 //
 
 constexpr uint32_t COLUMN_USERNAME_SIZE = 32;
 constexpr uint32_t COLUMN_EMAIL_SIZE = 255;
 
+constexpr uint32_t RECORD_STRING_SIZE_SIZE = sizeof(uint8_t);
+constexpr uint32_t ROW_MAX_RECORD_SIZE = RECORD_STRING_SIZE_SIZE + COLUMN_USERNAME_SIZE + RECORD_STRING_SIZE_SIZE + COLUMN_EMAIL_SIZE;
+
 struct Row
 {
     uint32_t id;
-    char username[COLUMN_USERNAME_SIZE + 1];
-    char email[COLUMN_EMAIL_SIZE + 1];
-
-    void print();
+    uint32_t record_size;
+    char record[ROW_MAX_RECORD_SIZE];
 };
 
 //
 // Page structure
-// remarks: padding may vary by complier and os
 //
 
-constexpr uint32_t ID_SIZE = sizeof(Row::id);
-constexpr uint32_t USERNAME_SIZE = sizeof(Row::username);
-
-constexpr uint32_t USERNAME_PADDING = 0;
-constexpr uint32_t EMAIL_SIZE = sizeof(Row::email);
-constexpr uint32_t EMAIL_PADDING = 3;
-constexpr uint32_t STRUCT_PADDING = USERNAME_PADDING + EMAIL_PADDING;
-
-constexpr uint32_t ID_OFFSET = 0;
-constexpr uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
-constexpr uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE + USERNAME_PADDING;
-constexpr uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE + STRUCT_PADDING;
-
-constexpr uint32_t TABLE_MAX_PAGES = 100;
 constexpr uint32_t PAGE_SIZE = 4096;
-constexpr uint32_t ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE;
 
 enum class NodeType
 {
     LEAF, // default node type
-    INTERNAL
+    INTERNAL,
+    INDEX_LEAF, // nodes of a secondary index, see index.hpp
+    INDEX_INTERNAL
 };
 
 //
@@ -58,25 +51,44 @@ constexpr uint32_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PAR
 
 //
 // Leaf Node Header Layout
+// Records are packed from the end of the page towards the front,
+// the content size counts them along with the gaps removed records
+// left behind, the fragmented size counts only those gaps.
+// A zeroed page is an empty leaf.
 //
 
 constexpr uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
 constexpr uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
 constexpr uint32_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
 constexpr uint32_t LEAF_NODE_NEXT_LEAF_OFFSET = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
-constexpr uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE;
+constexpr uint32_t LEAF_NODE_CONTENT_SIZE_SIZE = sizeof(uint32_t);
+constexpr uint32_t LEAF_NODE_CONTENT_SIZE_OFFSET = LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
+constexpr uint32_t LEAF_NODE_FRAGMENTED_SIZE_SIZE = sizeof(uint32_t);
+constexpr uint32_t LEAF_NODE_FRAGMENTED_SIZE_OFFSET = LEAF_NODE_CONTENT_SIZE_OFFSET + LEAF_NODE_CONTENT_SIZE_SIZE;
+constexpr uint32_t LEAF_NODE_HEADER_SIZE = LEAF_NODE_FRAGMENTED_SIZE_OFFSET + LEAF_NODE_FRAGMENTED_SIZE_SIZE;
 
 //
 // Leaf Node Body Layout
+// The keys of all cells follow the header as one dense array in
+// key order, then the locations of their records in the same
+// order, so searches read nothing but keys. A location holds the
+// page offset of the record in its low half and the record size in
+// its high half, the leaf does not look into records.
 //
 
 constexpr uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
-constexpr uint32_t LEAF_NODE_KEY_OFFSET = 0;
-constexpr uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
-constexpr uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
-constexpr uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
+constexpr uint32_t LEAF_NODE_KEYS_OFFSET = LEAF_NODE_HEADER_SIZE;
+constexpr uint32_t LEAF_NODE_RECORD_OFFSET_SIZE = sizeof(uint32_t);
+constexpr uint32_t LEAF_NODE_RECORD_OFFSET_MASK = 0xffff;
+constexpr uint32_t LEAF_NODE_RECORD_SIZE_SHIFT = 16;
+constexpr uint32_t LEAF_NODE_SLOT_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_RECORD_OFFSET_SIZE;
+
+constexpr uint32_t LEAF_NODE_MAX_RECORD_SIZE = ROW_MAX_RECORD_SIZE;
+constexpr uint32_t LEAF_NODE_MAX_CELL_SIZE = LEAF_NODE_SLOT_SIZE + LEAF_NODE_MAX_RECORD_SIZE;
 constexpr uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-constexpr uint32_t LEAF_NODE_MAX_CELLS = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
+
+static_assert(COLUMN_EMAIL_SIZE <= UINT8_MAX);
+static_assert(PAGE_SIZE <= LEAF_NODE_RECORD_OFFSET_MASK + 1);
 
 //
 // Internal Node Header Layout
@@ -89,175 +101,154 @@ constexpr uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNA
 
 //
 // Internal Node Body Layout
+// Keys, children and the row counts of the children's subtrees are
+// three dense arrays, each sized for the most cells a node can hold,
+// keys first so searches read only them. The row counts have one
+// more entry, the count of the right child comes after the others.
 //
-constexpr uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(nullptr_t);
-constexpr uint32_t INTERNAL_NODE_VALUE_SIZE = sizeof(nullptr_t);
-constexpr uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_VALUE_SIZE;
-constexpr uint32_t INTERNAL_NODE_SPACE_FOR_CELLS = PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE;
+constexpr uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
+constexpr uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
+constexpr uint32_t INTERNAL_NODE_ROW_COUNT_SIZE = sizeof(uint32_t);
+constexpr uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_ROW_COUNT_SIZE;
+constexpr uint32_t INTERNAL_NODE_SPACE_FOR_CELLS = PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE - INTERNAL_NODE_ROW_COUNT_SIZE;
 constexpr uint32_t INTERNAL_NODE_MAX_CELLS = INTERNAL_NODE_SPACE_FOR_CELLS / INTERNAL_NODE_CELL_SIZE;
+constexpr uint32_t INTERNAL_NODE_KEYS_OFFSET = INTERNAL_NODE_HEADER_SIZE;
+constexpr uint32_t INTERNAL_NODE_CHILDREN_OFFSET = INTERNAL_NODE_KEYS_OFFSET + INTERNAL_NODE_MAX_CELLS * INTERNAL_NODE_KEY_SIZE;
+constexpr uint32_t INTERNAL_NODE_ROW_COUNTS_OFFSET = INTERNAL_NODE_CHILDREN_OFFSET + INTERNAL_NODE_MAX_CELLS * INTERNAL_NODE_CHILD_SIZE;
+
+//
+// Node views
+// Nodes are non-owning views over a page buffer, every field
+// is read from / written to the page with the offsets above,
+// so a view costs nothing to create and can be freely copied.
+// Writes through a view mark the page dirty for the pager.
+//
 
 class Node
 {
 public:
     // functions
 
-    Node(NodeType *nodeType, bool *isRoot, uint32_t *parent_num);
-    virtual ~Node() = default;
+    Node(char *page_data, bool *dirty);
 
-    Node(const Node &) = delete;
-    Node &operator=(const Node &) = delete;
+    NodeType get_node_type() const;
 
-    NodeType get_node_type();
-
-    bool is_root();
+    bool is_root() const;
     void set_root(bool isRoot);
 
-    virtual uint32_t get_max_key() = 0;
-
-    uint32_t get_parent();
+    uint32_t get_parent() const;
     void set_parent(uint32_t page_num);
 
-private:
-    // variables
+    char *get_data() const;
+    void mark_dirty();
 
-    //
-    // Node Header
-    //
+protected:
+    // variables
 
-    NodeType *nodeType;
-    bool *isRoot;
-    uint32_t *parent_num;
-};
+    char *page_data;
+    bool *dirty; // dirty bit of the page, set by every mutating accessor
 
-class LeafNodeCell
-{
-public:
     // functions
 
-    LeafNodeCell(uint32_t *key, Row *value);
-
-    LeafNodeCell(const LeafNodeCell &) = delete;
-    LeafNodeCell &operator=(const LeafNodeCell &) = delete;
-
-    uint32_t get_key();
-    void set_key(uint32_t key);
-
-    Row *get_value();
-    void set_value(const Row &row);
-
-    LeafNodeCell *get_address();
-
-private:
-    // variables
-
-    uint32_t *key;
-    Row *value;
+    uint32_t read_u32(uint32_t offset) const;
+    void write_u32(uint32_t offset, uint32_t value);
 };
 
+//
+// Cells are a slot plus a record of the encoded column values. Space
+// is counted in cell bytes, a cell fits if the used space plus its
+// size stays within LEAF_NODE_SPACE_FOR_CELLS. The gaps of removed
+// records are reclaimed by compacting the page once an insert
+// needs them.
+//
 class LeafNode : public Node
 {
 public:
     // functions
 
-    LeafNode(NodeType *nodeType, uint32_t *next_leaf_num, bool *isRoot, uint32_t *parent_num, uint32_t *num_cells);
-    ~LeafNode();
-
-    LeafNode(const LeafNode &) = delete;
-    LeafNode &operator=(const LeafNode &) = delete;
+    LeafNode(char *page_data, bool *dirty);
+    explicit LeafNode(const Node &node);
 
-    uint32_t get_max_key() override;
+    uint32_t get_max_key() const;
 
-    uint32_t get_num_cells();
-    void set_num_cells(uint32_t num_cells);
+    uint32_t get_num_cells() const;
 
-    void set_cell(uint32_t index, LeafNodeCell *cell); // for initialize from page_data
-    void set_cell(uint32_t index, uint32_t key, const Row &row);
+    uint32_t get_next_leaf() const;
     void set_next_leaf_num(uint32_t next_leaf_num);
 
-    LeafNodeCell *get_cell(uint32_t index);
-    uint32_t get_next_leaf();
-
-    void copy_cell(uint32_t dst_index, uint32_t src_index);
-
-private:
-    // variables
+    uint32_t get_key(uint32_t index) const;
+    // index of the first key not less than key, searching from first on
+    uint32_t find_cell(uint32_t key, uint32_t first = 0) const;
+    void get_row(uint32_t index, Row &row) const;
 
-    // Leaf Node Header
+    static uint32_t get_cell_size(const Row &row);
+    uint32_t get_cell_size(uint32_t index) const;
+    uint32_t get_used_space() const;
+    bool has_room(uint32_t cell_size) const;
 
-    uint32_t *num_cells;
-    uint32_t *next_leaf_num;
+    // the cell has to fit, cells from index on move one slot up
+    void insert_cell(uint32_t index, uint32_t key, const Row &row);
+    void insert_cell(uint32_t index, const LeafNode &src_node, uint32_t src_index);
+    // remove the cells in [first, last)
+    void remove_cells(uint32_t first, uint32_t last);
+    void clear();
 
-    // Leaf Node Body
+private:
+    // functions
 
-    std::array<LeafNodeCell *, LEAF_NODE_MAX_CELLS> cells;
+    char *get_record_offsets() const;
+    uint32_t get_record_offset(uint32_t index) const;
+    uint32_t get_record_size(uint32_t index) const;
+    void set_record_location(uint32_t index, uint32_t record_offset, uint32_t record_size);
+    char *make_room(uint32_t index, uint32_t key, uint32_t record_size);
+    void compact();
 };
 
-class InternalNodeCell
+// A child of an internal node, the key of the right child is not stored
+struct Child
 {
-public:
-    // functions
-
-    InternalNodeCell(uint32_t *key, uint32_t *value);
-
-    InternalNodeCell(const InternalNodeCell &) = delete;
-    InternalNodeCell &operator=(const InternalNodeCell &) = delete;
-
-    uint32_t get_key();
-    void set_key(uint32_t key);
-
-    uint32_t get_value();
-    void set_value(uint32_t child_num);
-
-    InternalNodeCell *get_address();
-
-private:
-    // variables
-
-    uint32_t *key;
-    uint32_t *value;
+    uint32_t max_key;
+    uint32_t page_num;
+    uint32_t row_count; // rows in the subtree of the child
 };
 
+//
+// A subtree never holds every possible key, the root has at least
+// two children and a leaf at least one row, so a row count fits in
+// 32 bits. Sums over a node can exceed it and are 64 bits.
+//
 class InternalNode : public Node
 {
 public:
     // functions
 
-    InternalNode(NodeType *nodeType, bool *isRoot, uint32_t *parent_num, uint32_t *num_keys, uint32_t *right_child_num);
-    ~InternalNode();
+    InternalNode(char *page_data, bool *dirty);
+    explicit InternalNode(const Node &node);
 
-    InternalNode(const InternalNode &) = delete;
-    InternalNode &operator=(const InternalNode &) = delete;
-
-    uint32_t get_max_key() override;
-
-    uint32_t get_num_keys();
+    uint32_t get_num_keys() const;
     void set_num_keys(uint32_t num_keys);
 
-    uint32_t get_right_child();
+    uint32_t get_right_child() const;
     void set_right_child(uint32_t child_num);
 
-    InternalNodeCell *get_cell(uint32_t index);
-    void set_cell(uint32_t index, InternalNodeCell *cell); // for initialize from page_data
     void set_cell(uint32_t index, uint32_t key, uint32_t child_num);
 
-    uint32_t get_key_at_cell(uint32_t index);
-    uint32_t get_child_at_cell(uint32_t index);
+    uint32_t get_key_at_cell(uint32_t index) const;
+    void set_key_at_cell(uint32_t index, uint32_t key);
+    uint32_t get_child_at_cell(uint32_t index) const;
 
-    uint32_t find_child(uint32_t key);
+    // index num_keys is the right child
+    uint32_t get_row_count(uint32_t index) const;
+    void set_row_count(uint32_t index, uint32_t row_count);
+    // rows in the children before index
+    uint64_t get_row_count_before(uint32_t index) const;
+    uint64_t get_total_row_count() const;
+
+    uint32_t find_child(uint32_t key) const;
+    // index of the child holding the row at rank, rank becomes the rank within it
+    uint32_t find_child_by_rank(uint64_t &rank) const;
 
     void update_key(uint32_t old_key, uint32_t new_key);
 
     void copy_cell(uint32_t dst_index, uint32_t src_index);
-
-private:
-    // variables
-
-    // Internal Node Header
-
-    uint32_t *num_keys;
-    uint32_t *right_child; // page number of its rightmost child
-
-    // Internal Node Body
-
-    std::array<InternalNodeCell *, INTERNAL_NODE_MAX_CELLS> cells;
-};
\ No newline at end of file
+};
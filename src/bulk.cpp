@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "bulk.hpp"
+
+BulkLoader::BulkLoader(Table &table, double fill_factor)
+    : table(table), leaf_size(0), leaf_page_num(0), has_leaf_page(false), row_num(0), last_key(0), finished(false)
+{
+    if (fill_factor <= 0 || fill_factor > 1)
+    {
+        throw std::invalid_argument("Fill factor must be greater than 0 and at most 1.");
+    }
+
+    Node root = this->table.pager->get_page(this->table.get_root());
+    if (root.get_node_type() != NodeType::LEAF || LeafNode(root).get_num_cells() != 0)
+    {
+        throw std::runtime_error("Bulk load needs an empty table.");
+    }
+
+    this->leaf_capacity = LEAF_NODE_SPACE_FOR_CELLS * fill_factor;
+    // one slot is kept spare, so the last node of a level can always
+    // be merged into its left sibling if it ends up with a single child
+    this->internal_capacity = std::clamp<uint32_t>((INTERNAL_NODE_MAX_CELLS + 1) * fill_factor, 2, INTERNAL_NODE_MAX_CELLS);
+}
+
+bool BulkLoader::add(const Row &row)
+{
+    if (this->finished)
+    {
+        throw std::logic_error("Bulk load already finished.");
+    }
+    if (this->row_num > 0 && row.id <= this->last_key)
+    {
+        return false;
+    }
+
+    uint32_t cell_size = LeafNode::get_cell_size(row);
+    if (!this->leaf_rows.empty() && this->leaf_size + cell_size > this->leaf_capacity)
+    {
+        // Leaf is full and another one follows it
+        if (!this->has_leaf_page)
+        {
+            this->leaf_page_num = this->table.pager->allocate_page();
+            this->has_leaf_page = true;
+        }
+        uint32_t next_leaf_num = this->table.pager->allocate_page();
+        uint32_t parent_page_num = this->add_child(0, {this->leaf_rows.back().id, this->leaf_page_num, (uint32_t)this->leaf_rows.size()});
+        this->write_leaf(this->leaf_page_num, parent_page_num, next_leaf_num);
+
+        this->leaf_page_num = next_leaf_num;
+        this->leaf_rows.clear();
+        this->leaf_size = 0;
+    }
+
+    this->leaf_rows.push_back(row);
+    this->leaf_size += cell_size;
+    this->last_key = row.id;
+    this->row_num++;
+    return true;
+}
+
+void BulkLoader::finish()
+{
+    if (this->finished)
+    {
+        return;
+    }
+    this->finished = true;
+    this->table.invalidate_rightmost_leaf();
+
+    if (!this->has_leaf_page)
+    {
+        // Everything fits in the root leaf
+        this->write_leaf(this->table.get_root(), 0, 0);
+        return;
+    }
+
+    uint32_t parent_page_num = this->add_child(0, {this->leaf_rows.back().id, this->leaf_page_num, (uint32_t)this->leaf_rows.size()});
+    this->write_leaf(this->leaf_page_num, parent_page_num, 0);
+
+    // closing a level adds a child to the level above, which may create it
+    for (uint32_t level = 0; level < this->levels.size(); level++)
+    {
+        this->close_level(level);
+    }
+}
+
+uint64_t BulkLoader::get_row_num()
+{
+    return this->row_num;
+}
+
+//
+// Add a child to the open node of the given level and return the
+// page number of that node. A full node is written out first and
+// a new one is opened in its place.
+//
+uint32_t BulkLoader::add_child(uint32_t level, const Child &child)
+{
+    if (level == this->levels.size())
+    {
+        this->levels.push_back(Level{this->table.pager->allocate_page(), 0, {}});
+        this->levels.back().children.reserve(this->internal_capacity);
+    }
+
+    if (this->levels[level].children.size() == this->internal_capacity)
+    {
+        uint32_t closed_page_num = this->levels[level].page_num;
+        uint32_t parent_page_num = this->add_child(level + 1, this->get_parent_child(level, closed_page_num));
+        this->write_internal(closed_page_num, this->levels[level].children, parent_page_num);
+
+        this->levels[level].page_num = this->table.pager->allocate_page();
+        this->levels[level].closed_num++;
+        this->levels[level].children.clear();
+    }
+
+    this->levels[level].children.push_back(child);
+    return this->levels[level].page_num;
+}
+
+// the entry of the open node of a level in the level above
+Child BulkLoader::get_parent_child(uint32_t level, uint32_t page_num)
+{
+    uint32_t row_count = 0;
+    for (const auto &child : this->levels[level].children)
+    {
+        row_count += child.row_count;
+    }
+    return {this->levels[level].children.back().max_key, page_num, row_count};
+}
+
+// write out the open node of a level once all input is consumed
+void BulkLoader::close_level(uint32_t level)
+{
+    bool is_top = level + 1 == this->levels.size() && this->levels[level].closed_num == 0;
+    if (is_top)
+    {
+        // The only node of the top level becomes the root, its children
+        // were given the page reserved for it as parent and are moved
+        // over. The reserved page itself is not needed any more.
+        Pager &pager = *this->table.pager;
+        uint32_t root_page_num = this->table.get_root();
+        pager.free_page(this->levels[level].page_num);
+        if (this->levels[level].children.size() == 1)
+        {
+            // The level below was absorbed into a single node, which is
+            // copied into the root instead and its old page freed.
+            uint32_t child_page_num = this->levels[level].children[0].page_num;
+            pager.copy_node_data(root_page_num, child_page_num);
+            PinGuard root_guard(pager, root_page_num);
+            InternalNode root = pager.get_internal(root_page_num);
+            root.set_root(true);
+            root.set_parent(0);
+            for (uint32_t i = 0; i <= root.get_num_keys(); i++)
+            {
+                pager.get_page(root.get_child_at_cell(i)).set_parent(root_page_num);
+            }
+            pager.free_page(child_page_num);
+            return;
+        }
+
+        this->write_internal(root_page_num, this->levels[level].children, 0);
+        for (const auto &child : this->levels[level].children)
+        {
+            pager.get_page(child.page_num).set_parent(root_page_num);
+        }
+        return;
+    }
+
+    if (this->levels[level].children.size() == 1)
+    {
+        this->absorb_last_child(level);
+        return;
+    }
+
+    uint32_t page_num = this->levels[level].page_num;
+    uint32_t parent_page_num = this->add_child(level + 1, this->get_parent_child(level, page_num));
+    this->write_internal(page_num, this->levels[level].children, parent_page_num);
+}
+
+//
+// An internal node needs at least one key, so a single trailing
+// child is appended to the left sibling instead, which is the last
+// child of the open node one level up.
+//
+void BulkLoader::absorb_last_child(uint32_t level)
+{
+    Pager &pager = *this->table.pager;
+    auto child = this->levels[level].children.back();
+    auto &sibling = this->levels[level + 1].children.back();
+
+    PinGuard sibling_guard(pager, sibling.page_num);
+    InternalNode node = pager.get_internal(sibling.page_num);
+    uint32_t num_keys = node.get_num_keys();
+    node.set_cell(num_keys, sibling.max_key, node.get_right_child());
+    node.set_num_keys(num_keys + 1);
+    node.set_right_child(child.page_num);
+    node.set_row_count(num_keys + 1, child.row_count);
+
+    pager.get_page(child.page_num).set_parent(sibling.page_num);
+    sibling.max_key = child.max_key;
+    sibling.row_count += child.row_count;
+}
+
+void BulkLoader::write_leaf(uint32_t page_num, uint32_t parent_page_num, uint32_t next_leaf_num)
+{
+    LeafNode node = this->table.pager->get_leaf(page_num);
+    if (!node.is_root())
+    {
+        node.set_parent(parent_page_num);
+    }
+    node.set_next_leaf_num(next_leaf_num);
+    node.clear();
+    for (uint32_t i = 0; i < this->leaf_rows.size(); i++)
+    {
+        node.insert_cell(i, this->leaf_rows[i].id, this->leaf_rows[i]);
+    }
+}
+
+void BulkLoader::write_internal(uint32_t page_num, const std::vector<Child> &children, uint32_t parent_page_num)
+{
+    bool is_root = page_num == this->table.get_root();
+    InternalNode node = InternalNode(this->table.pager->set_node_type(page_num, NodeType::INTERNAL));
+    node.set_root(is_root);
+    node.set_parent(parent_page_num);
+    node.set_num_keys(children.size() - 1);
+    for (uint32_t i = 0; i + 1 < children.size(); i++)
+    {
+        node.set_cell(i, children[i].max_key, children[i].page_num);
+    }
+    node.set_right_child(children.back().page_num);
+    for (uint32_t i = 0; i < children.size(); i++)
+    {
+        node.set_row_count(i, children[i].row_count);
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "table.hpp"
+
+constexpr double DEFAULT_BULK_FILL_FACTOR = 1.0;
+
+//
+// Builds the B-tree of an empty table bottom-up from rows
+// given in ascending key order. Leaves are packed left to
+// right up to the fill factor of their space, with at least
+// one row each, and every level keeps one open node whose
+// page number is reserved up front, so each page is written
+// once with its parent and next leaf already known.
+// The root page is only written by finish(), until then the
+// table still looks empty.
+//
+class BulkLoader
+{
+public:
+    // functions
+
+    explicit BulkLoader(Table &table, double fill_factor = DEFAULT_BULK_FILL_FACTOR);
+
+    BulkLoader(const BulkLoader &) = delete;
+    BulkLoader &operator=(const BulkLoader &) = delete;
+
+    // returns false if the key is not greater than the previous one
+    bool add(const Row &row);
+    void finish();
+
+    uint64_t get_row_num();
+
+private:
+    // an internal node being filled
+    struct Level
+    {
+        uint32_t page_num;
+        uint32_t closed_num;
+        std::vector<Child> children;
+    };
+
+    // variables
+
+    Table &table;
+
+    uint32_t leaf_capacity;     // cell bytes per leaf
+    uint32_t internal_capacity; // children per internal node
+
+    std::vector<Row> leaf_rows;
+    uint32_t leaf_size;
+    uint32_t leaf_page_num;
+    bool has_leaf_page;
+
+    std::vector<Level> levels; // levels[0] is the parent level of the leaves
+
+    uint64_t row_num;
+    uint32_t last_key;
+    bool finished;
+
+    // functions
+
+    void write_leaf(uint32_t page_num, uint32_t parent_page_num, uint32_t next_leaf_num);
+    void write_internal(uint32_t page_num, const std::vector<Child> &children, uint32_t parent_page_num);
+
+    uint32_t add_child(uint32_t level, const Child &child);
+    Child get_parent_child(uint32_t level, uint32_t page_num);
+    void close_level(uint32_t level);
+    void absorb_last_child(uint32_t level);
+};
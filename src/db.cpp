@@ -1,23 +1,308 @@
 #include <iostream>
+#include <stdexcept>
+#include <unordered_set>
 
 #include "db.hpp"
+#include "format.hpp"
+#include "index.hpp"
 
-const char *UNKNOWN_TABLE_NAME = "Default_Table";
-
-Database::Database(const std::string &filename)
+Database::Database(const std::string &filename, const PagerOptions &options)
 {
-    Table *table = new Table(filename);
-    tables[UNKNOWN_TABLE_NAME] = table;
+    // the log may hold pages the upgrade check has to see
+    Wal::recover(filename);
+    upgrade_file(filename);
+    this->pager = new Pager(filename, options);
+
+    if (this->pager->get_page_num() == 0)
+    {
+        // New database file. Initialize the header page, page 1 as
+        // the catalog, page 2 as the root leaf node of the default
+        // table and page 3 as its schema, the default columns.
+        uint32_t catalog_page_num = HEADER_PAGE_NUM + 1;
+        uint32_t root_page_num = HEADER_PAGE_NUM + 2;
+        uint32_t schema_page_num = HEADER_PAGE_NUM + 3;
+        FileHeader header(this->pager->get_page(HEADER_PAGE_NUM));
+        header.initialize(catalog_page_num);
+
+        Catalog catalog(this->pager->get_page(catalog_page_num));
+        catalog.initialize();
+        catalog.add_table(DEFAULT_TABLE_NAME, root_page_num, schema_page_num);
+
+        SchemaPage(this->pager->get_page(schema_page_num)).initialize(Schema::get_default());
+
+        Node root_node = this->pager->get_page(root_page_num);
+        root_node.set_root(true);
+        // a transaction opened right away must not roll them back
+        this->pager->commit();
+    }
+    else
+    {
+        FileHeader header(this->pager->get_page(HEADER_PAGE_NUM));
+        if (!header.has_magic() || header.get_page_size() != PAGE_SIZE)
+        {
+            delete this->pager;
+            throw std::runtime_error("File Corrupted. Invalid file header: " + filename);
+        }
+    }
+
+    std::vector<std::string> table_names = this->get_table_names();
+    for (uint32_t i = 0; i < table_names.size(); i++)
+    {
+        this->tables[table_names[i]] = new Table(this->pager, i);
+    }
 }
 
 Database::~Database()
 {
     std::cout << "Closing database, please wait..." << std::endl;
-    delete this->tables[UNKNOWN_TABLE_NAME];
+    try
+    {
+        this->pager->flush_all();
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+    for (auto &[table_name, table] : this->tables)
+    {
+        delete table;
+    }
+    delete this->pager;
     std::cout << "Database closed." << std::endl;
 }
 
-Table *Database::get_table(const std::string &table_name)
+Catalog Database::get_catalog()
+{
+    uint32_t catalog_page_num = FileHeader(this->pager->get_page(HEADER_PAGE_NUM)).get_catalog_page();
+    return Catalog(this->pager->get_page(catalog_page_num));
+}
+
+Table *Database::get_table(std::string_view table_name)
+{
+    auto table = this->tables.find(std::string(table_name));
+    return table == this->tables.end() ? nullptr : table->second;
+}
+
+std::vector<std::string> Database::get_table_names()
+{
+    Catalog catalog = this->get_catalog();
+    std::vector<std::string> table_names;
+    for (uint32_t i = 0; i < catalog.get_num_tables(); i++)
+    {
+        table_names.emplace_back(catalog.get_table_name(i));
+    }
+    return table_names;
+}
+
+// the root is a fresh page, an empty leaf, and the schema gets one of its own
+Table *Database::create_table(std::string_view table_name, const Schema &schema)
+{
+    if (this->get_catalog().get_num_tables() >= CATALOG_MAX_TABLES)
+    {
+        throw std::length_error("The catalog is full.");
+    }
+    uint32_t root_page_num = this->pager->allocate_page();
+    this->pager->get_page(root_page_num).set_root(true);
+    uint32_t schema_page_num = this->pager->allocate_page();
+    SchemaPage(this->pager->get_page(schema_page_num)).initialize(schema);
+    uint32_t catalog_index = this->get_catalog().add_table(table_name, root_page_num, schema_page_num);
+
+    Table *table = new Table(this->pager, catalog_index);
+    this->tables[std::string(table_name)] = table;
+    return table;
+}
+
+void Database::reload_tables()
+{
+    for (auto &[table_name, table] : this->tables)
+    {
+        table->reload();
+    }
+}
+
+//
+// Compact the file: every live page past the number of live pages
+// is copied into a free page before it, then the end is cut off.
+// Pointers to a moved page are fixed up in its parent, its children
+// and the leaf before it in the leaf chain of its table, or in the
+// header, the catalog and the schema pages for the catalog page,
+// the schema pages and the roots. Index pages move the same way,
+// their leaves are not chained.
+//
+uint32_t Database::vacuum()
+{
+    uint32_t num_pages = this->pager->get_page_num();
+    std::unordered_set<uint32_t> free_pages;
+    {
+        FileHeader header(this->pager->get_page(HEADER_PAGE_NUM));
+        uint32_t trunk_page_num = header.get_free_trunk_page();
+        while (trunk_page_num != 0)
+        {
+            FreeTrunk trunk(this->pager->get_page(trunk_page_num));
+            free_pages.insert(trunk_page_num);
+            for (uint32_t i = 0; i < trunk.get_num_leaves(); i++)
+            {
+                free_pages.insert(trunk.get_leaf(i));
+            }
+            trunk_page_num = trunk.get_next_trunk();
+        }
+    }
+    if (free_pages.empty())
+    {
+        return 0;
+    }
+    uint32_t live_pages = num_pages - free_pages.size();
+
+    std::unordered_map<uint32_t, uint32_t> previous_leaves; // leaf -> leaf before it
+    for (auto &[table_name, table] : this->tables)
+    {
+        uint32_t page_num = table->get_root();
+        Node node = this->pager->get_page(page_num);
+        while (node.get_node_type() == NodeType::INTERNAL)
+        {
+            page_num = InternalNode(node).get_child_at_cell(0);
+            node = this->pager->get_page(page_num);
+        }
+        for (uint32_t next_page_num = LeafNode(node).get_next_leaf(); next_page_num != 0;)
+        {
+            previous_leaves[next_page_num] = page_num;
+            page_num = next_page_num;
+            next_page_num = this->pager->get_leaf(page_num).get_next_leaf();
+        }
+    }
+
+    std::vector<uint32_t> targets;
+    for (uint32_t free_page_num : free_pages)
+    {
+        if (free_page_num < live_pages)
+        {
+            targets.push_back(free_page_num);
+        }
+    }
+    for (uint32_t src_page_num = live_pages; src_page_num < num_pages; src_page_num++)
+    {
+        if (free_pages.find(src_page_num) == free_pages.end())
+        {
+            this->move_page(src_page_num, targets.back(), previous_leaves);
+            targets.pop_back();
+        }
+    }
+
+    FileHeader header(this->pager->get_page(HEADER_PAGE_NUM));
+    header.set_free_trunk_page(0);
+    header.set_free_page_count(0);
+    this->reload_tables();
+    this->pager->truncate(live_pages);
+    return num_pages - live_pages;
+}
+
+void Database::move_page(uint32_t src_page_num, uint32_t dst_page_num, std::unordered_map<uint32_t, uint32_t> &previous_leaves)
 {
-    return tables[table_name];
-}
\ No newline at end of file
+    this->pager->copy_node_data(dst_page_num, src_page_num);
+    {
+        FileHeader header(this->pager->get_page(HEADER_PAGE_NUM));
+        if (header.get_catalog_page() == src_page_num)
+        {
+            // not a node, nothing points at it but the header
+            header.set_catalog_page(dst_page_num);
+            return;
+        }
+    }
+    {
+        Catalog catalog = this->get_catalog();
+        for (uint32_t i = 0; i < catalog.get_num_tables(); i++)
+        {
+            if (catalog.get_schema_page(i) == src_page_num)
+            {
+                // not a node either, only its catalog entry points at it
+                catalog.set_schema_page(i, dst_page_num);
+                return;
+            }
+        }
+    }
+    PinGuard node_guard(*this->pager, dst_page_num);
+    Node node = this->pager->get_page(dst_page_num);
+
+    if (node.is_root())
+    {
+        // read the schema pages after the catalog, each fetch may evict the page before
+        std::vector<uint32_t> schema_pages;
+        {
+            Catalog catalog = this->get_catalog();
+            for (uint32_t i = 0; i < catalog.get_num_tables(); i++)
+            {
+                if (catalog.get_root_page(i) == src_page_num)
+                {
+                    catalog.set_root_page(i, dst_page_num);
+                }
+                schema_pages.push_back(catalog.get_schema_page(i));
+            }
+        }
+        for (uint32_t schema_page_num : schema_pages)
+        {
+            SchemaPage schema_page(this->pager->get_page(schema_page_num));
+            for (uint32_t column = 0; column < schema_page.get_num_columns(); column++)
+            {
+                if (schema_page.get_index_root_page(column) == src_page_num)
+                {
+                    schema_page.set_index_root_page(column, dst_page_num);
+                }
+            }
+        }
+    }
+    else if (node.get_node_type() == NodeType::INDEX_LEAF || node.get_node_type() == NodeType::INDEX_INTERNAL)
+    {
+        IndexNode parent = IndexNode(this->pager->get_page(node.get_parent()));
+        parent.set_child(parent.find_child(src_page_num), dst_page_num);
+    }
+    else
+    {
+        InternalNode parent = this->pager->get_internal(node.get_parent());
+        uint32_t num_keys = parent.get_num_keys();
+        if (parent.get_right_child() == src_page_num)
+        {
+            parent.set_right_child(dst_page_num);
+        }
+        for (uint32_t i = 0; i < num_keys; i++)
+        {
+            if (parent.get_child_at_cell(i) == src_page_num)
+            {
+                parent.set_cell(i, parent.get_key_at_cell(i), dst_page_num);
+            }
+        }
+    }
+
+    if (node.get_node_type() == NodeType::INTERNAL)
+    {
+        InternalNode internal = InternalNode(node);
+        for (uint32_t i = 0; i <= internal.get_num_keys(); i++)
+        {
+            this->pager->get_page(internal.get_child_at_cell(i)).set_parent(dst_page_num);
+        }
+        return;
+    }
+    if (node.get_node_type() == NodeType::INDEX_INTERNAL)
+    {
+        IndexNode internal = IndexNode(node);
+        for (uint32_t i = 0; i <= internal.get_num_keys(); i++)
+        {
+            this->pager->get_page(internal.get_child(i)).set_parent(dst_page_num);
+        }
+        return;
+    }
+    if (node.get_node_type() == NodeType::INDEX_LEAF)
+    {
+        return;
+    }
+
+    LeafNode leaf = LeafNode(node);
+    auto previous = previous_leaves.find(src_page_num);
+    if (previous != previous_leaves.end())
+    {
+        this->pager->get_leaf(previous->second).set_next_leaf_num(dst_page_num);
+    }
+    if (leaf.get_next_leaf() != 0)
+    {
+        previous_leaves[leaf.get_next_leaf()] = dst_page_num;
+    }
+}
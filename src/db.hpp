@@ -1,24 +1,50 @@
 #pragma once
 
-#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "table.hpp"
 
-// Only one table is supported, essentially a swapper of Table
+//
+// A database file and its tables. The file has one pager, and so one
+// buffer pool and one log, shared by every table listed in its catalog.
+//
 class Database
 {
 public:
+    // variables
+
+    Pager *pager;
+
     // functions
 
-    explicit Database(const std::string &filename);
+    explicit Database(const std::string &filename, const PagerOptions &options = PagerOptions());
     ~Database();
 
     Database(const Database &) = delete;
     Database &operator=(const Database &) = delete;
 
-    // Currently, only one table is support which is "Default_Table"
-    Table *get_table(const std::string &table_name = "Default_Table");
+    // nullptr if there is no table of that name
+    Table *get_table(std::string_view table_name = DEFAULT_TABLE_NAME);
+    // names in the order the tables were created
+    std::vector<std::string> get_table_names();
+    // the name must be new, the catalog must have room and the schema fit its page
+    Table *create_table(std::string_view table_name, const Schema &schema);
+    // after a rollback, the tables read their root pages again
+    void reload_tables();
+
+    // move live pages into free ones and cut the file, returns the pages released
+    uint32_t vacuum();
 
 private:
+    // variables
+
     std::unordered_map<std::string, Table *> tables;
-};
\ No newline at end of file
+
+    // functions
+
+    Catalog get_catalog();
+    void move_page(uint32_t src_page_num, uint32_t dst_page_num, std::unordered_map<uint32_t, uint32_t> &previous_leaves);
+};
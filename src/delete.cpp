@@ -0,0 +1,457 @@
+#include <algorithm>
+
+#include "delete.hpp"
+
+Deleter::Deleter(Table &table)
+    : table(table), low(0), high(0), row_num(0) {}
+
+uint64_t Deleter::erase(uint32_t low, uint32_t high)
+{
+    if (low > high)
+    {
+        return 0;
+    }
+    this->low = low;
+    this->high = high;
+    this->row_num = 0;
+    Pager &pager = *this->table.pager;
+
+    // The leaves holding the last key before and the first key
+    // after the range are linked once everything between is gone.
+    // Both keep those keys, so neither is freed.
+    uint32_t previous_leaf_num = 0;
+    uint32_t low_leaf_num = this->find_leaf(low, previous_leaf_num);
+    LeafNode low_leaf = pager.get_leaf(low_leaf_num);
+    if (low_leaf.get_num_cells() > 0 && low_leaf.get_key(0) < low)
+    {
+        previous_leaf_num = low_leaf_num;
+    }
+
+    uint32_t unused_leaf_num = 0;
+    uint32_t high_leaf_num = this->find_leaf(high, unused_leaf_num);
+    LeafNode high_leaf = pager.get_leaf(high_leaf_num);
+    uint32_t next_leaf_num = high_leaf.get_next_leaf();
+    if (high_leaf.get_num_cells() > 0 && high_leaf.get_max_key() > high)
+    {
+        next_leaf_num = high_leaf_num;
+    }
+
+    uint32_t root_page_num = this->table.get_root();
+    if (this->erase_node(root_page_num, -1, UINT32_MAX) &&
+        pager.get_page(root_page_num).get_node_type() == NodeType::INTERNAL)
+    {
+        // Every row is gone, the root is an empty leaf again
+        pager.set_node_type(root_page_num, NodeType::LEAF).set_root(true);
+    }
+    if (this->row_num == 0)
+    {
+        return 0;
+    }
+    if (previous_leaf_num != 0 && previous_leaf_num != next_leaf_num)
+    {
+        pager.get_leaf(previous_leaf_num).set_next_leaf_num(next_leaf_num);
+    }
+
+    // a root with a single child blocks merges below it
+    do
+    {
+        this->collapse_root();
+    } while (this->rebalance(root_page_num));
+
+    this->table.invalidate_rightmost_leaf();
+    return this->row_num;
+}
+
+//
+// Return the leaf whose key range holds the given key, and the
+// rightmost leaf of the nearest subtree to the left of the path
+// as the leaf before it, 0 if the path is the leftmost one.
+//
+uint32_t Deleter::find_leaf(uint32_t key, uint32_t &previous_leaf_num)
+{
+    Pager &pager = *this->table.pager;
+    uint32_t page_num = this->table.get_root();
+    uint32_t left_page_num = 0;
+
+    Node node = pager.get_page(page_num);
+    while (node.get_node_type() == NodeType::INTERNAL)
+    {
+        InternalNode internal = InternalNode(node);
+        uint32_t index = internal.find_child(key);
+        if (index > 0)
+        {
+            left_page_num = internal.get_child_at_cell(index - 1);
+        }
+        page_num = internal.get_child_at_cell(index);
+        node = pager.get_page(page_num);
+    }
+
+    previous_leaf_num = left_page_num;
+    if (left_page_num != 0)
+    {
+        node = pager.get_page(left_page_num);
+        while (node.get_node_type() == NodeType::INTERNAL)
+        {
+            previous_leaf_num = InternalNode(node).get_right_child();
+            node = pager.get_page(previous_leaf_num);
+        }
+    }
+    return page_num;
+}
+
+//
+// Remove the keys in range from the subtree whose keys lie in
+// (lower_bound, upper_bound]. Children entirely in range are freed
+// without reading their leaves, the at most two children the range
+// ends in are descended into. Returns true if nothing is left of
+// the node, the caller frees it then.
+//
+bool Deleter::erase_node(uint32_t page_num, int64_t lower_bound, int64_t upper_bound)
+{
+    Pager &pager = *this->table.pager;
+    Node node = pager.get_page(page_num);
+
+    if (node.get_node_type() == NodeType::LEAF)
+    {
+        LeafNode leaf = LeafNode(node);
+        uint32_t num_cells = leaf.get_num_cells();
+        uint32_t first = leaf.find_cell(this->low);
+        uint32_t last = this->high == UINT32_MAX ? num_cells : leaf.find_cell(this->high + 1, first);
+        if (last > first)
+        {
+            leaf.remove_cells(first, last);
+            this->row_num += last - first;
+        }
+        return leaf.get_num_cells() == 0;
+    }
+
+    uint64_t start_row_num = this->row_num;
+    Children children = this->get_children(page_num, upper_bound);
+    Children kept;
+    kept.reserve(children.size());
+    int64_t child_lower_bound = lower_bound;
+    for (uint32_t i = 0; i < children.size(); i++)
+    {
+        int64_t child_upper_bound = i + 1 < children.size() ? children[i].max_key : upper_bound;
+        uint32_t child_page_num = children[i].page_num;
+
+        if (child_upper_bound < this->low || child_lower_bound >= this->high)
+        {
+            kept.push_back(children[i]);
+        }
+        else if (child_lower_bound + 1 >= this->low && child_upper_bound <= this->high)
+        {
+            this->row_num += children[i].row_count;
+            this->free_subtree(child_page_num);
+        }
+        else
+        {
+            uint64_t child_start_row_num = this->row_num;
+            if (this->erase_node(child_page_num, child_lower_bound, child_upper_bound))
+            {
+                pager.free_page(child_page_num);
+            }
+            else
+            {
+                kept.push_back(children[i]);
+                kept.back().row_count -= this->row_num - child_start_row_num;
+            }
+        }
+        child_lower_bound = child_upper_bound;
+    }
+
+    if (this->row_num == start_row_num)
+    {
+        return false;
+    }
+    if (kept.empty())
+    {
+        return true;
+    }
+    this->set_children(page_num, kept);
+    return false;
+}
+
+// leaves are all on one level, below an internal node whose first child is one
+void Deleter::free_subtree(uint32_t page_num)
+{
+    Pager &pager = *this->table.pager;
+    Node node = pager.get_page(page_num);
+    if (node.get_node_type() == NodeType::INTERNAL)
+    {
+        Children children = this->get_children(page_num, 0);
+        bool has_leaves = pager.get_page(children[0].page_num).get_node_type() == NodeType::LEAF;
+        for (const auto &child : children)
+        {
+            if (has_leaves)
+            {
+                pager.free_page(child.page_num);
+            }
+            else
+            {
+                this->free_subtree(child.page_num);
+            }
+        }
+    }
+    pager.free_page(page_num);
+}
+
+//
+// Merge or refill the underfull nodes on the paths to both ends of
+// the range, children first. Returns true if anything was changed,
+// a merge may leave a node below it underfull on another pass.
+//
+bool Deleter::rebalance(uint32_t page_num)
+{
+    Pager &pager = *this->table.pager;
+    Node node = pager.get_page(page_num);
+    if (node.get_node_type() == NodeType::LEAF)
+    {
+        return false;
+    }
+
+    InternalNode internal = InternalNode(node);
+    uint32_t low_child_num = internal.get_child_at_cell(internal.find_child(this->low));
+    uint32_t high_child_num = internal.get_child_at_cell(internal.find_child(this->high));
+    bool changed = this->rebalance(low_child_num);
+    if (high_child_num != low_child_num)
+    {
+        changed = this->rebalance(high_child_num) || changed;
+    }
+
+    while (true)
+    {
+        internal = pager.get_internal(page_num);
+        if (internal.get_num_keys() == 0)
+        {
+            break;
+        }
+        uint32_t low_index = internal.find_child(this->low);
+        uint32_t high_index = internal.find_child(this->high);
+        uint32_t high_page_num = internal.get_child_at_cell(high_index);
+        if (this->is_underfull(internal.get_child_at_cell(low_index)))
+        {
+            this->fix_child(page_num, low_index);
+        }
+        else if (this->is_underfull(high_page_num))
+        {
+            this->fix_child(page_num, high_index);
+        }
+        else
+        {
+            break;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+bool Deleter::is_underfull(uint32_t page_num)
+{
+    Node node = this->table.pager->get_page(page_num);
+    if (node.get_node_type() == NodeType::LEAF)
+    {
+        return LeafNode(node).get_used_space() < LEAF_NODE_MIN_USED_SPACE;
+    }
+    return InternalNode(node).get_num_keys() + 1 < INTERNAL_NODE_MIN_CHILDREN;
+}
+
+// merge the child at index with a sibling or move entries over from it
+void Deleter::fix_child(uint32_t page_num, uint32_t index)
+{
+    Children children = this->get_children(page_num, 0);
+    uint32_t left = index > 0 ? index - 1 : index;
+
+    if (this->table.pager->get_page(children[left].page_num).get_node_type() == NodeType::LEAF)
+    {
+        this->rebalance_leaves(children, left);
+    }
+    else
+    {
+        this->rebalance_internals(children, left);
+    }
+    this->set_children(page_num, children);
+}
+
+//
+// Move the cells of the right leaf into the left one if they fit,
+// otherwise share them evenly by size. The key of the left leaf
+// becomes the key of the right one on a merge, its exact max
+// otherwise. Row counts follow the cells.
+//
+void Deleter::rebalance_leaves(Children &children, uint32_t left)
+{
+    Pager &pager = *this->table.pager;
+    uint32_t left_page_num = children[left].page_num;
+    uint32_t right_page_num = children[left + 1].page_num;
+    PinGuard left_guard(pager, left_page_num);
+    PinGuard right_guard(pager, right_page_num);
+    LeafNode left_node = pager.get_leaf(left_page_num);
+    LeafNode right_node = pager.get_leaf(right_page_num);
+    uint32_t left_count = left_node.get_num_cells();
+    uint32_t right_count = right_node.get_num_cells();
+
+    if (left_node.has_room(right_node.get_used_space()))
+    {
+        for (uint32_t i = 0; i < right_count; i++)
+        {
+            left_node.insert_cell(left_count + i, right_node, i);
+        }
+        left_node.set_next_leaf_num(right_node.get_next_leaf());
+
+        children[left].max_key = children[left + 1].max_key;
+        children[left].row_count = left_node.get_num_cells();
+        children.erase(children.begin() + left + 1);
+        pager.free_page(right_page_num);
+        return;
+    }
+
+    // a cell narrows the difference as long as it is smaller than it
+    uint32_t left_size = left_node.get_used_space();
+    uint32_t right_size = right_node.get_used_space();
+    if (left_size > right_size)
+    {
+        uint32_t moved = 0;
+        uint32_t size;
+        while (left_size > right_size && (size = left_node.get_cell_size(left_count - moved - 1)) < left_size - right_size)
+        {
+            left_size -= size;
+            right_size += size;
+            moved++;
+        }
+        for (uint32_t i = 0; i < moved; i++)
+        {
+            right_node.insert_cell(i, left_node, left_count - moved + i);
+        }
+        left_node.remove_cells(left_count - moved, left_count);
+    }
+    else
+    {
+        uint32_t moved = 0;
+        uint32_t size;
+        while (right_size > left_size && (size = right_node.get_cell_size(moved)) < right_size - left_size)
+        {
+            right_size -= size;
+            left_size += size;
+            moved++;
+        }
+        for (uint32_t i = 0; i < moved; i++)
+        {
+            left_node.insert_cell(left_count + i, right_node, i);
+        }
+        right_node.remove_cells(0, moved);
+    }
+    children[left].max_key = left_node.get_max_key();
+    children[left].row_count = left_node.get_num_cells();
+    children[left + 1].row_count = right_node.get_num_cells();
+}
+
+//
+// Same for internal nodes. The right child of the left node has no
+// key of its own, the key of the left node in the parent bounds it.
+//
+void Deleter::rebalance_internals(Children &children, uint32_t left)
+{
+    Pager &pager = *this->table.pager;
+    uint32_t left_page_num = children[left].page_num;
+    uint32_t right_page_num = children[left + 1].page_num;
+    Children combined = this->get_children(left_page_num, children[left].max_key);
+    uint32_t left_count = combined.size();
+    Children right_children = this->get_children(right_page_num, children[left + 1].max_key);
+    combined.insert(combined.end(), right_children.begin(), right_children.end());
+
+    if (combined.size() <= INTERNAL_NODE_MAX_CELLS + 1)
+    {
+        this->set_children(left_page_num, combined);
+        for (const auto &child : right_children)
+        {
+            pager.get_page(child.page_num).set_parent(left_page_num);
+        }
+
+        children[left].max_key = children[left + 1].max_key;
+        children[left].row_count += children[left + 1].row_count;
+        children.erase(children.begin() + left + 1);
+        pager.free_page(right_page_num);
+        return;
+    }
+
+    uint32_t target = combined.size() / 2;
+    this->set_children(left_page_num, Children(combined.begin(), combined.begin() + target));
+    this->set_children(right_page_num, Children(combined.begin() + target, combined.end()));
+    for (uint32_t i = std::min(left_count, target); i < std::max(left_count, target); i++)
+    {
+        pager.get_page(combined[i].page_num).set_parent(i < target ? left_page_num : right_page_num);
+    }
+    uint32_t total_row_count = children[left].row_count + children[left + 1].row_count;
+    uint32_t left_row_count = 0;
+    for (uint32_t i = 0; i < target; i++)
+    {
+        left_row_count += combined[i].row_count;
+    }
+    children[left].row_count = left_row_count;
+    children[left + 1].row_count = total_row_count - left_row_count;
+    children[left].max_key = combined[target - 1].max_key;
+}
+
+//
+// While the root is an internal node with a single child, move
+// that child into the root page, the root page number never changes.
+//
+void Deleter::collapse_root()
+{
+    Pager &pager = *this->table.pager;
+    uint32_t root_page_num = this->table.get_root();
+
+    while (true)
+    {
+        Node root = pager.get_page(root_page_num);
+        if (root.get_node_type() == NodeType::LEAF || InternalNode(root).get_num_keys() > 0)
+        {
+            return;
+        }
+
+        uint32_t child_page_num = InternalNode(root).get_right_child();
+        pager.copy_node_data(root_page_num, child_page_num);
+        root = pager.get_page(root_page_num);
+        root.set_root(true);
+        root.set_parent(0);
+        if (root.get_node_type() == NodeType::INTERNAL)
+        {
+            for (const auto &child : this->get_children(root_page_num, 0))
+            {
+                pager.get_page(child.page_num).set_parent(root_page_num);
+            }
+        }
+        pager.free_page(child_page_num);
+    }
+}
+
+// the key of the last child is not stored, last_key stands in for it
+Deleter::Children Deleter::get_children(uint32_t page_num, uint32_t last_key)
+{
+    InternalNode node = this->table.pager->get_internal(page_num);
+    uint32_t num_keys = node.get_num_keys();
+    Children children;
+    children.reserve(num_keys + 1);
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        children.push_back({node.get_key_at_cell(i), node.get_child_at_cell(i), node.get_row_count(i)});
+    }
+    children.push_back({last_key, node.get_right_child(), node.get_row_count(num_keys)});
+    return children;
+}
+
+void Deleter::set_children(uint32_t page_num, const Children &children)
+{
+    InternalNode node = this->table.pager->get_internal(page_num);
+    node.set_num_keys(children.size() - 1);
+    for (uint32_t i = 0; i + 1 < children.size(); i++)
+    {
+        node.set_cell(i, children[i].max_key, children[i].page_num);
+    }
+    node.set_right_child(children.back().page_num);
+    for (uint32_t i = 0; i < children.size(); i++)
+    {
+        node.set_row_count(i, children[i].row_count);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "table.hpp"
+
+// Nodes with fewer entries are merged with or refilled from a sibling.
+// Leaves are counted in bytes, one cell below half so that sharing
+// the cells of two leaves evenly always leaves both above it.
+constexpr uint32_t LEAF_NODE_MIN_USED_SPACE = LEAF_NODE_SPACE_FOR_CELLS / 2 - LEAF_NODE_MAX_CELL_SIZE;
+constexpr uint32_t INTERNAL_NODE_MIN_CHILDREN = (INTERNAL_NODE_MAX_CELLS + 1) / 2;
+
+//
+// Deletes every row with a key in [low, high] in two passes.
+// The first removes cells from the two leaves the range ends in
+// and frees every subtree it covers as a whole, without visiting
+// its rows. The second relinks the leaf chain and rebalances the
+// nodes on the paths to both ends, the only ones which changed,
+// then shrinks the tree from the root while it has a single child.
+// Row counts change along the same paths, a freed subtree is taken
+// off by the count its parent holds for it.
+//
+class Deleter
+{
+public:
+    // functions
+
+    explicit Deleter(Table &table);
+
+    Deleter(const Deleter &) = delete;
+    Deleter &operator=(const Deleter &) = delete;
+
+    // returns the number of rows deleted
+    uint64_t erase(uint32_t low, uint32_t high);
+
+private:
+    using Children = std::vector<Child>;
+
+    // variables
+
+    Table &table;
+    uint32_t low;
+    uint32_t high;
+    uint64_t row_num;
+
+    // functions
+
+    uint32_t find_leaf(uint32_t key, uint32_t &previous_leaf_num);
+
+    bool erase_node(uint32_t page_num, int64_t lower_bound, int64_t upper_bound);
+    void free_subtree(uint32_t page_num);
+
+    bool rebalance(uint32_t page_num);
+    bool is_underfull(uint32_t page_num);
+    void fix_child(uint32_t page_num, uint32_t index);
+    void rebalance_leaves(Children &children, uint32_t left);
+    void rebalance_internals(Children &children, uint32_t left);
+    void collapse_root();
+
+    Children get_children(uint32_t page_num, uint32_t last_key);
+    void set_children(uint32_t page_num, const Children &children);
+};
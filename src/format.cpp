@@ -0,0 +1,1023 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "format.hpp"
+
+FileHeader::FileHeader(const Node &page)
+    : page(page)
+{
+}
+
+uint32_t FileHeader::read_u32(uint32_t offset) const
+{
+    uint32_t value;
+    memcpy(&value, this->page.get_data() + offset, sizeof(uint32_t));
+    return value;
+}
+
+void FileHeader::write_u32(uint32_t offset, uint32_t value)
+{
+    memcpy(this->page.get_data() + offset, &value, sizeof(uint32_t));
+    this->page.mark_dirty();
+}
+
+void FileHeader::initialize(uint32_t catalog_page_num)
+{
+    memset(this->page.get_data(), 0, PAGE_SIZE);
+    memcpy(this->page.get_data() + FILE_MAGIC_OFFSET, FILE_MAGIC, sizeof(FILE_MAGIC));
+    this->write_u32(FILE_VERSION_OFFSET, FILE_FORMAT_VERSION);
+    this->write_u32(FILE_PAGE_SIZE_OFFSET, PAGE_SIZE);
+    this->write_u32(FILE_CATALOG_PAGE_OFFSET, catalog_page_num);
+}
+
+bool FileHeader::has_magic() const
+{
+    return memcmp(this->page.get_data() + FILE_MAGIC_OFFSET, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0;
+}
+
+uint32_t FileHeader::get_version() const
+{
+    return this->read_u32(FILE_VERSION_OFFSET);
+}
+
+void FileHeader::set_version(uint32_t version)
+{
+    this->write_u32(FILE_VERSION_OFFSET, version);
+}
+
+uint32_t FileHeader::get_page_size() const
+{
+    return this->read_u32(FILE_PAGE_SIZE_OFFSET);
+}
+
+uint32_t FileHeader::get_catalog_page() const
+{
+    return this->read_u32(FILE_CATALOG_PAGE_OFFSET);
+}
+
+void FileHeader::set_catalog_page(uint32_t page_num)
+{
+    this->write_u32(FILE_CATALOG_PAGE_OFFSET, page_num);
+}
+
+uint32_t FileHeader::get_free_trunk_page() const
+{
+    return this->read_u32(FILE_FREE_TRUNK_PAGE_OFFSET);
+}
+
+void FileHeader::set_free_trunk_page(uint32_t page_num)
+{
+    this->write_u32(FILE_FREE_TRUNK_PAGE_OFFSET, page_num);
+}
+
+uint32_t FileHeader::get_free_page_count() const
+{
+    return this->read_u32(FILE_FREE_PAGE_COUNT_OFFSET);
+}
+
+void FileHeader::set_free_page_count(uint32_t count)
+{
+    this->write_u32(FILE_FREE_PAGE_COUNT_OFFSET, count);
+}
+
+Catalog::Catalog(const Node &page)
+    : page(page)
+{
+}
+
+uint32_t Catalog::read_u32(uint32_t offset) const
+{
+    uint32_t value;
+    memcpy(&value, this->page.get_data() + offset, sizeof(uint32_t));
+    return value;
+}
+
+void Catalog::write_u32(uint32_t offset, uint32_t value)
+{
+    memcpy(this->page.get_data() + offset, &value, sizeof(uint32_t));
+    this->page.mark_dirty();
+}
+
+void Catalog::initialize()
+{
+    memset(this->page.get_data(), 0, PAGE_SIZE);
+    this->page.mark_dirty();
+}
+
+uint32_t Catalog::get_num_tables() const
+{
+    return this->read_u32(CATALOG_NUM_TABLES_OFFSET);
+}
+
+std::string_view Catalog::get_table_name(uint32_t index) const
+{
+    const char *name = this->page.get_data() + CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE + CATALOG_TABLE_NAME_OFFSET;
+    return std::string_view(name, strnlen(name, CATALOG_TABLE_NAME_SIZE));
+}
+
+uint32_t Catalog::find_table(std::string_view name) const
+{
+    uint32_t num_tables = this->get_num_tables();
+    for (uint32_t i = 0; i < num_tables; i++)
+    {
+        if (this->get_table_name(i) == name)
+        {
+            return i;
+        }
+    }
+    return num_tables;
+}
+
+uint32_t Catalog::add_table(std::string_view name, uint32_t root_page_num, uint32_t schema_page_num)
+{
+    uint32_t index = this->get_num_tables();
+    char *entry = this->page.get_data() + CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE;
+    memset(entry, 0, CATALOG_ENTRY_SIZE);
+    memcpy(entry + CATALOG_TABLE_NAME_OFFSET, name.data(), std::min<size_t>(name.size(), CATALOG_TABLE_NAME_SIZE));
+    this->write_u32(CATALOG_NUM_TABLES_OFFSET, index + 1);
+    this->set_root_page(index, root_page_num);
+    this->set_schema_page(index, schema_page_num);
+    return index;
+}
+
+uint32_t Catalog::get_root_page(uint32_t index) const
+{
+    return this->read_u32(CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE + CATALOG_ROOT_PAGE_OFFSET);
+}
+
+void Catalog::set_root_page(uint32_t index, uint32_t page_num)
+{
+    this->write_u32(CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE + CATALOG_ROOT_PAGE_OFFSET, page_num);
+}
+
+uint32_t Catalog::get_schema_page(uint32_t index) const
+{
+    return this->read_u32(CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE + CATALOG_SCHEMA_PAGE_OFFSET);
+}
+
+void Catalog::set_schema_page(uint32_t index, uint32_t page_num)
+{
+    this->write_u32(CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE + CATALOG_SCHEMA_PAGE_OFFSET, page_num);
+}
+
+double Catalog::get_split_fill_factor(uint32_t index) const
+{
+    double fill_factor;
+    memcpy(&fill_factor, this->page.get_data() + CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE + CATALOG_SPLIT_FILL_FACTOR_OFFSET,
+           CATALOG_SPLIT_FILL_FACTOR_SIZE);
+    return fill_factor;
+}
+
+void Catalog::set_split_fill_factor(uint32_t index, double fill_factor)
+{
+    memcpy(this->page.get_data() + CATALOG_HEADER_SIZE + index * CATALOG_ENTRY_SIZE + CATALOG_SPLIT_FILL_FACTOR_OFFSET, &fill_factor,
+           CATALOG_SPLIT_FILL_FACTOR_SIZE);
+    this->page.mark_dirty();
+}
+
+SchemaPage::SchemaPage(const Node &page)
+    : page(page)
+{
+}
+
+uint32_t SchemaPage::read_u32(uint32_t offset) const
+{
+    uint32_t value;
+    memcpy(&value, this->page.get_data() + offset, sizeof(uint32_t));
+    return value;
+}
+
+void SchemaPage::write_u32(uint32_t offset, uint32_t value)
+{
+    memcpy(this->page.get_data() + offset, &value, sizeof(uint32_t));
+    this->page.mark_dirty();
+}
+
+void SchemaPage::initialize(const Schema &schema)
+{
+    char *data = this->page.get_data();
+    memset(data, 0, PAGE_SIZE);
+    this->write_u32(SCHEMA_NUM_COLUMNS_OFFSET, schema.columns.size());
+    for (uint32_t i = 0; i < schema.columns.size(); i++)
+    {
+        const Column &column = schema.columns[i];
+        uint32_t entry_offset = SCHEMA_HEADER_SIZE + i * SCHEMA_ENTRY_SIZE;
+        memcpy(data + entry_offset + SCHEMA_COLUMN_NAME_OFFSET, column.name.data(), std::min<size_t>(column.name.size(), COLUMN_NAME_SIZE));
+        this->write_u32(entry_offset + SCHEMA_COLUMN_TYPE_OFFSET, (uint32_t)column.type);
+        this->write_u32(entry_offset + SCHEMA_COLUMN_SIZE_OFFSET, column.size);
+    }
+}
+
+Schema SchemaPage::get_schema() const
+{
+    Schema schema;
+    uint32_t num_columns = this->get_num_columns();
+    for (uint32_t i = 0; i < num_columns; i++)
+    {
+        uint32_t entry_offset = SCHEMA_HEADER_SIZE + i * SCHEMA_ENTRY_SIZE;
+        const char *name = this->page.get_data() + entry_offset + SCHEMA_COLUMN_NAME_OFFSET;
+        schema.columns.push_back({std::string(name, strnlen(name, COLUMN_NAME_SIZE)),
+                                  (ColumnType)this->read_u32(entry_offset + SCHEMA_COLUMN_TYPE_OFFSET),
+                                  this->read_u32(entry_offset + SCHEMA_COLUMN_SIZE_OFFSET)});
+    }
+    return schema;
+}
+
+uint32_t SchemaPage::get_num_columns() const
+{
+    return this->read_u32(SCHEMA_NUM_COLUMNS_OFFSET);
+}
+
+uint32_t SchemaPage::get_index_root_page(uint32_t column) const
+{
+    return this->read_u32(SCHEMA_HEADER_SIZE + column * SCHEMA_ENTRY_SIZE + SCHEMA_INDEX_ROOT_PAGE_OFFSET);
+}
+
+void SchemaPage::set_index_root_page(uint32_t column, uint32_t page_num)
+{
+    this->write_u32(SCHEMA_HEADER_SIZE + column * SCHEMA_ENTRY_SIZE + SCHEMA_INDEX_ROOT_PAGE_OFFSET, page_num);
+}
+
+FreeTrunk::FreeTrunk(const Node &page)
+    : page(page)
+{
+}
+
+uint32_t FreeTrunk::read_u32(uint32_t offset) const
+{
+    uint32_t value;
+    memcpy(&value, this->page.get_data() + offset, sizeof(uint32_t));
+    return value;
+}
+
+void FreeTrunk::write_u32(uint32_t offset, uint32_t value)
+{
+    memcpy(this->page.get_data() + offset, &value, sizeof(uint32_t));
+    this->page.mark_dirty();
+}
+
+void FreeTrunk::initialize(uint32_t next_trunk_page_num)
+{
+    memset(this->page.get_data(), 0, PAGE_SIZE);
+    this->write_u32(FREE_TRUNK_NEXT_OFFSET, next_trunk_page_num);
+}
+
+uint32_t FreeTrunk::get_next_trunk() const
+{
+    return this->read_u32(FREE_TRUNK_NEXT_OFFSET);
+}
+
+uint32_t FreeTrunk::get_num_leaves() const
+{
+    return this->read_u32(FREE_TRUNK_NUM_LEAVES_OFFSET);
+}
+
+void FreeTrunk::set_num_leaves(uint32_t num_leaves)
+{
+    this->write_u32(FREE_TRUNK_NUM_LEAVES_OFFSET, num_leaves);
+}
+
+uint32_t FreeTrunk::get_leaf(uint32_t index) const
+{
+    return this->read_u32(FREE_TRUNK_HEADER_SIZE + index * FREE_TRUNK_LEAF_SIZE);
+}
+
+void FreeTrunk::set_leaf(uint32_t index, uint32_t page_num)
+{
+    this->write_u32(FREE_TRUNK_HEADER_SIZE + index * FREE_TRUNK_LEAF_SIZE, page_num);
+}
+
+void read_exact(int fd, char *data, uint32_t page_num, const std::string &filename)
+{
+    if (pread(fd, data, PAGE_SIZE, (off_t)page_num * PAGE_SIZE) != PAGE_SIZE)
+    {
+        throw std::runtime_error("Error reading file: " + filename);
+    }
+}
+
+void write_exact(int fd, const char *data, uint32_t page_num, const std::string &filename)
+{
+    if (pwrite(fd, data, PAGE_SIZE, (off_t)page_num * PAGE_SIZE) != PAGE_SIZE)
+    {
+        throw std::runtime_error("Error writing file: " + filename);
+    }
+}
+
+//
+// Version 0 -> 1
+// Internal cells are repacked from 16 to 8 bytes, a header page is
+// added in front and the old root (page 0) moves to the end of the
+// file. Nodes pointing at page 0 as their parent now point at it.
+//
+void upgrade_v0_to_v1(int src_fd, int dst_fd, uint32_t num_pages, const std::string &filename)
+{
+    uint32_t new_root_page_num = num_pages;
+    std::vector<char> data(PAGE_SIZE);
+    std::vector<char> repacked(PAGE_SIZE);
+
+    for (uint32_t page_num = 0; page_num < num_pages; page_num++)
+    {
+        read_exact(src_fd, data.data(), page_num, filename);
+        Node node = Node(data.data(), nullptr);
+
+        if (node.get_node_type() == NodeType::INTERNAL)
+        {
+            uint32_t num_keys;
+            memcpy(&num_keys, &data[INTERNAL_NODE_NUM_KEYS_OFFSET], sizeof(uint32_t));
+
+            memset(repacked.data(), 0, PAGE_SIZE);
+            memcpy(repacked.data(), data.data(), INTERNAL_NODE_HEADER_SIZE);
+            for (uint32_t i = 0; i < num_keys; i++)
+            {
+                const char *old_cell = &data[INTERNAL_NODE_HEADER_SIZE + i * V0_INTERNAL_NODE_CELL_SIZE];
+                char *new_cell = &repacked[INTERNAL_NODE_HEADER_SIZE + i * V2_INTERNAL_NODE_CELL_SIZE];
+                memcpy(new_cell, old_cell, INTERNAL_NODE_KEY_SIZE);
+                memcpy(new_cell + V2_INTERNAL_NODE_VALUE_OFFSET, old_cell + V0_INTERNAL_NODE_VALUE_OFFSET, INTERNAL_NODE_CHILD_SIZE);
+            }
+            data.swap(repacked);
+        }
+
+        uint32_t parent_num;
+        memcpy(&parent_num, &data[PARENT_NUM_OFFSET], sizeof(uint32_t));
+        if (page_num != 0 && parent_num == 0)
+        {
+            memcpy(&data[PARENT_NUM_OFFSET], &new_root_page_num, sizeof(uint32_t));
+        }
+
+        write_exact(dst_fd, data.data(), page_num == 0 ? new_root_page_num : page_num, filename);
+    }
+
+    bool dirty = false;
+    FileHeader header(Node(data.data(), &dirty));
+    header.initialize(0);
+    memcpy(&data[V5_FILE_ROOT_PAGE_OFFSET], &new_root_page_num, sizeof(uint32_t));
+    header.set_version(1);
+    write_exact(dst_fd, data.data(), HEADER_PAGE_NUM, filename);
+}
+
+// repack a version 1 leaf into key and record location arrays and records of the string bytes
+void upgrade_v1_leaf(std::vector<char> &data, std::vector<char> &repacked)
+{
+    uint32_t num_cells, next_leaf_num;
+    memcpy(&num_cells, &data[LEAF_NODE_NUM_CELLS_OFFSET], sizeof(uint32_t));
+    memcpy(&next_leaf_num, &data[LEAF_NODE_NEXT_LEAF_OFFSET], sizeof(uint32_t));
+
+    memset(repacked.data(), 0, PAGE_SIZE);
+    memcpy(repacked.data(), data.data(), COMMON_NODE_HEADER_SIZE);
+    bool dirty = false;
+    LeafNode node(repacked.data(), &dirty);
+    node.set_next_leaf_num(next_leaf_num);
+
+    Schema schema = Schema::get_default();
+    Row row;
+    for (uint32_t i = 0; i < num_cells; i++)
+    {
+        const char *old_cell = &data[V1_LEAF_NODE_HEADER_SIZE + i * V1_LEAF_NODE_CELL_SIZE];
+        const char *username = old_cell + V1_LEAF_NODE_USERNAME_OFFSET;
+        const char *email = old_cell + V1_LEAF_NODE_EMAIL_OFFSET;
+        memcpy(&row.id, old_cell, LEAF_NODE_KEY_SIZE);
+        row.record_size = 0;
+        schema.append_value(row, 0, std::string_view(username, strnlen(username, COLUMN_USERNAME_SIZE)));
+        schema.append_value(row, 1, std::string_view(email, strnlen(email, COLUMN_EMAIL_SIZE)));
+        node.insert_cell(i, row.id, row);
+    }
+    data.swap(repacked);
+}
+
+// split the slots of a version 2 leaf into key and record offset arrays, records stay in place
+void upgrade_v2_leaf(std::vector<char> &data, std::vector<char> &repacked)
+{
+    uint32_t num_cells;
+    memcpy(&num_cells, &data[LEAF_NODE_NUM_CELLS_OFFSET], sizeof(uint32_t));
+
+    repacked = data;
+    char *keys = &repacked[LEAF_NODE_KEYS_OFFSET];
+    char *record_offsets = keys + num_cells * LEAF_NODE_KEY_SIZE;
+    for (uint32_t i = 0; i < num_cells; i++)
+    {
+        const char *old_slot = &data[LEAF_NODE_HEADER_SIZE + i * V2_LEAF_NODE_SLOT_SIZE];
+        memcpy(keys + i * LEAF_NODE_KEY_SIZE, old_slot, LEAF_NODE_KEY_SIZE);
+        memcpy(record_offsets + i * LEAF_NODE_RECORD_OFFSET_SIZE, old_slot + V2_LEAF_NODE_RECORD_OFFSET_OFFSET,
+               LEAF_NODE_RECORD_OFFSET_SIZE);
+    }
+    data.swap(repacked);
+}
+
+// split the cells of a version 1 or 2 internal node into the key and child arrays of version 3
+void upgrade_v2_internal(std::vector<char> &data, std::vector<char> &repacked)
+{
+    uint32_t num_keys;
+    memcpy(&num_keys, &data[INTERNAL_NODE_NUM_KEYS_OFFSET], sizeof(uint32_t));
+
+    memset(repacked.data(), 0, PAGE_SIZE);
+    memcpy(repacked.data(), data.data(), INTERNAL_NODE_HEADER_SIZE);
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        const char *old_cell = &data[INTERNAL_NODE_HEADER_SIZE + i * V2_INTERNAL_NODE_CELL_SIZE];
+        memcpy(&repacked[INTERNAL_NODE_KEYS_OFFSET + i * INTERNAL_NODE_KEY_SIZE], old_cell, INTERNAL_NODE_KEY_SIZE);
+        memcpy(&repacked[V3_INTERNAL_NODE_CHILDREN_OFFSET + i * INTERNAL_NODE_CHILD_SIZE], old_cell + V2_INTERNAL_NODE_VALUE_OFFSET,
+               INTERNAL_NODE_CHILD_SIZE);
+    }
+    data.swap(repacked);
+}
+
+//
+// Version 1 or 2 -> 3
+// Version 1 leaves become slotted pages, version 2 leaves keep their
+// records. Keys of all nodes move into arrays of their own. Only the
+// nodes reachable from the root are converted, free pages are copied
+// as they are. Every page is read before it is written, so src_fd may
+// be dst_fd.
+//
+void upgrade_to_v3(int src_fd, int dst_fd, uint32_t num_pages, uint32_t version, const std::string &filename)
+{
+    std::vector<char> data(PAGE_SIZE);
+    std::vector<char> repacked(PAGE_SIZE);
+
+    read_exact(src_fd, data.data(), HEADER_PAGE_NUM, filename);
+    uint32_t root_page_num;
+    memcpy(&root_page_num, &data[V5_FILE_ROOT_PAGE_OFFSET], sizeof(uint32_t));
+    std::vector<uint32_t> pending = {root_page_num};
+    std::vector<NodeType> node_types(num_pages);
+    std::vector<bool> is_node(num_pages, false);
+    while (!pending.empty())
+    {
+        uint32_t page_num = pending.back();
+        pending.pop_back();
+        if (page_num == HEADER_PAGE_NUM || page_num >= num_pages || is_node[page_num])
+        {
+            throw std::runtime_error("File Corrupted. Invalid page number: " + filename);
+        }
+        read_exact(src_fd, data.data(), page_num, filename);
+        is_node[page_num] = true;
+        node_types[page_num] = Node(data.data(), nullptr).get_node_type();
+        if (node_types[page_num] == NodeType::LEAF)
+        {
+            continue;
+        }
+
+        uint32_t num_keys, child_num;
+        memcpy(&num_keys, &data[INTERNAL_NODE_NUM_KEYS_OFFSET], sizeof(uint32_t));
+        for (uint32_t i = 0; i < num_keys; i++)
+        {
+            memcpy(&child_num, &data[INTERNAL_NODE_HEADER_SIZE + i * V2_INTERNAL_NODE_CELL_SIZE + V2_INTERNAL_NODE_VALUE_OFFSET],
+                   sizeof(uint32_t));
+            pending.push_back(child_num);
+        }
+        memcpy(&child_num, &data[INTERNAL_NODE_RIGHT_CHILD_OFFSET], sizeof(uint32_t));
+        pending.push_back(child_num);
+    }
+
+    for (uint32_t page_num = 0; page_num < num_pages; page_num++)
+    {
+        read_exact(src_fd, data.data(), page_num, filename);
+        if (page_num == HEADER_PAGE_NUM)
+        {
+            bool dirty = false;
+            FileHeader(Node(data.data(), &dirty)).set_version(3);
+        }
+        else if (is_node[page_num] && node_types[page_num] == NodeType::INTERNAL)
+        {
+            upgrade_v2_internal(data, repacked);
+        }
+        else if (is_node[page_num] && version == 1)
+        {
+            upgrade_v1_leaf(data, repacked);
+        }
+        else if (is_node[page_num])
+        {
+            upgrade_v2_leaf(data, repacked);
+        }
+        write_exact(dst_fd, data.data(), page_num, filename);
+    }
+}
+
+void write_parent(int fd, uint32_t page_num, uint32_t parent_page_num, const std::string &filename)
+{
+    if (pwrite(fd, &parent_page_num, sizeof(uint32_t), (off_t)page_num * PAGE_SIZE + PARENT_NUM_OFFSET) != sizeof(uint32_t))
+    {
+        throw std::runtime_error("Error writing file: " + filename);
+    }
+}
+
+// same as Pager::free_page, on the file
+void free_page(int fd, FileHeader &header, uint32_t page_num, const std::string &filename)
+{
+    std::vector<char> data(PAGE_SIZE);
+    bool dirty = false;
+    uint32_t trunk_page_num = header.get_free_trunk_page();
+    header.set_free_page_count(header.get_free_page_count() + 1);
+
+    if (trunk_page_num != 0)
+    {
+        read_exact(fd, data.data(), trunk_page_num, filename);
+        FreeTrunk trunk(Node(data.data(), &dirty));
+        uint32_t num_leaves = trunk.get_num_leaves();
+        if (num_leaves < FREE_TRUNK_MAX_LEAVES)
+        {
+            trunk.set_leaf(num_leaves, page_num);
+            trunk.set_num_leaves(num_leaves + 1);
+            write_exact(fd, data.data(), trunk_page_num, filename);
+            return;
+        }
+    }
+
+    FreeTrunk(Node(data.data(), &dirty)).initialize(trunk_page_num);
+    write_exact(fd, data.data(), page_num, filename);
+    header.set_free_trunk_page(page_num);
+}
+
+void copy_pages(int src_fd, int dst_fd, uint32_t num_pages, const std::string &filename)
+{
+    std::vector<char> data(PAGE_SIZE);
+    for (uint32_t page_num = 0; page_num < num_pages; page_num++)
+    {
+        read_exact(src_fd, data.data(), page_num, filename);
+        write_exact(dst_fd, data.data(), page_num, filename);
+    }
+}
+
+//
+// Version 3 -> 4
+// Internal nodes hold the row counts of their children, which leaves
+// room for fewer of them, so the internal levels are built again from
+// the leaves in key order, each level spread evenly over as few nodes
+// as fit it. Internal pages are reused as far as they go and further
+// ones appended, left over ones are freed. Leaves keep their place
+// and only get their new parent. src_fd is copied into dst_fd first
+// unless they are the same, then dst_fd is changed in place.
+//
+void upgrade_v3_to_v4(int src_fd, int dst_fd, uint32_t &num_pages, const std::string &filename)
+{
+    std::vector<char> data(PAGE_SIZE);
+    if (src_fd != dst_fd)
+    {
+        copy_pages(src_fd, dst_fd, num_pages, filename);
+    }
+
+    std::vector<char> header_data(PAGE_SIZE);
+    read_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+    bool dirty = false;
+    FileHeader header(Node(header_data.data(), &dirty));
+    uint32_t root_page_num;
+    memcpy(&root_page_num, &header_data[V5_FILE_ROOT_PAGE_OFFSET], sizeof(uint32_t));
+
+    // Leaves in key order, internal pages other than the root to reuse
+    std::vector<Child> children;
+    std::vector<uint32_t> spare_pages;
+    std::vector<bool> is_visited(num_pages, false);
+    std::vector<uint32_t> pending = {root_page_num};
+    while (!pending.empty())
+    {
+        uint32_t page_num = pending.back();
+        pending.pop_back();
+        if (page_num == HEADER_PAGE_NUM || page_num >= num_pages || is_visited[page_num])
+        {
+            throw std::runtime_error("File Corrupted. Invalid page number: " + filename);
+        }
+        is_visited[page_num] = true;
+        read_exact(dst_fd, data.data(), page_num, filename);
+        Node node = Node(data.data(), nullptr);
+        if (node.get_node_type() == NodeType::LEAF)
+        {
+            LeafNode leaf = LeafNode(node);
+            if (leaf.get_num_cells() > 0)
+            {
+                children.push_back({leaf.get_max_key(), page_num, leaf.get_num_cells()});
+            }
+            continue;
+        }
+        if (page_num != root_page_num)
+        {
+            spare_pages.push_back(page_num);
+        }
+
+        // children are visited in order, so they are pushed in reverse
+        uint32_t child_num;
+        memcpy(&child_num, &data[INTERNAL_NODE_RIGHT_CHILD_OFFSET], sizeof(uint32_t));
+        pending.push_back(child_num);
+        uint32_t num_keys = InternalNode(node).get_num_keys();
+        for (uint32_t i = num_keys; i > 0; i--)
+        {
+            memcpy(&child_num, &data[V3_INTERNAL_NODE_CHILDREN_OFFSET + (i - 1) * INTERNAL_NODE_CHILD_SIZE], sizeof(uint32_t));
+            pending.push_back(child_num);
+        }
+    }
+
+    read_exact(dst_fd, data.data(), root_page_num, filename);
+    if (Node(data.data(), nullptr).get_node_type() == NodeType::INTERNAL)
+    {
+        if (children.size() < 2)
+        {
+            throw std::runtime_error("File Corrupted. Internal node without children: " + filename);
+        }
+        std::reverse(spare_pages.begin(), spare_pages.end());
+        constexpr uint32_t MAX_CHILDREN = INTERNAL_NODE_MAX_CELLS + 1;
+        while (true)
+        {
+            bool is_root = children.size() <= MAX_CHILDREN;
+            uint32_t node_num = is_root ? 1 : (children.size() + MAX_CHILDREN - 1) / MAX_CHILDREN;
+            std::vector<Child> parents;
+            parents.reserve(node_num);
+            for (uint32_t j = 0; j < node_num; j++)
+            {
+                uint32_t first = (uint64_t)children.size() * j / node_num;
+                uint32_t last = (uint64_t)children.size() * (j + 1) / node_num;
+                uint32_t page_num = root_page_num;
+                if (!is_root && !spare_pages.empty())
+                {
+                    page_num = spare_pages.back();
+                    spare_pages.pop_back();
+                }
+                else if (!is_root)
+                {
+                    page_num = num_pages++;
+                }
+
+                memset(data.data(), 0, PAGE_SIZE);
+                NodeType node_type = NodeType::INTERNAL;
+                memcpy(&data[NODE_TYPE_OFFSET], &node_type, NODE_TYPE_SIZE);
+                InternalNode node(data.data(), &dirty);
+                node.set_root(is_root);
+                node.set_num_keys(last - first - 1);
+                uint32_t row_count = 0;
+                for (uint32_t i = first; i < last; i++)
+                {
+                    if (i + 1 < last)
+                    {
+                        node.set_cell(i - first, children[i].max_key, children[i].page_num);
+                    }
+                    node.set_row_count(i - first, children[i].row_count);
+                    row_count += children[i].row_count;
+                    write_parent(dst_fd, children[i].page_num, page_num, filename);
+                }
+                node.set_right_child(children[last - 1].page_num);
+                write_exact(dst_fd, data.data(), page_num, filename);
+                parents.push_back({children[last - 1].max_key, page_num, row_count});
+            }
+            if (is_root)
+            {
+                break;
+            }
+            children.swap(parents);
+        }
+    }
+
+    for (uint32_t page_num : spare_pages)
+    {
+        free_page(dst_fd, header, page_num, filename);
+    }
+    header.set_version(4);
+    write_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+}
+
+//
+// Version 4 -> 5
+// The header lists the root pages of the secondary indexes, older
+// files have none. src_fd is copied into dst_fd first unless they
+// are the same.
+//
+void upgrade_v4_to_v5(int src_fd, int dst_fd, uint32_t num_pages, const std::string &filename)
+{
+    if (src_fd != dst_fd)
+    {
+        copy_pages(src_fd, dst_fd, num_pages, filename);
+    }
+
+    std::vector<char> data(PAGE_SIZE);
+    read_exact(dst_fd, data.data(), HEADER_PAGE_NUM, filename);
+    bool dirty = false;
+    FileHeader header(Node(data.data(), &dirty));
+    memset(&data[V5_FILE_INDEX_ROOT_PAGES_OFFSET], 0, V5_INDEX_COLUMN_NUM * V7_CATALOG_INDEX_ROOT_PAGE_SIZE);
+    header.set_version(5);
+    write_exact(dst_fd, data.data(), HEADER_PAGE_NUM, filename);
+}
+
+//
+// Version 5 -> 6
+// The root pages of the one table and its indexes move from the
+// header into a catalog, appended as a new last page, the table is
+// named DEFAULT_TABLE_NAME. src_fd is copied into dst_fd first unless
+// they are the same.
+//
+void upgrade_v5_to_v6(int src_fd, int dst_fd, uint32_t &num_pages, const std::string &filename)
+{
+    if (src_fd != dst_fd)
+    {
+        copy_pages(src_fd, dst_fd, num_pages, filename);
+    }
+
+    std::vector<char> header_data(PAGE_SIZE);
+    read_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+    uint32_t root_page_num;
+    memcpy(&root_page_num, &header_data[V5_FILE_ROOT_PAGE_OFFSET], sizeof(uint32_t));
+
+    // the one entry is the first, the index root pages keep their order
+    std::vector<char> data(PAGE_SIZE, 0);
+    uint32_t num_tables = 1;
+    memcpy(&data[CATALOG_NUM_TABLES_OFFSET], &num_tables, sizeof(uint32_t));
+    memcpy(&data[CATALOG_HEADER_SIZE + CATALOG_TABLE_NAME_OFFSET], DEFAULT_TABLE_NAME, sizeof(DEFAULT_TABLE_NAME) - 1);
+    memcpy(&data[CATALOG_HEADER_SIZE + CATALOG_ROOT_PAGE_OFFSET], &root_page_num, sizeof(uint32_t));
+    memcpy(&data[CATALOG_HEADER_SIZE + V7_CATALOG_INDEX_ROOT_PAGES_OFFSET], &header_data[V5_FILE_INDEX_ROOT_PAGES_OFFSET],
+           V5_INDEX_COLUMN_NUM * V7_CATALOG_INDEX_ROOT_PAGE_SIZE);
+    uint32_t catalog_page_num = num_pages;
+    write_exact(dst_fd, data.data(), catalog_page_num, filename);
+    num_pages++;
+
+    bool dirty = false;
+    FileHeader header(Node(header_data.data(), &dirty));
+    memset(&header_data[V5_FILE_INDEX_ROOT_PAGES_OFFSET], 0, V5_INDEX_COLUMN_NUM * V7_CATALOG_INDEX_ROOT_PAGE_SIZE);
+    header.set_catalog_page(catalog_page_num);
+    header.set_version(6);
+    write_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+}
+
+//
+// Version 6 -> 7
+// Catalog entries grow by the split fill factor of their table, it
+// is left unset. src_fd is copied into dst_fd first unless they are
+// the same.
+//
+void upgrade_v6_to_v7(int src_fd, int dst_fd, uint32_t num_pages, const std::string &filename)
+{
+    if (src_fd != dst_fd)
+    {
+        copy_pages(src_fd, dst_fd, num_pages, filename);
+    }
+
+    std::vector<char> header_data(PAGE_SIZE);
+    read_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+    bool dirty = false;
+    FileHeader header(Node(header_data.data(), &dirty));
+    uint32_t catalog_page_num = header.get_catalog_page();
+
+    std::vector<char> data(PAGE_SIZE);
+    std::vector<char> repacked(PAGE_SIZE, 0);
+    read_exact(dst_fd, data.data(), catalog_page_num, filename);
+    uint32_t num_tables;
+    memcpy(&num_tables, &data[CATALOG_NUM_TABLES_OFFSET], sizeof(uint32_t));
+    if (num_tables > V7_CATALOG_MAX_TABLES)
+    {
+        throw std::runtime_error("File Corrupted. Too many tables for the catalog: " + filename);
+    }
+    memcpy(repacked.data(), data.data(), CATALOG_HEADER_SIZE);
+    for (uint32_t i = 0; i < num_tables; i++)
+    {
+        memcpy(&repacked[CATALOG_HEADER_SIZE + i * V7_CATALOG_ENTRY_SIZE], &data[CATALOG_HEADER_SIZE + i * V6_CATALOG_ENTRY_SIZE],
+               V6_CATALOG_ENTRY_SIZE);
+    }
+    write_exact(dst_fd, repacked.data(), catalog_page_num, filename);
+
+    header.set_version(7);
+    write_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+}
+
+//
+// Version 7 -> 8
+// Every table gets a schema page of the default columns, appended
+// at the end, which takes over the index root pages from its catalog
+// entry. The leaf slots of each table get the size of their record
+// next to its offset, a masked offset keeps the step right for
+// leaves repacked from version 1, which have it already. src_fd is
+// copied into dst_fd first unless they are the same.
+//
+void upgrade_v7_to_v8(int src_fd, int dst_fd, uint32_t &num_pages, const std::string &filename)
+{
+    if (src_fd != dst_fd)
+    {
+        copy_pages(src_fd, dst_fd, num_pages, filename);
+    }
+
+    std::vector<char> header_data(PAGE_SIZE);
+    read_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+    bool dirty = false;
+    FileHeader header(Node(header_data.data(), &dirty));
+    uint32_t catalog_page_num = header.get_catalog_page();
+
+    std::vector<char> data(PAGE_SIZE);
+    std::vector<char> repacked(PAGE_SIZE, 0);
+    read_exact(dst_fd, data.data(), catalog_page_num, filename);
+    uint32_t num_tables;
+    memcpy(&num_tables, &data[CATALOG_NUM_TABLES_OFFSET], sizeof(uint32_t));
+    if (num_tables > V7_CATALOG_MAX_TABLES)
+    {
+        throw std::runtime_error("File Corrupted. Too many tables for the catalog: " + filename);
+    }
+    memcpy(repacked.data(), data.data(), CATALOG_HEADER_SIZE);
+
+    uint32_t first_schema_page_num = num_pages;
+    std::vector<char> schema_data(PAGE_SIZE);
+    std::vector<uint32_t> pending;
+    for (uint32_t i = 0; i < num_tables; i++)
+    {
+        const char *old_entry = &data[CATALOG_HEADER_SIZE + i * V7_CATALOG_ENTRY_SIZE];
+        char *new_entry = &repacked[CATALOG_HEADER_SIZE + i * CATALOG_ENTRY_SIZE];
+        SchemaPage schema_page(Node(schema_data.data(), &dirty));
+        schema_page.initialize(Schema::get_default());
+        for (uint32_t column = 0; column < V5_INDEX_COLUMN_NUM; column++)
+        {
+            uint32_t index_root_page_num;
+            memcpy(&index_root_page_num, old_entry + V7_CATALOG_INDEX_ROOT_PAGES_OFFSET + column * V7_CATALOG_INDEX_ROOT_PAGE_SIZE,
+                   sizeof(uint32_t));
+            schema_page.set_index_root_page(column, index_root_page_num);
+        }
+        uint32_t schema_page_num = num_pages++;
+        write_exact(dst_fd, schema_data.data(), schema_page_num, filename);
+
+        memcpy(new_entry, old_entry, CATALOG_ROOT_PAGE_OFFSET + CATALOG_ROOT_PAGE_SIZE);
+        memcpy(new_entry + CATALOG_SCHEMA_PAGE_OFFSET, &schema_page_num, CATALOG_SCHEMA_PAGE_SIZE);
+        memcpy(new_entry + CATALOG_SPLIT_FILL_FACTOR_OFFSET, old_entry + V7_CATALOG_SPLIT_FILL_FACTOR_OFFSET, CATALOG_SPLIT_FILL_FACTOR_SIZE);
+        uint32_t root_page_num;
+        memcpy(&root_page_num, old_entry + CATALOG_ROOT_PAGE_OFFSET, sizeof(uint32_t));
+        pending.push_back(root_page_num);
+    }
+    write_exact(dst_fd, repacked.data(), catalog_page_num, filename);
+
+    std::vector<bool> is_visited(first_schema_page_num, false);
+    while (!pending.empty())
+    {
+        uint32_t page_num = pending.back();
+        pending.pop_back();
+        if (page_num == HEADER_PAGE_NUM || page_num >= first_schema_page_num || is_visited[page_num])
+        {
+            throw std::runtime_error("File Corrupted. Invalid page number: " + filename);
+        }
+        is_visited[page_num] = true;
+        read_exact(dst_fd, data.data(), page_num, filename);
+        Node node = Node(data.data(), nullptr);
+        if (node.get_node_type() == NodeType::INTERNAL)
+        {
+            InternalNode internal = InternalNode(node);
+            for (uint32_t i = 0; i <= internal.get_num_keys(); i++)
+            {
+                pending.push_back(internal.get_child_at_cell(i));
+            }
+            continue;
+        }
+
+        // records are the username and the email, each behind its size
+        uint32_t num_cells = LeafNode(node).get_num_cells();
+        if (num_cells > LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_SLOT_SIZE)
+        {
+            throw std::runtime_error("File Corrupted. Invalid number of cells: " + filename);
+        }
+        char *record_offsets = &data[LEAF_NODE_KEYS_OFFSET + num_cells * LEAF_NODE_KEY_SIZE];
+        for (uint32_t i = 0; i < num_cells; i++)
+        {
+            uint32_t record_offset;
+            memcpy(&record_offset, record_offsets + i * LEAF_NODE_RECORD_OFFSET_SIZE, LEAF_NODE_RECORD_OFFSET_SIZE);
+            record_offset &= LEAF_NODE_RECORD_OFFSET_MASK;
+            uint32_t email_offset = record_offset + RECORD_STRING_SIZE_SIZE;
+            if (record_offset < PAGE_SIZE)
+            {
+                email_offset += (uint8_t)data[record_offset];
+            }
+            uint32_t record_end = email_offset + RECORD_STRING_SIZE_SIZE;
+            if (email_offset < PAGE_SIZE)
+            {
+                record_end += (uint8_t)data[email_offset];
+            }
+            if (record_end > PAGE_SIZE)
+            {
+                throw std::runtime_error("File Corrupted. Invalid record: " + filename);
+            }
+            uint32_t location = record_offset | (record_end - record_offset) << LEAF_NODE_RECORD_SIZE_SHIFT;
+            memcpy(record_offsets + i * LEAF_NODE_RECORD_OFFSET_SIZE, &location, LEAF_NODE_RECORD_OFFSET_SIZE);
+        }
+        write_exact(dst_fd, data.data(), page_num, filename);
+    }
+
+    header.set_version(8);
+    write_exact(dst_fd, header_data.data(), HEADER_PAGE_NUM, filename);
+}
+
+void upgrade_file(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        // new database, nothing to upgrade
+        return;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1 || file_stat.st_size % PAGE_SIZE != 0)
+    {
+        close(fd);
+        return; // let the pager report it
+    }
+    uint32_t num_pages = file_stat.st_size / PAGE_SIZE;
+    if (num_pages == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    std::vector<char> data(PAGE_SIZE);
+    read_exact(fd, data.data(), HEADER_PAGE_NUM, filename);
+    FileHeader header(Node(data.data(), nullptr));
+    uint32_t version = 0; // no header, a version 0 file
+    if (header.has_magic())
+    {
+        version = header.get_version();
+        if (version > FILE_FORMAT_VERSION)
+        {
+            close(fd);
+            throw std::runtime_error("Unsupported file format version " + std::to_string(version) + ": " + filename);
+        }
+        if (version == FILE_FORMAT_VERSION)
+        {
+            close(fd);
+            return;
+        }
+    }
+
+    std::string upgrade_filename = filename + ".upgrade";
+    int dst_fd = open(upgrade_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (dst_fd == -1)
+    {
+        close(fd);
+        throw std::runtime_error("Unable to create file: " + upgrade_filename);
+    }
+
+    try
+    {
+        if (version == 0)
+        {
+            // the root moved to a page of its own at the end
+            upgrade_v0_to_v1(fd, dst_fd, num_pages, filename);
+            num_pages++;
+            upgrade_to_v3(dst_fd, dst_fd, num_pages, 1, filename);
+            upgrade_v3_to_v4(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v4_to_v5(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v5_to_v6(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v6_to_v7(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v7_to_v8(dst_fd, dst_fd, num_pages, filename);
+        }
+        else if (version < 3)
+        {
+            upgrade_to_v3(fd, dst_fd, num_pages, version, filename);
+            upgrade_v3_to_v4(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v4_to_v5(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v5_to_v6(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v6_to_v7(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v7_to_v8(dst_fd, dst_fd, num_pages, filename);
+        }
+        else if (version == 3)
+        {
+            upgrade_v3_to_v4(fd, dst_fd, num_pages, filename);
+            upgrade_v4_to_v5(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v5_to_v6(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v6_to_v7(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v7_to_v8(dst_fd, dst_fd, num_pages, filename);
+        }
+        else if (version == 4)
+        {
+            upgrade_v4_to_v5(fd, dst_fd, num_pages, filename);
+            upgrade_v5_to_v6(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v6_to_v7(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v7_to_v8(dst_fd, dst_fd, num_pages, filename);
+        }
+        else if (version == 5)
+        {
+            upgrade_v5_to_v6(fd, dst_fd, num_pages, filename);
+            upgrade_v6_to_v7(dst_fd, dst_fd, num_pages, filename);
+            upgrade_v7_to_v8(dst_fd, dst_fd, num_pages, filename);
+        }
+        else if (version == 6)
+        {
+            upgrade_v6_to_v7(fd, dst_fd, num_pages, filename);
+            upgrade_v7_to_v8(dst_fd, dst_fd, num_pages, filename);
+        }
+        else
+        {
+            upgrade_v7_to_v8(fd, dst_fd, num_pages, filename);
+        }
+        if (fsync(dst_fd) == -1)
+        {
+            throw std::runtime_error("Fail to sync file: " + upgrade_filename);
+        }
+    }
+    catch (...)
+    {
+        close(fd);
+        close(dst_fd);
+        unlink(upgrade_filename.c_str());
+        throw;
+    }
+    close(fd);
+    close(dst_fd);
+
+    if (rename(upgrade_filename.c_str(), filename.c_str()) == -1)
+    {
+        throw std::runtime_error("Unable to replace file: " + filename);
+    }
+    std::cout << "Upgraded " << filename << " to file format version " << FILE_FORMAT_VERSION << "." << std::endl;
+}
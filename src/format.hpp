@@ -0,0 +1,305 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "btree.hpp"
+#include "schema.hpp"
+
+//
+// File Header Layout
+// Page 0 of the database file holds the file header, it records
+// the page of the catalog, which lists the tables.
+// Free pages are chained from the header as trunk pages, each
+// listing up to FREE_TRUNK_MAX_LEAVES more free pages and the
+// next trunk. A trunk is free itself and is reused last. Files
+// written before the list existed have zeros there, no free page.
+//
+
+constexpr char FILE_MAGIC[] = "Mini-SQLite v1";
+constexpr uint32_t FILE_FORMAT_VERSION = 8;
+
+constexpr uint32_t HEADER_PAGE_NUM = 0;
+
+constexpr uint32_t FILE_MAGIC_SIZE = 16;
+constexpr uint32_t FILE_MAGIC_OFFSET = 0;
+constexpr uint32_t FILE_VERSION_SIZE = sizeof(uint32_t);
+constexpr uint32_t FILE_VERSION_OFFSET = FILE_MAGIC_OFFSET + FILE_MAGIC_SIZE;
+constexpr uint32_t FILE_PAGE_SIZE_SIZE = sizeof(uint32_t);
+constexpr uint32_t FILE_PAGE_SIZE_OFFSET = FILE_VERSION_OFFSET + FILE_VERSION_SIZE;
+constexpr uint32_t FILE_CATALOG_PAGE_SIZE = sizeof(uint32_t);
+constexpr uint32_t FILE_CATALOG_PAGE_OFFSET = FILE_PAGE_SIZE_OFFSET + FILE_PAGE_SIZE_SIZE;
+constexpr uint32_t FILE_FREE_TRUNK_PAGE_SIZE = sizeof(uint32_t);
+constexpr uint32_t FILE_FREE_TRUNK_PAGE_OFFSET = FILE_CATALOG_PAGE_OFFSET + FILE_CATALOG_PAGE_SIZE;
+constexpr uint32_t FILE_FREE_PAGE_COUNT_SIZE = sizeof(uint32_t);
+constexpr uint32_t FILE_FREE_PAGE_COUNT_OFFSET = FILE_FREE_TRUNK_PAGE_OFFSET + FILE_FREE_TRUNK_PAGE_SIZE;
+constexpr uint32_t FILE_HEADER_SIZE = FILE_FREE_PAGE_COUNT_OFFSET + FILE_FREE_PAGE_COUNT_SIZE;
+
+static_assert(sizeof(FILE_MAGIC) <= FILE_MAGIC_SIZE);
+
+constexpr uint32_t FREE_TRUNK_NEXT_SIZE = sizeof(uint32_t);
+constexpr uint32_t FREE_TRUNK_NEXT_OFFSET = 0;
+constexpr uint32_t FREE_TRUNK_NUM_LEAVES_SIZE = sizeof(uint32_t);
+constexpr uint32_t FREE_TRUNK_NUM_LEAVES_OFFSET = FREE_TRUNK_NEXT_OFFSET + FREE_TRUNK_NEXT_SIZE;
+constexpr uint32_t FREE_TRUNK_HEADER_SIZE = FREE_TRUNK_NUM_LEAVES_OFFSET + FREE_TRUNK_NUM_LEAVES_SIZE;
+constexpr uint32_t FREE_TRUNK_LEAF_SIZE = sizeof(uint32_t);
+constexpr uint32_t FREE_TRUNK_MAX_LEAVES = (PAGE_SIZE - FREE_TRUNK_HEADER_SIZE) / FREE_TRUNK_LEAF_SIZE;
+
+//
+// Catalog Layout
+// The number of tables, then one fixed-size entry per table in the
+// order they were created: the NUL padded name, the root page of the
+// table, its schema page and the split fill factor of the table, 0
+// if it was never set.
+//
+
+constexpr uint32_t CATALOG_NUM_TABLES_SIZE = sizeof(uint32_t);
+constexpr uint32_t CATALOG_NUM_TABLES_OFFSET = 0;
+constexpr uint32_t CATALOG_HEADER_SIZE = CATALOG_NUM_TABLES_OFFSET + CATALOG_NUM_TABLES_SIZE;
+
+constexpr uint32_t CATALOG_TABLE_NAME_SIZE = 32;
+constexpr uint32_t CATALOG_TABLE_NAME_OFFSET = 0;
+constexpr uint32_t CATALOG_ROOT_PAGE_SIZE = sizeof(uint32_t);
+constexpr uint32_t CATALOG_ROOT_PAGE_OFFSET = CATALOG_TABLE_NAME_OFFSET + CATALOG_TABLE_NAME_SIZE;
+constexpr uint32_t CATALOG_SCHEMA_PAGE_SIZE = sizeof(uint32_t);
+constexpr uint32_t CATALOG_SCHEMA_PAGE_OFFSET = CATALOG_ROOT_PAGE_OFFSET + CATALOG_ROOT_PAGE_SIZE;
+constexpr uint32_t CATALOG_SPLIT_FILL_FACTOR_SIZE = sizeof(double);
+constexpr uint32_t CATALOG_SPLIT_FILL_FACTOR_OFFSET = CATALOG_SCHEMA_PAGE_OFFSET + CATALOG_SCHEMA_PAGE_SIZE;
+constexpr uint32_t CATALOG_ENTRY_SIZE = CATALOG_SPLIT_FILL_FACTOR_OFFSET + CATALOG_SPLIT_FILL_FACTOR_SIZE;
+constexpr uint32_t CATALOG_MAX_TABLES = (PAGE_SIZE - CATALOG_HEADER_SIZE) / CATALOG_ENTRY_SIZE;
+
+// the table of new files, and the one table of files from before the catalog
+constexpr char DEFAULT_TABLE_NAME[] = "main";
+
+//
+// Schema Page Layout
+// The number of columns, then one fixed-size entry per column in
+// the order of their values: the NUL padded name, the ColumnType,
+// the size and the root page of the secondary index on the column,
+// 0 if it has none.
+//
+
+constexpr uint32_t SCHEMA_NUM_COLUMNS_SIZE = sizeof(uint32_t);
+constexpr uint32_t SCHEMA_NUM_COLUMNS_OFFSET = 0;
+constexpr uint32_t SCHEMA_HEADER_SIZE = SCHEMA_NUM_COLUMNS_OFFSET + SCHEMA_NUM_COLUMNS_SIZE;
+
+constexpr uint32_t SCHEMA_COLUMN_NAME_OFFSET = 0;
+constexpr uint32_t SCHEMA_COLUMN_TYPE_SIZE = sizeof(uint32_t);
+constexpr uint32_t SCHEMA_COLUMN_TYPE_OFFSET = SCHEMA_COLUMN_NAME_OFFSET + COLUMN_NAME_SIZE;
+constexpr uint32_t SCHEMA_COLUMN_SIZE_SIZE = sizeof(uint32_t);
+constexpr uint32_t SCHEMA_COLUMN_SIZE_OFFSET = SCHEMA_COLUMN_TYPE_OFFSET + SCHEMA_COLUMN_TYPE_SIZE;
+constexpr uint32_t SCHEMA_INDEX_ROOT_PAGE_SIZE = sizeof(uint32_t);
+constexpr uint32_t SCHEMA_INDEX_ROOT_PAGE_OFFSET = SCHEMA_COLUMN_SIZE_OFFSET + SCHEMA_COLUMN_SIZE_SIZE;
+constexpr uint32_t SCHEMA_ENTRY_SIZE = SCHEMA_INDEX_ROOT_PAGE_OFFSET + SCHEMA_INDEX_ROOT_PAGE_SIZE;
+constexpr uint32_t SCHEMA_MAX_COLUMNS = (PAGE_SIZE - SCHEMA_HEADER_SIZE) / SCHEMA_ENTRY_SIZE;
+
+//
+// Legacy Layout (version 0)
+// No header page, the root lives in page 0 and internal
+// cells are 16 bytes with the child page number after the key.
+//
+
+constexpr uint32_t V0_INTERNAL_NODE_CELL_SIZE = 16;
+constexpr uint32_t V0_INTERNAL_NODE_VALUE_OFFSET = sizeof(uint32_t);
+
+//
+// Legacy Layout (version 1 and 2)
+// Internal cells are 8 bytes, the key then the child page number.
+//
+
+constexpr uint32_t V2_INTERNAL_NODE_CELL_SIZE = 8;
+constexpr uint32_t V2_INTERNAL_NODE_VALUE_OFFSET = sizeof(uint32_t);
+
+//
+// Legacy Layout (version 1)
+// Leaf cells are the key followed by the whole row struct of the
+// time, with both strings NUL padded to their full size.
+//
+
+struct V1Row
+{
+    uint32_t id;
+    char username[COLUMN_USERNAME_SIZE + 1];
+    char email[COLUMN_EMAIL_SIZE + 1];
+};
+
+constexpr uint32_t V1_LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE;
+constexpr uint32_t V1_LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + sizeof(V1Row);
+constexpr uint32_t V1_LEAF_NODE_USERNAME_OFFSET = LEAF_NODE_KEY_SIZE + offsetof(V1Row, username);
+constexpr uint32_t V1_LEAF_NODE_EMAIL_OFFSET = LEAF_NODE_KEY_SIZE + offsetof(V1Row, email);
+
+//
+// Legacy Layout (version 2)
+// Leaves have the current header and records, but each key is
+// stored next to its record offset in one slot array.
+//
+
+constexpr uint32_t V2_LEAF_NODE_SLOT_SIZE = 8;
+constexpr uint32_t V2_LEAF_NODE_RECORD_OFFSET_OFFSET = sizeof(uint32_t);
+
+//
+// Legacy Layout (version 3)
+// Internal nodes have the current key array, followed by the child
+// array, with room for more cells as there are no row counts.
+//
+
+constexpr uint32_t V3_INTERNAL_NODE_MAX_CELLS = 509;
+constexpr uint32_t V3_INTERNAL_NODE_CHILDREN_OFFSET = INTERNAL_NODE_KEYS_OFFSET + V3_INTERNAL_NODE_MAX_CELLS * INTERNAL_NODE_KEY_SIZE;
+
+//
+// Legacy Layout (version 5 and before)
+// One table, the header records its root page where the catalog
+// page is now. Version 5 adds the root pages of its indexes after
+// the free page count, one for username and one for email.
+//
+
+constexpr uint32_t V5_FILE_ROOT_PAGE_OFFSET = FILE_CATALOG_PAGE_OFFSET;
+constexpr uint32_t V5_FILE_INDEX_ROOT_PAGES_OFFSET = FILE_FREE_PAGE_COUNT_OFFSET + FILE_FREE_PAGE_COUNT_SIZE;
+constexpr uint32_t V5_INDEX_COLUMN_NUM = 2;
+
+//
+// Legacy Layout (version 7 and before)
+// Every table has the default schema. Catalog entries hold the
+// root pages of the indexes on its two columns where the schema
+// page is now, then the split fill factor, which version 6 did
+// not keep. Leaf slots hold the plain record offset, the size is
+// read from the record.
+//
+
+constexpr uint32_t V7_CATALOG_INDEX_ROOT_PAGE_SIZE = sizeof(uint32_t);
+constexpr uint32_t V7_CATALOG_INDEX_ROOT_PAGES_OFFSET = CATALOG_ROOT_PAGE_OFFSET + CATALOG_ROOT_PAGE_SIZE;
+constexpr uint32_t V7_CATALOG_SPLIT_FILL_FACTOR_OFFSET = V7_CATALOG_INDEX_ROOT_PAGES_OFFSET + V5_INDEX_COLUMN_NUM * V7_CATALOG_INDEX_ROOT_PAGE_SIZE;
+constexpr uint32_t V7_CATALOG_ENTRY_SIZE = V7_CATALOG_SPLIT_FILL_FACTOR_OFFSET + CATALOG_SPLIT_FILL_FACTOR_SIZE;
+constexpr uint32_t V7_CATALOG_MAX_TABLES = (PAGE_SIZE - CATALOG_HEADER_SIZE) / V7_CATALOG_ENTRY_SIZE;
+constexpr uint32_t V6_CATALOG_ENTRY_SIZE = V7_CATALOG_SPLIT_FILL_FACTOR_OFFSET;
+
+static_assert(V7_CATALOG_MAX_TABLES <= CATALOG_MAX_TABLES);
+
+// A view over the header page, same conventions as Node
+class FileHeader
+{
+public:
+    // functions
+
+    explicit FileHeader(const Node &page);
+
+    void initialize(uint32_t catalog_page_num);
+
+    bool has_magic() const;
+    uint32_t get_version() const;
+    void set_version(uint32_t version);
+    uint32_t get_page_size() const;
+
+    uint32_t get_catalog_page() const;
+    void set_catalog_page(uint32_t page_num);
+
+    uint32_t get_free_trunk_page() const; // 0 if no page is free
+    void set_free_trunk_page(uint32_t page_num);
+    uint32_t get_free_page_count() const;
+    void set_free_page_count(uint32_t count);
+
+private:
+    // variables
+
+    Node page;
+
+    // functions
+
+    uint32_t read_u32(uint32_t offset) const;
+    void write_u32(uint32_t offset, uint32_t value);
+};
+
+// A view over the catalog page, same conventions as Node
+class Catalog
+{
+public:
+    // functions
+
+    explicit Catalog(const Node &page);
+
+    void initialize();
+
+    uint32_t get_num_tables() const;
+    std::string_view get_table_name(uint32_t index) const;
+    // index of the table, num_tables if there is none
+    uint32_t find_table(std::string_view name) const;
+    // the catalog must have room, see CATALOG_MAX_TABLES, returns the index
+    uint32_t add_table(std::string_view name, uint32_t root_page_num, uint32_t schema_page_num);
+
+    uint32_t get_root_page(uint32_t index) const;
+    void set_root_page(uint32_t index, uint32_t page_num);
+    uint32_t get_schema_page(uint32_t index) const;
+    void set_schema_page(uint32_t index, uint32_t page_num);
+    double get_split_fill_factor(uint32_t index) const; // 0 if it was never set
+    void set_split_fill_factor(uint32_t index, double fill_factor);
+
+private:
+    // variables
+
+    Node page;
+
+    // functions
+
+    uint32_t read_u32(uint32_t offset) const;
+    void write_u32(uint32_t offset, uint32_t value);
+};
+
+// A view over the schema page of a table, same conventions as Node
+class SchemaPage
+{
+public:
+    // functions
+
+    explicit SchemaPage(const Node &page);
+
+    // at most SCHEMA_MAX_COLUMNS columns, none of them has an index
+    void initialize(const Schema &schema);
+
+    Schema get_schema() const;
+    uint32_t get_num_columns() const;
+    uint32_t get_index_root_page(uint32_t column) const; // 0 if there is no index
+    void set_index_root_page(uint32_t column, uint32_t page_num);
+
+private:
+    // variables
+
+    Node page;
+
+    // functions
+
+    uint32_t read_u32(uint32_t offset) const;
+    void write_u32(uint32_t offset, uint32_t value);
+};
+
+// A view over a trunk page of the free list, same conventions as Node
+class FreeTrunk
+{
+public:
+    // functions
+
+    explicit FreeTrunk(const Node &page);
+
+    void initialize(uint32_t next_trunk_page_num);
+
+    uint32_t get_next_trunk() const; // 0 for the last trunk
+    uint32_t get_num_leaves() const;
+    void set_num_leaves(uint32_t num_leaves);
+    uint32_t get_leaf(uint32_t index) const;
+    void set_leaf(uint32_t index, uint32_t page_num);
+
+private:
+    // variables
+
+    Node page;
+
+    // functions
+
+    uint32_t read_u32(uint32_t offset) const;
+    void write_u32(uint32_t offset, uint32_t value);
+};
+
+// Bring an existing database file up to FILE_FORMAT_VERSION.
+// The upgraded file is written next to the original and renamed
+// over it, so a crash leaves either the old or the new file.
+void upgrade_file(const std::string &filename);
@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "index.hpp"
+#include "vm.hpp"
+
+IndexNode::IndexNode(const Node &node)
+    : Node(node)
+{
+}
+
+bool IndexNode::is_leaf() const
+{
+    return this->get_node_type() == NodeType::INDEX_LEAF;
+}
+
+uint32_t IndexNode::get_keys_offset() const
+{
+    return this->is_leaf() ? INDEX_LEAF_NODE_KEYS_OFFSET : INDEX_INTERNAL_NODE_KEYS_OFFSET;
+}
+
+uint32_t IndexNode::get_num_keys() const
+{
+    return this->read_u32(INDEX_NODE_NUM_KEYS_OFFSET);
+}
+
+void IndexNode::set_num_keys(uint32_t num_keys)
+{
+    this->write_u32(INDEX_NODE_NUM_KEYS_OFFSET, num_keys);
+}
+
+uint64_t IndexNode::get_key(uint32_t index) const
+{
+    uint64_t key;
+    memcpy(&key, this->page_data + this->get_keys_offset() + index * INDEX_NODE_KEY_SIZE, INDEX_NODE_KEY_SIZE);
+    return key;
+}
+
+void IndexNode::set_key(uint32_t index, uint64_t key)
+{
+    memcpy(this->page_data + this->get_keys_offset() + index * INDEX_NODE_KEY_SIZE, &key, INDEX_NODE_KEY_SIZE);
+    this->mark_dirty();
+}
+
+// binary search with a conditional move per step, like lower_bound_keys
+uint32_t IndexNode::find_key(uint64_t key) const
+{
+    uint32_t num_keys = this->get_num_keys();
+    if (num_keys == 0)
+    {
+        return 0;
+    }
+    uint32_t first = 0;
+    while (num_keys > 1)
+    {
+        uint32_t half = num_keys / 2;
+        first = this->get_key(first + half - 1) < key ? first + half : first;
+        num_keys -= half;
+    }
+    return first + (this->get_key(first) < key);
+}
+
+uint32_t IndexNode::get_child(uint32_t index) const
+{
+    if (index == this->get_num_keys())
+    {
+        return this->read_u32(INTERNAL_NODE_RIGHT_CHILD_OFFSET);
+    }
+    return this->read_u32(INDEX_INTERNAL_NODE_CHILDREN_OFFSET + index * INTERNAL_NODE_CHILD_SIZE);
+}
+
+void IndexNode::set_child(uint32_t index, uint32_t page_num)
+{
+    if (index == this->get_num_keys())
+    {
+        this->write_u32(INTERNAL_NODE_RIGHT_CHILD_OFFSET, page_num);
+        return;
+    }
+    this->write_u32(INDEX_INTERNAL_NODE_CHILDREN_OFFSET + index * INTERNAL_NODE_CHILD_SIZE, page_num);
+}
+
+uint32_t IndexNode::find_child(uint32_t page_num) const
+{
+    uint32_t num_keys = this->get_num_keys();
+    for (uint32_t i = 0; i <= num_keys; i++)
+    {
+        if (this->get_child(i) == page_num)
+        {
+            return i;
+        }
+    }
+    throw std::runtime_error("Index corrupted. Child not found in its parent.");
+}
+
+void IndexNode::insert_key(uint32_t index, uint64_t key)
+{
+    uint32_t num_keys = this->get_num_keys();
+    char *keys = this->page_data + INDEX_LEAF_NODE_KEYS_OFFSET;
+    memmove(keys + (index + 1) * INDEX_NODE_KEY_SIZE, keys + index * INDEX_NODE_KEY_SIZE, (num_keys - index) * INDEX_NODE_KEY_SIZE);
+    this->set_num_keys(num_keys + 1);
+    this->set_key(index, key);
+}
+
+void IndexNode::remove_key(uint32_t index)
+{
+    uint32_t num_keys = this->get_num_keys();
+    char *keys = this->page_data + INDEX_LEAF_NODE_KEYS_OFFSET;
+    memmove(keys + index * INDEX_NODE_KEY_SIZE, keys + (index + 1) * INDEX_NODE_KEY_SIZE, (num_keys - index - 1) * INDEX_NODE_KEY_SIZE);
+    this->set_num_keys(num_keys - 1);
+}
+
+void IndexNode::insert_child(uint32_t index, uint64_t key, uint32_t page_num)
+{
+    uint32_t num_keys = this->get_num_keys();
+    char *keys = this->page_data + INDEX_INTERNAL_NODE_KEYS_OFFSET;
+    char *children = this->page_data + INDEX_INTERNAL_NODE_CHILDREN_OFFSET;
+    memmove(keys + (index + 1) * INDEX_NODE_KEY_SIZE, keys + index * INDEX_NODE_KEY_SIZE, (num_keys - index) * INDEX_NODE_KEY_SIZE);
+    memmove(children + (index + 1) * INTERNAL_NODE_CHILD_SIZE, children + index * INTERNAL_NODE_CHILD_SIZE,
+            (num_keys - index) * INTERNAL_NODE_CHILD_SIZE);
+    this->set_num_keys(num_keys + 1);
+    this->set_key(index, key);
+    // the right child stays in the header
+    this->set_child(index, page_num);
+}
+
+// the right child is replaced by the one before it, which takes over its range
+void IndexNode::remove_child(uint32_t index)
+{
+    uint32_t num_keys = this->get_num_keys();
+    if (index == num_keys)
+    {
+        uint32_t last_child = this->get_child(num_keys - 1);
+        this->set_num_keys(num_keys - 1);
+        this->set_child(num_keys - 1, last_child);
+        return;
+    }
+    char *keys = this->page_data + INDEX_INTERNAL_NODE_KEYS_OFFSET;
+    char *children = this->page_data + INDEX_INTERNAL_NODE_CHILDREN_OFFSET;
+    memmove(keys + index * INDEX_NODE_KEY_SIZE, keys + (index + 1) * INDEX_NODE_KEY_SIZE, (num_keys - index - 1) * INDEX_NODE_KEY_SIZE);
+    memmove(children + index * INTERNAL_NODE_CHILD_SIZE, children + (index + 1) * INTERNAL_NODE_CHILD_SIZE,
+            (num_keys - index - 1) * INTERNAL_NODE_CHILD_SIZE);
+    this->set_num_keys(num_keys - 1);
+}
+
+Index::Index(Table &table, uint32_t column)
+    : table(table), column(column)
+{
+    this->root_page_num = this->table.get_index_root(column);
+}
+
+bool Index::exists() const
+{
+    return this->root_page_num != 0;
+}
+
+void Index::create()
+{
+    this->root_page_num = this->table.pager->allocate_page();
+    IndexNode root = IndexNode(this->table.pager->set_node_type(this->root_page_num, NodeType::INDEX_LEAF));
+    root.set_root(true);
+    this->table.set_index_root(this->column, this->root_page_num);
+    this->add_table_rows();
+}
+
+// keys go in sorted, so leaves fill up completely, see insert_key
+void Index::add_table_rows()
+{
+    std::vector<uint64_t> keys;
+    Row row;
+    for (Cursor cursor(this->table); !cursor.is_end_of_table(); cursor.advance())
+    {
+        this->table.pager->get_leaf(cursor.get_page_num()).get_row(cursor.get_cell_num(), row);
+        keys.push_back(this->get_key(row));
+    }
+    std::sort(keys.begin(), keys.end());
+    for (uint64_t key : keys)
+    {
+        this->insert_key(key);
+    }
+}
+
+void Index::insert(const Row &row)
+{
+    this->insert_key(this->get_key(row));
+}
+
+void Index::erase(const Row &row)
+{
+    this->erase_key(this->get_key(row));
+}
+
+//
+// Leaves are walked without a chain between them, once one runs out
+// while the hash still matches, the next one is found by descending
+// again for the key after its bound.
+//
+void Index::find(std::string_view value, std::vector<uint32_t> &ids)
+{
+    uint32_t hash = hash_value(value);
+    uint64_t key = (uint64_t)hash << 32;
+    uint64_t bound;
+    uint32_t page_num = this->find_leaf(key, bound);
+    while (true)
+    {
+        IndexNode leaf = IndexNode(this->table.pager->get_page(page_num));
+        uint32_t num_keys = leaf.get_num_keys();
+        for (uint32_t i = leaf.find_key(key); i < num_keys; i++)
+        {
+            uint64_t found_key = leaf.get_key(i);
+            if (found_key >> 32 != hash)
+            {
+                return;
+            }
+            ids.push_back((uint32_t)found_key);
+        }
+        // keys past the bound are in the following leaves
+        if (bound == UINT64_MAX || bound >> 32 != hash)
+        {
+            return;
+        }
+        key = bound + 1;
+        page_num = this->find_leaf(key, bound);
+    }
+}
+
+// 32-bit FNV-1a
+uint32_t Index::hash_value(std::string_view value)
+{
+    uint32_t hash = 2166136261u;
+    for (char c : value)
+    {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return hash;
+}
+
+uint64_t Index::get_key(const Row &row) const
+{
+    return (uint64_t)hash_value(this->table.get_schema().get_value(row, this->column)) << 32 | row.id;
+}
+
+//
+// The leaf which holds key if it is in the index. bound is the key of
+// the leaf in its parent, or the nearest one above it on the path,
+// UINT64_MAX for the last leaf.
+//
+uint32_t Index::find_leaf(uint64_t key, uint64_t &bound)
+{
+    uint32_t page_num = this->root_page_num;
+    bound = UINT64_MAX;
+    IndexNode node = IndexNode(this->table.pager->get_page(page_num));
+    while (!node.is_leaf())
+    {
+        uint32_t index = node.find_key(key);
+        if (index < node.get_num_keys())
+        {
+            bound = node.get_key(index);
+        }
+        page_num = node.get_child(index);
+        node = IndexNode(this->table.pager->get_page(page_num));
+    }
+    return page_num;
+}
+
+//
+// A full leaf splits evenly, unless the key goes after every key in
+// the index. Then the leaf keeps all of its keys and the new one
+// starts a leaf of its own, so keys added in order fill the leaves.
+//
+void Index::insert_key(uint64_t key)
+{
+    uint64_t bound;
+    uint32_t page_num = this->find_leaf(key, bound);
+    IndexNode leaf = IndexNode(this->table.pager->get_page(page_num));
+    uint32_t num_keys = leaf.get_num_keys();
+    uint32_t index = leaf.find_key(key);
+    if (index < num_keys && leaf.get_key(index) == key)
+    {
+        return;
+    }
+    if (num_keys < INDEX_LEAF_NODE_MAX_KEYS)
+    {
+        leaf.insert_key(index, key);
+        return;
+    }
+
+    std::vector<uint64_t> keys(num_keys + 1);
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        keys[i < index ? i : i + 1] = leaf.get_key(i);
+    }
+    keys[index] = key;
+    uint32_t left_num = bound == UINT64_MAX && index == num_keys ? num_keys : (num_keys + 1) / 2;
+    this->split_node(page_num, keys, {}, left_num);
+}
+
+//
+// Spread the keys of an overflowing node, with the children of an
+// internal one, over the node and a new right sibling. The first
+// left_num keys of a leaf stay, or the first left_num children of
+// an internal node along with their keys, the key of the last of
+// them becomes the bound of the node in its parent.
+//
+void Index::split_node(uint32_t page_num, const std::vector<uint64_t> &keys, const std::vector<uint32_t> &children, uint32_t left_num)
+{
+    bool is_leaf = children.empty();
+    uint32_t new_page_num;
+    uint64_t left_bound;
+    {
+        PinGuard node_guard(*this->table.pager, page_num);
+        new_page_num = this->table.pager->allocate_page();
+        PinGuard new_node_guard(*this->table.pager, new_page_num);
+        IndexNode new_node = IndexNode(this->table.pager->set_node_type(new_page_num, is_leaf ? NodeType::INDEX_LEAF : NodeType::INDEX_INTERNAL));
+        IndexNode node = IndexNode(this->table.pager->get_page(page_num));
+        new_node.set_parent(node.get_parent());
+
+        if (is_leaf)
+        {
+            node.set_num_keys(left_num);
+            new_node.set_num_keys(keys.size() - left_num);
+            for (uint32_t i = 0; i < keys.size(); i++)
+            {
+                (i < left_num ? node : new_node).set_key(i < left_num ? i : i - left_num, keys[i]);
+            }
+        }
+        else
+        {
+            node.set_num_keys(left_num - 1);
+            new_node.set_num_keys(children.size() - left_num - 1);
+            for (uint32_t i = 0; i < children.size(); i++)
+            {
+                IndexNode &target = i < left_num ? node : new_node;
+                uint32_t target_index = i < left_num ? i : i - left_num;
+                if (target_index < target.get_num_keys())
+                {
+                    target.set_key(target_index, keys[i]);
+                }
+                target.set_child(target_index, children[i]);
+            }
+            for (uint32_t i = left_num; i < children.size(); i++)
+            {
+                this->table.pager->get_page(children[i]).set_parent(new_page_num);
+            }
+        }
+        left_bound = keys[left_num - 1];
+    }
+    this->insert_split(page_num, left_bound, new_page_num);
+}
+
+// add the new right sibling of a node that split to their parent
+void Index::insert_split(uint32_t page_num, uint64_t left_bound, uint32_t new_page_num)
+{
+    Node node = this->table.pager->get_page(page_num);
+    if (node.is_root())
+    {
+        this->split_root(new_page_num, left_bound);
+        return;
+    }
+
+    uint32_t parent_page_num = node.get_parent();
+    IndexNode parent = IndexNode(this->table.pager->get_page(parent_page_num));
+    uint32_t index = parent.find_child(page_num);
+    uint32_t num_keys = parent.get_num_keys();
+    if (num_keys < INDEX_INTERNAL_NODE_MAX_KEYS)
+    {
+        parent.insert_child(index, left_bound, page_num);
+        parent.set_child(index + 1, new_page_num);
+        return;
+    }
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> children;
+    for (uint32_t i = 0; i <= num_keys; i++)
+    {
+        if (i == index)
+        {
+            keys.push_back(left_bound);
+            children.push_back(page_num);
+            children.push_back(new_page_num);
+        }
+        else
+        {
+            children.push_back(parent.get_child(i));
+        }
+        if (i < num_keys)
+        {
+            keys.push_back(parent.get_key(i));
+        }
+    }
+    this->split_node(parent_page_num, keys, children, children.size() / 2);
+}
+
+// the left half of the root moves to a new page, the root becomes their parent
+void Index::split_root(uint32_t new_page_num, uint64_t left_bound)
+{
+    uint32_t left_page_num = this->table.pager->allocate_page();
+    PinGuard root_guard(*this->table.pager, this->root_page_num);
+    PinGuard left_guard(*this->table.pager, left_page_num);
+
+    this->table.pager->copy_node_data(left_page_num, this->root_page_num);
+    IndexNode left = IndexNode(this->table.pager->get_page(left_page_num));
+    left.set_root(false);
+    left.set_parent(this->root_page_num);
+    if (!left.is_leaf())
+    {
+        for (uint32_t i = 0; i <= left.get_num_keys(); i++)
+        {
+            this->table.pager->get_page(left.get_child(i)).set_parent(left_page_num);
+        }
+    }
+
+    IndexNode root = IndexNode(this->table.pager->set_node_type(this->root_page_num, NodeType::INDEX_INTERNAL));
+    root.set_root(true);
+    root.set_parent(0);
+    root.set_num_keys(1);
+    root.set_key(0, left_bound);
+    root.set_child(0, left_page_num);
+    root.set_child(1, new_page_num);
+    this->table.pager->get_page(new_page_num).set_parent(this->root_page_num);
+}
+
+void Index::erase_key(uint64_t key)
+{
+    uint64_t bound;
+    uint32_t page_num = this->find_leaf(key, bound);
+    IndexNode leaf = IndexNode(this->table.pager->get_page(page_num));
+    uint32_t index = leaf.find_key(key);
+    if (index == leaf.get_num_keys() || leaf.get_key(index) != key)
+    {
+        return;
+    }
+    leaf.remove_key(index);
+    if (leaf.get_num_keys() == 0 && !leaf.is_root())
+    {
+        this->remove_node(page_num);
+        this->shrink_root();
+    }
+}
+
+// free an empty node, and its parent as well if it was the only child
+void Index::remove_node(uint32_t page_num)
+{
+    while (true)
+    {
+        uint32_t parent_page_num = this->table.pager->get_page(page_num).get_parent();
+        this->table.pager->free_page(page_num);
+        IndexNode parent = IndexNode(this->table.pager->get_page(parent_page_num));
+        if (parent.get_num_keys() > 0)
+        {
+            parent.remove_child(parent.find_child(page_num));
+            return;
+        }
+        if (parent.is_root())
+        {
+            IndexNode root = IndexNode(this->table.pager->set_node_type(parent_page_num, NodeType::INDEX_LEAF));
+            root.set_root(true);
+            return;
+        }
+        page_num = parent_page_num;
+    }
+}
+
+// while the root has a single child, the child moves into the root page
+void Index::shrink_root()
+{
+    IndexNode root = IndexNode(this->table.pager->get_page(this->root_page_num));
+    while (!root.is_leaf() && root.get_num_keys() == 0)
+    {
+        uint32_t child_page_num = root.get_child(0);
+        this->table.pager->copy_node_data(this->root_page_num, child_page_num);
+        root = IndexNode(this->table.pager->get_page(this->root_page_num));
+        root.set_root(true);
+        root.set_parent(0);
+        if (!root.is_leaf())
+        {
+            PinGuard root_guard(*this->table.pager, this->root_page_num);
+            for (uint32_t i = 0; i <= root.get_num_keys(); i++)
+            {
+                this->table.pager->get_page(root.get_child(i)).set_parent(this->root_page_num);
+            }
+        }
+        this->table.pager->free_page(child_page_num);
+        root = IndexNode(this->table.pager->get_page(this->root_page_num));
+    }
+}
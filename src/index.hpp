@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "table.hpp"
+
+//
+// Index Node Layout
+// A secondary index is a B-tree of its own in the database file.
+// Its keys are 8 bytes, the hash of the column value in the high
+// half and the row id in the low half, so every key is unique and
+// the ids of one value are next to each other in id order. Both
+// node types keep their keys in one dense array after the header.
+// Internal nodes have the header of table internal nodes and their
+// children after the keys, the key of a child is an upper bound of
+// its subtree as in the table.
+//
+
+constexpr uint32_t INDEX_NODE_KEY_SIZE = sizeof(uint64_t);
+constexpr uint32_t INDEX_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
+constexpr uint32_t INDEX_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
+
+constexpr uint32_t INDEX_LEAF_NODE_HEADER_SIZE = INDEX_NODE_NUM_KEYS_OFFSET + INDEX_NODE_NUM_KEYS_SIZE;
+constexpr uint32_t INDEX_LEAF_NODE_KEYS_OFFSET = INDEX_LEAF_NODE_HEADER_SIZE;
+constexpr uint32_t INDEX_LEAF_NODE_MAX_KEYS = (PAGE_SIZE - INDEX_LEAF_NODE_HEADER_SIZE) / INDEX_NODE_KEY_SIZE;
+
+constexpr uint32_t INDEX_INTERNAL_NODE_CELL_SIZE = INDEX_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE;
+constexpr uint32_t INDEX_INTERNAL_NODE_MAX_KEYS = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) / INDEX_INTERNAL_NODE_CELL_SIZE;
+constexpr uint32_t INDEX_INTERNAL_NODE_KEYS_OFFSET = INTERNAL_NODE_HEADER_SIZE;
+constexpr uint32_t INDEX_INTERNAL_NODE_CHILDREN_OFFSET = INDEX_INTERNAL_NODE_KEYS_OFFSET + INDEX_INTERNAL_NODE_MAX_KEYS * INDEX_NODE_KEY_SIZE;
+
+static_assert(INDEX_NODE_NUM_KEYS_OFFSET == INTERNAL_NODE_NUM_KEYS_OFFSET);
+
+// A view over an index node of either type, same conventions as Node
+class IndexNode : public Node
+{
+public:
+    // functions
+
+    explicit IndexNode(const Node &node);
+
+    bool is_leaf() const;
+
+    uint32_t get_num_keys() const;
+    void set_num_keys(uint32_t num_keys);
+
+    uint64_t get_key(uint32_t index) const;
+    void set_key(uint32_t index, uint64_t key);
+    // index of the first key not less than key, num_keys if there is none
+    uint32_t find_key(uint64_t key) const;
+
+    // internal nodes, index num_keys is the right child
+    uint32_t get_child(uint32_t index) const;
+    void set_child(uint32_t index, uint32_t page_num);
+    uint32_t find_child(uint32_t page_num) const;
+
+    // leaves, keys from index on move one up / down
+    void insert_key(uint32_t index, uint64_t key);
+    void remove_key(uint32_t index);
+    // internal nodes, the child goes in at index with key as its
+    // bound and the children from index on move one up
+    void insert_child(uint32_t index, uint64_t key, uint32_t page_num);
+    // internal nodes with at least one key
+    void remove_child(uint32_t index);
+
+private:
+    // functions
+
+    uint32_t get_keys_offset() const;
+};
+
+//
+// A secondary index on one column of a table, opened for a statement.
+// Its root page is recorded in the schema page of the table and
+// never moves, a root that splits is copied into a new page as in
+// the table. The hash is over the value of the column, see Schema.
+//
+// Nodes are not merged when keys are removed, only a node left
+// empty is taken out of its parent, and the root shrinks while it
+// has a single child. Every leaf stays at the same depth.
+//
+class Index
+{
+public:
+    // functions
+
+    Index(Table &table, uint32_t column);
+
+    Index(const Index &) = delete;
+    Index &operator=(const Index &) = delete;
+
+    bool exists() const;
+    // allocate the root and add every row of the table
+    void create();
+    // add every row of the table, the index must be empty
+    void add_table_rows();
+
+    void insert(const Row &row);
+    void erase(const Row &row);
+
+    //
+    // Ids of the rows whose value may be value, in ascending order.
+    // Values with the same hash are found as well, callers compare
+    // the values of the rows.
+    //
+    void find(std::string_view value, std::vector<uint32_t> &ids);
+
+    static uint32_t hash_value(std::string_view value);
+
+private:
+    // variables
+
+    Table &table;
+    uint32_t column;
+    uint32_t root_page_num; // 0 if there is no index
+
+    // functions
+
+    uint64_t get_key(const Row &row) const;
+    uint32_t find_leaf(uint64_t key, uint64_t &bound);
+
+    void insert_key(uint64_t key);
+    void split_node(uint32_t page_num, const std::vector<uint64_t> &keys, const std::vector<uint32_t> &children, uint32_t left_num);
+    void insert_split(uint32_t page_num, uint64_t left_bound, uint32_t new_page_num);
+    void split_root(uint32_t new_page_num, uint64_t left_bound);
+
+    void erase_key(uint64_t key);
+    void remove_node(uint32_t page_num);
+    void shrink_root();
+};
@@ -1,5 +1,9 @@
 #include <iostream>
 #include <cstdlib>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "db.hpp"
 #include "runtime.hpp"
@@ -8,15 +12,74 @@ int main(int argc, char *argv[])
 {
     if (argc < 2)
     {
-        std::cerr << "Must supply a database filename. Usage: " << argv[0] << " <database_filename>" << std::endl;
+        std::cerr << "Must supply a database filename. Usage: " << argv[0] << " <database_filename> [-f SCRIPT] [--frames N] [--mmap] [--no-wal] [--sync-interval MS]" << std::endl;
         return EXIT_FAILURE;
     }
 
-    Database db(argv[1]);
+    PagerOptions options;
+    std::string script_filename;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "-f" && i + 1 < argc)
+        {
+            script_filename = argv[++i];
+        }
+        else if (option == "--frames" && i + 1 < argc)
+        {
+            options.num_frames = std::strtoul(argv[++i], nullptr, 10);
+            if (options.num_frames < MIN_BUFFER_POOL_FRAMES)
+            {
+                std::cerr << "Buffer pool needs at least " << MIN_BUFFER_POOL_FRAMES << " frames." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (option == "--mmap")
+        {
+            options.mode = PagerMode::MMAP;
+        }
+        else if (option == "--no-wal")
+        {
+            options.wal = false;
+        }
+        else if (option == "--sync-interval" && i + 1 < argc)
+        {
+            options.wal_sync_interval_ms = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // a script file or piped input runs in batch mode
+    int script_fd = STDIN_FILENO;
+    if (!script_filename.empty())
+    {
+        script_fd = open(script_filename.c_str(), O_RDONLY);
+        if (script_fd == -1)
+        {
+            std::cerr << "Unable to open script: " << script_filename << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    bool batch = !script_filename.empty() || !isatty(STDIN_FILENO);
+
+    Database db(argv[1], options);
     Runtime runtime(&db);
     
     try
     {
+        if (batch)
+        {
+            bool succeeded = runtime.run_batch(script_fd);
+            if (script_fd != STDIN_FILENO)
+            {
+                close(script_fd);
+            }
+            return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
         runtime.indefinite_loop();
         return EXIT_SUCCESS;
     }
@@ -1,258 +1,861 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "format.hpp"
 #include "pager.hpp"
 
-Pager::Pager(const std::string &filename)
+Pager::Pager(const std::string &filename, const PagerOptions &options)
 {
+    uint32_t num_frames = options.num_frames;
+    if (options.mode == PagerMode::BUFFER_POOL && num_frames < MIN_BUFFER_POOL_FRAMES)
+    {
+        throw std::invalid_argument("Buffer pool needs at least " + std::to_string(MIN_BUFFER_POOL_FRAMES) + " frames.");
+    }
+
+    // one descriptor for the lifetime of the pager,
+    // create file if it is not exit
     this->filename = filename;
-    std::ifstream file = std::ifstream(filename, std::ios::ate | std::ios::binary);
-    if (!file.is_open())
-    {
-        // create file if it is not exit
-        std::ofstream new_file = std::ofstream(filename, std::ofstream::trunc | std::fstream::binary);
-        new_file.close();
-        file = std::ifstream(filename, std::ios::ate | std::ios::binary);
-        if (!file.is_open())
-        {
-            throw std::runtime_error("Unable to create file: " + filename);
-        }
+    this->fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd == -1)
+    {
+        throw std::runtime_error("Unable to open file: " + filename);
     }
 
-    this->file_length = file.tellg();
-    file.close();
+    struct stat file_stat;
+    if (fstat(this->fd, &file_stat) == -1)
+    {
+        close(this->fd);
+        throw std::runtime_error("Unable to stat file: " + filename);
+    }
+    this->file_length = file_stat.st_size;
 
     this->num_pages = file_length / PAGE_SIZE;
     if (file_length % PAGE_SIZE != 0)
     {
+        close(this->fd);
         throw std::runtime_error("File Corrupted. Db file contains partial page.");
     }
+    this->file_pages = this->num_pages;
+
+    // frames are allocated on demand up to max_frames,
+    // the reserve keeps Frame::dirty addresses stable for node views
+    this->mode = options.mode;
+    this->max_frames = this->mode == PagerMode::BUFFER_POOL ? num_frames : 0;
+    this->frames.reserve(this->max_frames);
+    this->clock_hand = 0;
+
+    this->map_base = nullptr;
+    this->mapped_pages = 0;
+    if (this->mode == PagerMode::MMAP)
+    {
+        this->map_file();
+    }
 
-    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++)
+    this->wal = nullptr;
+    if (options.wal && this->mode == PagerMode::BUFFER_POOL)
     {
-        this->pages[i] = nullptr;
+        this->wal = new Wal(filename, this->fd, options.wal_sync_interval_ms, options.wal_checkpoint_size);
     }
+    this->transaction = false;
+    this->committed_num_pages = this->num_pages;
 }
 
 Pager::~Pager()
 {
-    for (auto &page : this->pages)
+    delete this->wal;
+    for (auto &frame : this->frames)
+    {
+        delete[] frame.data;
+        delete[] frame.logged;
+    }
+    for (auto &before_image : this->before_images)
+    {
+        delete[] before_image.second;
+    }
+    if (this->map_base != nullptr)
     {
-        if (page)
+        munmap(this->map_base, MMAP_RESERVED_SIZE);
+        // drop the pages reserved by growth but never used
+        if (ftruncate(this->fd, (off_t)this->num_pages * PAGE_SIZE) == -1)
         {
-            delete page;
+            std::cerr << "Fail to truncate file: " << this->filename << std::endl;
         }
     }
-    for (auto &data : this->page_data)
+    close(this->fd);
+}
+
+//
+// Reserve the whole address range once, then map the file over
+// the front of it, so growing never moves existing pages.
+//
+void Pager::map_file()
+{
+    if ((uint64_t)this->file_length > MMAP_RESERVED_SIZE)
     {
-        if (data)
+        close(this->fd);
+        throw std::runtime_error("File too large to be mapped: " + this->filename);
+    }
+
+    void *base = mmap(nullptr, MMAP_RESERVED_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        close(this->fd);
+        throw std::runtime_error("Unable to reserve address space for file: " + this->filename);
+    }
+    this->map_base = (char *)base;
+
+    if (this->num_pages > 0)
+    {
+        void *mapped = mmap(this->map_base, (size_t)this->num_pages * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_FIXED, this->fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            munmap(this->map_base, MMAP_RESERVED_SIZE);
+            close(this->fd);
+            throw std::runtime_error("Unable to map file: " + this->filename);
+        }
+    }
+    this->mapped_pages = this->num_pages;
+    this->page_dirty.resize(this->mapped_pages, false);
+}
+
+// extend the file and map the new tail right after the current mapping
+void Pager::grow_mapping(uint32_t page_num)
+{
+    uint32_t new_mapped_pages = std::max(page_num + 1, this->mapped_pages + std::max(this->mapped_pages, MMAP_MIN_GROW_PAGES));
+    if ((uint64_t)new_mapped_pages * PAGE_SIZE > MMAP_RESERVED_SIZE)
+    {
+        new_mapped_pages = MMAP_RESERVED_SIZE / PAGE_SIZE;
+        if (page_num >= new_mapped_pages)
         {
-            delete data;
+            throw std::out_of_range("Tried to fetch page number out of the mapped range.");
         }
     }
+
+    off_t old_size = (off_t)this->mapped_pages * PAGE_SIZE;
+    off_t new_size = (off_t)new_mapped_pages * PAGE_SIZE;
+    if (ftruncate(this->fd, new_size) == -1)
+    {
+        throw std::runtime_error("Fail to extend file: " + this->filename);
+    }
+    void *mapped = mmap(this->map_base + old_size, new_size - old_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_FIXED, this->fd, old_size);
+    if (mapped == MAP_FAILED)
+    {
+        throw std::runtime_error("Unable to map file: " + this->filename);
+    }
+
+    this->mapped_pages = new_mapped_pages;
+    this->page_dirty.resize(this->mapped_pages, false);
+}
+
+// persist each run of consecutive dirty pages with one msync
+void Pager::sync_mapping()
+{
+    uint32_t page_num = 0;
+    while (page_num < this->mapped_pages)
+    {
+        if (!this->page_dirty[page_num])
+        {
+            page_num++;
+            continue;
+        }
+
+        uint32_t run_start = page_num;
+        while (page_num < this->mapped_pages && this->page_dirty[page_num])
+        {
+            this->page_dirty[page_num] = false;
+            page_num++;
+        }
+
+        if (msync(this->map_base + (size_t)run_start * PAGE_SIZE, (size_t)(page_num - run_start) * PAGE_SIZE, MS_SYNC) == -1)
+        {
+            throw std::runtime_error("Fail to sync file: " + this->filename);
+        }
+        this->stats.write_backs += page_num - run_start;
+    }
 }
 
 void Pager::flush(uint32_t page_num)
 {
-    if (this->pages[page_num] == nullptr)
+    if (this->mode == PagerMode::MMAP)
+    {
+        if (page_num < this->mapped_pages && this->page_dirty[page_num])
+        {
+            if (msync(this->map_base + (size_t)page_num * PAGE_SIZE, PAGE_SIZE, MS_SYNC) == -1)
+            {
+                throw std::runtime_error("Fail to sync file: " + this->filename);
+            }
+            this->page_dirty[page_num] = false;
+            this->stats.write_backs++;
+        }
+        return;
+    }
+
+    auto it = this->page_table.find(page_num);
+    if (it == this->page_table.end())
     {
         throw std::runtime_error("Tried to flush null page.");
     }
 
-    std::ofstream file;
-    if (page_num == 0)
+    Frame &frame = this->frames[it->second];
+    if (frame.dirty)
     {
-        file = std::ofstream(filename, std::ios::trunc | std::ios::binary);
+        Frame *dirty_frame = &frame;
+        this->write_pages(&dirty_frame, 1);
     }
-    else
+}
+
+void Pager::begin()
+{
+    if (this->wal == nullptr)
+    {
+        throw std::logic_error("Transactions need the write-ahead log.");
+    }
+    if (this->transaction)
     {
-        file = std::ofstream(filename, std::ios::app | std::ios::binary);
+        throw std::logic_error("A transaction is already open.");
     }
+    // anything changed outside of the transaction is not rolled back
+    this->commit();
+    this->transaction = true;
+}
 
-    if (!file.is_open())
+//
+// Log every dirty frame as one commit and end the transaction.
+// Without the write-ahead log pages are only written back on
+// eviction and flush_all.
+//
+void Pager::commit(bool sync)
+{
+    if (this->wal == nullptr)
     {
-        throw std::runtime_error("Fail to open file: " + this->filename);
-    };
+        return;
+    }
 
-    file.seekp(page_num * PAGE_SIZE, std::ios::beg);
-    file.write(this->page_data[page_num], PAGE_SIZE);
+    std::vector<Frame *> dirty_frames;
+    for (auto &frame : this->frames)
+    {
+        if (frame.dirty)
+        {
+            dirty_frames.push_back(&frame);
+        }
+    }
+    std::sort(dirty_frames.begin(), dirty_frames.end(),
+              [](const Frame *a, const Frame *b)
+              { return a->page_num < b->page_num; });
 
-    if (file.bad())
+    std::vector<WalPage> pages;
+    pages.reserve(dirty_frames.size());
+    for (const Frame *frame : dirty_frames)
     {
-        throw std::runtime_error("Read/writing error on i/o operation occur in writing file: " + this->filename);
+        pages.push_back(WalPage{frame->page_num, frame->data, frame->logged});
     }
-    if (file.fail())
+    this->wal->commit(pages, this->num_pages, sync);
+
+    for (Frame *frame : dirty_frames)
     {
-        throw std::runtime_error("cal error on i/o operation occur in writing file: " + this->filename);
+        memcpy(frame->logged, frame->data, PAGE_SIZE);
+        frame->dirty = false;
     }
 
-    file.close();
+    for (auto &before_image : this->before_images)
+    {
+        delete[] before_image.second;
+    }
+    this->before_images.clear();
+    this->committed_num_pages = this->num_pages;
+    this->transaction = false;
 }
 
-Node *Pager::get_page(uint32_t page_num)
+//
+// Drop every change since the last commit. Dirty frames go back to
+// their logged copy. Pages imaged to the log in the meantime are
+// read again, or restored from their before-image when the log has
+// only deltas for them; those are imaged and committed once more so
+// they can be read back later. Pages allocated since are dropped.
+//
+void Pager::rollback()
 {
-    if (page_num > TABLE_MAX_PAGES)
+    if (!this->transaction)
     {
-        throw std::out_of_range("Tried to fetch page number out of bounds.");
+        throw std::logic_error("No transaction is open.");
     }
 
-    if (this->pages[page_num] == nullptr)
+    std::vector<uint32_t> imaged_pages = this->wal->rollback();
+    for (auto &frame : this->frames)
     {
-        // Cache miss. Allocate memory and load from file.
-        uint32_t num_pages = this->num_pages;
+        if (frame.page_num == INVALID_PAGE_NUM)
+        {
+            continue;
+        }
+        if (frame.page_num >= this->committed_num_pages)
+        {
+            this->page_table.erase(frame.page_num);
+            frame.page_num = INVALID_PAGE_NUM;
+            frame.referenced = false;
+        }
+        else if (frame.dirty)
+        {
+            memcpy(frame.data, frame.logged, PAGE_SIZE);
+        }
+        frame.dirty = false;
+    }
 
-        char *data = this->new_page_data();
-        if (page_num <= num_pages)
+    for (uint32_t page_num : imaged_pages)
+    {
+        if (page_num >= this->committed_num_pages)
+        {
+            continue;
+        }
+        auto before_image = this->before_images.find(page_num);
+        auto it = this->page_table.find(page_num);
+        if (it != this->page_table.end())
         {
-            std::ifstream file = std::ifstream(filename, std::ios::ate | std::ios::binary);
-            if (!file.is_open())
+            Frame &frame = this->frames[it->second];
+            if (before_image != this->before_images.end())
             {
-                throw std::runtime_error("Fail to open file: " + this->filename);
-            };
-            file.seekg(page_num * PAGE_SIZE, std::ios::beg);
-            file.read(data, PAGE_SIZE);
-            if (!file.eof() && file.fail())
+                memcpy(frame.data, before_image->second, PAGE_SIZE);
+            }
+            else if (!this->wal->read_page(page_num, frame.data))
             {
-                file.close();
-                throw std::runtime_error("Error reading file: " + this->filename);
+                this->read_page(page_num, frame.data);
             }
-            file.close();
+            memcpy(frame.logged, frame.data, PAGE_SIZE);
+        }
+        else if (before_image != this->before_images.end())
+        {
+            this->wal->append(page_num, before_image->second);
         }
+    }
 
-        this->page_data[page_num] = data;
+    this->num_pages = this->committed_num_pages;
+    this->transaction = false;
+    this->commit();
+}
 
-        if (page_num >= this->num_pages)
+bool Pager::in_transaction()
+{
+    return this->transaction;
+}
+
+//
+// Write back every dirty frame. Pages are sorted by page number
+// and each run of consecutive pages goes out in one pwritev.
+//
+void Pager::flush_all()
+{
+    if (this->mode == PagerMode::MMAP)
+    {
+        this->sync_mapping();
+        return;
+    }
+    if (this->wal != nullptr)
+    {
+        // an open transaction is never committed implicitly
+        if (this->transaction)
         {
-            this->num_pages = page_num + 1;
+            this->rollback();
+        }
+        this->commit();
+        this->wal->checkpoint();
+        return;
+    }
+
+    std::vector<Frame *> dirty_frames;
+    for (auto &frame : this->frames)
+    {
+        if (frame.dirty)
+        {
+            dirty_frames.push_back(&frame);
+        }
+    }
+    if (dirty_frames.empty())
+    {
+        return;
+    }
+
+    std::sort(dirty_frames.begin(), dirty_frames.end(),
+              [](const Frame *a, const Frame *b)
+              { return a->page_num < b->page_num; });
+
+    size_t run_start = 0;
+    for (size_t i = 1; i <= dirty_frames.size(); i++)
+    {
+        if (i == dirty_frames.size() || dirty_frames[i]->page_num != dirty_frames[i - 1]->page_num + 1)
+        {
+            this->write_pages(&dirty_frames[run_start], i - run_start);
+            run_start = i;
         }
     }
 
-    this->pages[page_num] = this->deserialize(this->page_data[page_num]);
-    return this->pages[page_num];
+    if (fdatasync(this->fd) == -1)
+    {
+        throw std::runtime_error("Fail to sync file: " + this->filename);
+    }
 }
 
-char *Pager::new_page_data()
+// frames must hold consecutive page numbers
+void Pager::write_pages(Frame *const *frames, uint32_t count)
 {
-    char *data = new char[PAGE_SIZE]();
-    return data;
+    if (this->wal != nullptr)
+    {
+        // not committed yet, so it may only go to the log
+        for (uint32_t i = 0; i < count; i++)
+        {
+            // the committed content of a page the log has only deltas
+            // for would be lost if the transaction is rolled back
+            uint32_t page_num = frames[i]->page_num;
+            if (this->transaction && page_num < this->committed_num_pages && this->wal->needs_image(page_num) &&
+                this->before_images.find(page_num) == this->before_images.end())
+            {
+                char *before_image = this->new_page_data();
+                memcpy(before_image, frames[i]->logged, PAGE_SIZE);
+                this->before_images[page_num] = before_image;
+            }
+            this->wal->append(frames[i]->page_num, frames[i]->data);
+            memcpy(frames[i]->logged, frames[i]->data, PAGE_SIZE);
+            frames[i]->dirty = false;
+        }
+        this->stats.write_backs += count;
+        return;
+    }
+
+    uint32_t written = 0;
+    while (written < count)
+    {
+        uint32_t batch = std::min<uint32_t>(count - written, IOV_MAX);
+        std::vector<iovec> iov(batch);
+        for (uint32_t i = 0; i < batch; i++)
+        {
+            iov[i].iov_base = frames[written + i]->data;
+            iov[i].iov_len = PAGE_SIZE;
+        }
+
+        off_t offset = (off_t)frames[written]->page_num * PAGE_SIZE;
+        ssize_t expected = (ssize_t)batch * PAGE_SIZE;
+        if (pwritev(this->fd, iov.data(), batch, offset) != expected)
+        {
+            throw std::runtime_error("Error writing file: " + this->filename);
+        }
+        written += batch;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        frames[i]->dirty = false;
+    }
+
+    uint32_t last_page_num = frames[count - 1]->page_num;
+    if (last_page_num >= this->file_pages)
+    {
+        this->file_pages = last_page_num + 1;
+    }
+    this->stats.write_backs += count;
 }
 
-Node *Pager::deserialize(char *page_data)
+void Pager::read_page(uint32_t page_num, char *data)
 {
-    // switch to create node
-    // separate to different functions
-    // to avoid conflict
-    switch (*(NodeType *)(&page_data[NODE_TYPE_OFFSET]))
+    ssize_t bytes_read = pread(this->fd, data, PAGE_SIZE, (off_t)page_num * PAGE_SIZE);
+    if (bytes_read == -1)
     {
-    case NodeType::INTERNAL:
-        return (Node *)this->deserialize_internal(page_data);
-    case NodeType::LEAF:
-        return (Node *)this->deserialize_leaf(page_data);
+        throw std::runtime_error("Error reading file: " + this->filename);
     }
+    // a short read means the page was never fully written
+    memset(data + bytes_read, 0, PAGE_SIZE - bytes_read);
+}
+
+Frame &Pager::get_frame(uint32_t page_num)
+{
+    auto it = this->page_table.find(page_num);
+    if (it != this->page_table.end())
+    {
+        Frame &frame = this->frames[it->second];
+        frame.referenced = true;
+        this->stats.hits++;
+        return frame;
+    }
+
+    // Cache miss. Take a frame and load from file.
+    this->stats.misses++;
+    uint32_t frame_index = this->allocate_frame();
+    Frame &frame = this->frames[frame_index];
+    frame.page_num = page_num;
+    frame.pin_count = 0;
+    frame.referenced = true;
+    frame.dirty = false;
+
+    if (this->wal != nullptr)
+    {
+        // logged pages are newer than the file, which is
+        // extended by checkpoints behind the pager's back
+        if (!this->wal->read_page(page_num, frame.data))
+        {
+            this->read_page(page_num, frame.data);
+        }
+        memcpy(frame.logged, frame.data, PAGE_SIZE);
+    }
+    else if (page_num < this->file_pages)
+    {
+        this->read_page(page_num, frame.data);
+    }
+    else
+    {
+        memset(frame.data, 0, PAGE_SIZE);
+    }
+    this->page_table[page_num] = frame_index;
+
+    if (page_num >= this->num_pages)
+    {
+        this->num_pages = page_num + 1;
+    }
+
+    return frame;
+}
+
+uint32_t Pager::allocate_frame()
+{
+    if (this->frames.size() < this->max_frames)
+    {
+        char *logged = this->wal != nullptr ? this->new_page_data() : nullptr;
+        this->frames.push_back(Frame{0, this->new_page_data(), 0, false, false, logged});
+        return this->frames.size() - 1;
+    }
+
+    uint32_t victim = this->find_victim();
+    Frame &frame = this->frames[victim];
+    if (frame.page_num == INVALID_PAGE_NUM)
+    {
+        return victim;
+    }
+    if (frame.dirty || (this->wal != nullptr && this->wal->needs_image(frame.page_num)))
+    {
+        Frame *dirty_frame = &frame;
+        this->write_pages(&dirty_frame, 1);
+    }
+    this->page_table.erase(frame.page_num);
+    this->stats.evictions++;
+    return victim;
+}
+
+//
+// CLOCK: sweep the frames, clearing the referenced bit of recently
+// used frames and evicting the first unpinned frame without it.
+//
+uint32_t Pager::find_victim()
+{
+    uint32_t num_frames = this->frames.size();
+    for (uint32_t i = 0; i < 2 * num_frames; i++)
+    {
+        uint32_t index = this->clock_hand;
+        this->clock_hand = (this->clock_hand + 1) % num_frames;
+
+        Frame &frame = this->frames[index];
+        if (frame.pin_count > 0)
+        {
+            continue;
+        }
+        if (frame.referenced)
+        {
+            frame.referenced = false;
+            continue;
+        }
+        return index;
+    }
+    throw std::runtime_error("Buffer pool exhausted, all frames are pinned.");
+}
+
+void Pager::pin(uint32_t page_num)
+{
+    if (this->mode == PagerMode::MMAP)
+    {
+        return;
+    }
+    this->get_frame(page_num).pin_count++;
+}
+
+void Pager::unpin(uint32_t page_num)
+{
+    if (this->mode == PagerMode::MMAP)
+    {
+        return;
+    }
+    auto it = this->page_table.find(page_num);
+    if (it == this->page_table.end() || this->frames[it->second].pin_count == 0)
+    {
+        throw std::logic_error("Tried to unpin a page which is not pinned.");
+    }
+    this->frames[it->second].pin_count--;
+}
+
+const PagerStats &Pager::get_stats()
+{
+    if (this->wal != nullptr)
+    {
+        this->stats.wal_records = this->wal->get_record_num();
+        this->stats.wal_bytes = this->wal->get_byte_num();
+        this->stats.wal_commits = this->wal->get_commit_num();
+        this->stats.wal_syncs = this->wal->get_sync_num();
+        this->stats.checkpoints = this->wal->get_checkpoint_num();
+    }
+    return this->stats;
+}
+
+bool Pager::has_wal()
+{
+    return this->wal != nullptr;
+}
+
+PagerMode Pager::get_mode()
+{
+    return this->mode;
+}
+
+uint32_t Pager::get_frame_num()
+{
+    return this->max_frames;
+}
+
+// nodes are views over the cached page buffer,
+// so constructing one costs no allocation
+
+Node Pager::get_page(uint32_t page_num)
+{
+    if (this->mode == PagerMode::MMAP)
+    {
+        if (page_num >= this->mapped_pages)
+        {
+            this->grow_mapping(page_num);
+        }
+        if (page_num >= this->num_pages)
+        {
+            this->num_pages = page_num + 1;
+        }
+        this->stats.hits++;
+        return Node(this->map_base + (size_t)page_num * PAGE_SIZE, &this->page_dirty[page_num]);
+    }
+
+    Frame &frame = this->get_frame(page_num);
+    return Node(frame.data, &frame.dirty);
+}
+
+LeafNode Pager::get_leaf(uint32_t page_num)
+{
+    return LeafNode(this->get_page(page_num));
+}
+
+InternalNode Pager::get_internal(uint32_t page_num)
+{
+    return InternalNode(this->get_page(page_num));
 }
 
 // page_data is a char[]
 // all elements set to 0 by default
-// LeafNode constructed by pointer to
-// the array, so the default value
-// of those elements are all set to 0
+// so a new page is an empty leaf node
 // i.e.
 // nodeType = NodeType::Leaf (=0)
 // isRoot = false (=0)
 // parent_num = 0
 // num_cells = 0
+char *Pager::new_page_data()
+{
+    char *data = new char[PAGE_SIZE]();
+    return data;
+}
 
-InternalNode *Pager::deserialize_internal(char *page_data)
+uint32_t Pager::get_page_num()
 {
-    InternalNode *node = new InternalNode(
-        (NodeType *)(&page_data[NODE_TYPE_OFFSET]),
-        (bool *)(&page_data[IS_ROOT_OFFSET]),
-        (uint32_t *)(&page_data[PARENT_NUM_OFFSET]),
-        (uint32_t *)(&page_data[INTERNAL_NODE_NUM_KEYS_OFFSET]),
-        (uint32_t *)(&page_data[INTERNAL_NODE_RIGHT_CHILD_OFFSET]));
+    return this->num_pages;
+}
 
-    uint32_t body_start = INTERNAL_NODE_HEADER_SIZE;
-    for (uint32_t i = 0; i < INTERNAL_NODE_MAX_CELLS; i++)
-    {
-        uint32_t cell_start = body_start + i * INTERNAL_NODE_CELL_SIZE;
-        InternalNodeCell *cell = new InternalNodeCell(
-            (uint32_t *)(&page_data[cell_start + LEAF_NODE_KEY_OFFSET]),
-            (uint32_t *)(&page_data[cell_start + LEAF_NODE_VALUE_OFFSET]));
-        node->set_cell(i, cell);
-    }
-    return node;
+uint32_t Pager::get_free_page_num()
+{
+    return FileHeader(this->get_page(HEADER_PAGE_NUM)).get_free_page_count();
 }
 
-LeafNode *Pager::deserialize_leaf(char *page_data)
+//
+// Take a page off the free list, the last leaf of the first trunk
+// or the trunk itself once it is empty. New pages only go onto the
+// end of the database file if nothing is free. Either way the page
+// is returned zeroed, an empty leaf node.
+//
+uint32_t Pager::allocate_page()
 {
-    LeafNode *node = new LeafNode(
-        (NodeType *)(&page_data[NODE_TYPE_OFFSET]),
-        (uint32_t *)(&page_data[LEAF_NODE_NEXT_LEAF_OFFSET]),
-        (bool *)(&page_data[IS_ROOT_OFFSET]),
-        (uint32_t *)(&page_data[PARENT_NUM_OFFSET]),
-        (uint32_t *)(&page_data[LEAF_NODE_NUM_CELLS_OFFSET]));
+    PinGuard header_guard(*this, HEADER_PAGE_NUM);
+    FileHeader header(this->get_page(HEADER_PAGE_NUM));
+    uint32_t trunk_page_num = header.get_free_trunk_page();
 
-    uint32_t body_start = LEAF_NODE_HEADER_SIZE;
-    for (uint32_t i = 0; i < LEAF_NODE_MAX_CELLS; i++)
+    uint32_t page_num = this->num_pages;
+    if (trunk_page_num == 0)
     {
-        uint32_t cell_start = body_start + i * LEAF_NODE_CELL_SIZE;
-        LeafNodeCell *cell = new LeafNodeCell(
-            (uint32_t *)(&page_data[cell_start + LEAF_NODE_KEY_OFFSET]),
-            (Row *)(&page_data[cell_start + LEAF_NODE_VALUE_OFFSET]));
-        node->set_cell(i, cell);
+        this->num_pages = page_num + 1;
     }
-    return node;
+    else
+    {
+        FreeTrunk trunk(this->get_page(trunk_page_num));
+        uint32_t num_leaves = trunk.get_num_leaves();
+        if (num_leaves > 0)
+        {
+            page_num = trunk.get_leaf(num_leaves - 1);
+            trunk.set_num_leaves(num_leaves - 1);
+        }
+        else
+        {
+            page_num = trunk_page_num;
+            header.set_free_trunk_page(trunk.get_next_trunk());
+        }
+        header.set_free_page_count(header.get_free_page_count() - 1);
+    }
+
+    this->clean_page_data(page_num);
+    return page_num;
 }
 
-uint32_t Pager::get_page_num()
+//
+// Add a page to the first trunk of the free list, or make it the
+// new first trunk if that one is full. Its content is dropped.
+//
+void Pager::free_page(uint32_t page_num)
 {
-    return this->num_pages;
+    PinGuard header_guard(*this, HEADER_PAGE_NUM);
+    FileHeader header(this->get_page(HEADER_PAGE_NUM));
+    uint32_t trunk_page_num = header.get_free_trunk_page();
+    header.set_free_page_count(header.get_free_page_count() + 1);
+
+    if (trunk_page_num != 0)
+    {
+        FreeTrunk trunk(this->get_page(trunk_page_num));
+        uint32_t num_leaves = trunk.get_num_leaves();
+        if (num_leaves < FREE_TRUNK_MAX_LEAVES)
+        {
+            trunk.set_leaf(num_leaves, page_num);
+            trunk.set_num_leaves(num_leaves + 1);
+            return;
+        }
+    }
+
+    FreeTrunk trunk(this->get_page(page_num));
+    trunk.initialize(trunk_page_num);
+    header.set_free_trunk_page(page_num);
 }
 
-// Until we start recycling free pages, new pages will always
-// go onto the end of the database file
-uint32_t Pager::get_unused_page_num()
+//
+// Shrink the database to num_pages and make it durable. Frames of
+// the dropped pages are discarded unwritten. With the log the new
+// size is committed and the checkpoint cuts the file.
+//
+void Pager::truncate(uint32_t num_pages)
 {
-    return this->num_pages;
+    if (this->transaction)
+    {
+        throw std::logic_error("Cannot truncate inside a transaction.");
+    }
+
+    for (auto &frame : this->frames)
+    {
+        if (frame.page_num != INVALID_PAGE_NUM && frame.page_num >= num_pages)
+        {
+            this->page_table.erase(frame.page_num);
+            frame.page_num = INVALID_PAGE_NUM;
+            frame.referenced = false;
+            frame.dirty = false;
+        }
+    }
+    for (uint32_t page_num = num_pages; page_num < this->mapped_pages; page_num++)
+    {
+        this->page_dirty[page_num] = false;
+    }
+    this->num_pages = num_pages;
+
+    // the mapping keeps its size, the file is cut when it is closed
+    this->flush_all();
+    if (this->mode == PagerMode::BUFFER_POOL && this->wal == nullptr)
+    {
+        if (ftruncate(this->fd, (off_t)num_pages * PAGE_SIZE) == -1)
+        {
+            throw std::runtime_error("Fail to truncate file: " + this->filename);
+        }
+        this->file_pages = std::min(this->file_pages, num_pages);
+    }
 }
 
 void Pager::clean_page_data(uint32_t page_num)
 {
-    char *old_page = this->page_data[page_num];
-    char *new_page = this->new_page_data();
-    this->page_data[page_num] = new_page;
-    delete old_page;
+    Node node = this->get_page(page_num);
+    memset(node.get_data(), 0, PAGE_SIZE);
+    node.mark_dirty();
 }
 
 void Pager::copy_node_data(uint32_t dst_page_num, uint32_t src_page_num)
 {
     // deep copy
-    memcpy(this->page_data[dst_page_num], this->page_data[src_page_num], PAGE_SIZE);
-}
-
-void Pager::copy_node_cell(LeafNode *dst_node, uint32_t dst_cell_num, LeafNode *src_node, uint32_t src_cell_num)
-{
-    memcpy(dst_node->get_cell(dst_cell_num)->get_address(), src_node->get_cell(src_cell_num)->get_address(), LEAF_NODE_CELL_SIZE);
+    PinGuard src_guard(*this, src_page_num);
+    Node src = this->get_page(src_page_num);
+    Node dst = this->get_page(dst_page_num);
+    memcpy(dst.get_data(), src.get_data(), PAGE_SIZE);
+    dst.mark_dirty();
 }
 
 // will clean page data after changing node type
-Node *Pager::set_node_type(uint32_t page_num, NodeType new_type)
+Node Pager::set_node_type(uint32_t page_num, NodeType new_type)
 {
-    Node *node = this->get_page(page_num);
-    if (node->get_node_type() != new_type)
+    Node node = this->get_page(page_num);
+    if (node.get_node_type() != new_type)
     {
         this->clean_page_data(page_num);
         // set node type
-        char *page_data = this->page_data[page_num];
-        NodeType *node_type = (NodeType *)(&page_data[NODE_TYPE_OFFSET]);
-        *node_type = new_type;
-
-        return this->get_page(page_num);
+        memcpy(node.get_data() + NODE_TYPE_OFFSET, &new_type, NODE_TYPE_SIZE);
+        node.mark_dirty();
     }
     return node;
 }
 
+//
+// Max key of the subtree rooted at page_num,
+// which is the max key of its rightmost leaf.
+//
+uint32_t Pager::get_node_max_key(uint32_t page_num)
+{
+    Node node = this->get_page(page_num);
+    while (node.get_node_type() == NodeType::INTERNAL)
+    {
+        node = this->get_page(InternalNode(node).get_right_child());
+    }
+    return LeafNode(node).get_max_key();
+}
+
+// rows in the subtree rooted at page_num, read from the node alone
+uint64_t Pager::get_node_row_count(uint32_t page_num)
+{
+    Node node = this->get_page(page_num);
+    if (node.get_node_type() == NodeType::INTERNAL)
+    {
+        return InternalNode(node).get_total_row_count();
+    }
+    return LeafNode(node).get_num_cells();
+}
+
+PinGuard::PinGuard(Pager &pager, uint32_t page_num)
+    : pager(pager), page_num(page_num)
+{
+    this->pager.pin(page_num);
+}
+
+PinGuard::~PinGuard()
+{
+    this->pager.unpin(this->page_num);
+}
+
 void indent(uint32_t level)
 {
     for (uint32_t i = 0; i < level; i++)
@@ -261,54 +864,66 @@ void indent(uint32_t level)
     }
 }
 
-void Pager::print_tree(uint32_t page_num, uint32_t indentation_level)
+void Pager::print_tree(uint32_t page_num, uint32_t indentation_level, const Schema &schema)
 {
-    Node *node = this->get_page(page_num);
+    Node node = this->get_page(page_num);
 
-    switch (node->get_node_type())
+    switch (node.get_node_type())
     {
     case NodeType::INTERNAL:
-        print_internal(node, indentation_level);
+    {
+        // node is used again after each child is printed
+        PinGuard guard(*this, page_num);
+        print_internal(InternalNode(node), indentation_level, schema);
         break;
+    }
     case NodeType::LEAF:
-        print_leaf(node, indentation_level);
+        print_leaf(LeafNode(node), indentation_level, schema);
+        break;
+    case NodeType::INDEX_LEAF:
+        // index pages are not part of a table tree
+        indent(indentation_level);
+        std::cout << "- index leaf (page " << page_num << ")" << std::endl;
+        break;
+    case NodeType::INDEX_INTERNAL:
+        indent(indentation_level);
+        std::cout << "- index internal (page " << page_num << ")" << std::endl;
         break;
     }
 }
 
-void Pager::print_internal(Node *node, uint32_t indentation_level)
+void Pager::print_internal(InternalNode node, uint32_t indentation_level, const Schema &schema)
 {
     uint32_t num_keys, child;
-    auto node_internal = static_cast<InternalNode *>(node);
-    num_keys = node_internal->get_num_keys();
+    num_keys = node.get_num_keys();
     indent(indentation_level);
     std::cout << "- internal (size " << num_keys << ")" << std::endl;
 
     for (uint32_t i = 0; i < num_keys; i++)
     {
-        child = node_internal->get_child_at_cell(i);
-        this->print_tree(child, indentation_level + 1);
+        child = node.get_child_at_cell(i);
+        this->print_tree(child, indentation_level + 1, schema);
 
         indent(indentation_level + 1);
-        std::cout << "- key " << node_internal->get_key_at_cell(i) << std::endl;
+        std::cout << "- key " << node.get_key_at_cell(i) << std::endl;
     }
-    child = node_internal->get_right_child();
-    this->print_tree(child, indentation_level + 1);
+    child = node.get_right_child();
+    this->print_tree(child, indentation_level + 1, schema);
 }
 
-void Pager::print_leaf(Node *node, uint32_t indentation_level)
+void Pager::print_leaf(LeafNode node, uint32_t indentation_level, const Schema &schema)
 {
-    uint32_t num_keys, child;
-    auto node_leaf = static_cast<LeafNode *>(node);
-    num_keys = node_leaf->get_num_cells();
+    uint32_t num_keys;
+    num_keys = node.get_num_cells();
     indent(indentation_level);
     std::cout << "- leaf (size " << num_keys << ")" << std::endl;
 
+    Row row;
+    char text[ROW_MAX_TEXT_SIZE];
     for (uint32_t i = 0; i < num_keys; i++)
     {
+        node.get_row(i, row);
         indent(indentation_level + 1);
-        std::cout << "- " << node_leaf->get_cell(i)->get_key()
-                  << ": " << node_leaf->get_cell(i)->get_value()->username
-                  << "  " << node_leaf->get_cell(i)->get_value()->email << std::endl;
+        std::cout << "- " << row.id << ": " << std::string_view(text, schema.write_text(row, text) - text) << std::endl;
     }
 }
\ No newline at end of file
@@ -1,54 +1,193 @@
 #pragma once
 
-#include <fstream>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
 
 #include "btree.hpp"
+#include "schema.hpp"
+#include "wal.hpp"
+
+constexpr uint32_t DEFAULT_BUFFER_POOL_FRAMES = 1024;
+constexpr uint32_t MIN_BUFFER_POOL_FRAMES = 8; // enough for every page pinned by a split
+
+constexpr uint32_t INVALID_PAGE_NUM = UINT32_MAX; // page number of a frame holding no page
+
+constexpr uint64_t MMAP_RESERVED_SIZE = 1ull << 36; // address space kept for the mapping, 64 GiB
+constexpr uint32_t MMAP_MIN_GROW_PAGES = 256;
 
+enum class PagerMode
+{
+    BUFFER_POOL, // pages are read into a bounded pool of frames
+    MMAP         // pages are served straight from a shared mapping of the file
+};
+
+struct PagerOptions
+{
+    PagerMode mode = PagerMode::BUFFER_POOL;
+    uint32_t num_frames = DEFAULT_BUFFER_POOL_FRAMES;
+    bool wal = true; // buffer pool mode only
+    uint32_t wal_sync_interval_ms = DEFAULT_WAL_SYNC_INTERVAL_MS;
+    uint32_t wal_checkpoint_size = DEFAULT_WAL_CHECKPOINT_SIZE;
+};
+
+// A frame of the buffer pool, holds one cached page
+struct Frame
+{
+    uint32_t page_num;
+    char *data;
+    uint32_t pin_count;
+    bool referenced; // second chance bit for CLOCK eviction
+    bool dirty;
+    char *logged; // content as of the latest log record of the page, only with the log
+};
+
+struct PagerStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t write_backs = 0;
+    uint64_t wal_records = 0;
+    uint64_t wal_bytes = 0;
+    uint64_t wal_commits = 0;
+    uint64_t wal_syncs = 0;
+    uint64_t checkpoints = 0;
+};
+
+//
+// In BUFFER_POOL mode pages are cached in a bounded buffer pool.
+// A node view is only valid until its frame is evicted, which may
+// happen on any miss, so a page must be pinned while a view over
+// it is held across other page fetches.
+//
+// With the write-ahead log, commit() logs the changes of dirty
+// pages against their logged copy instead, and the database file
+// is only written by checkpoints. A page whose latest state is not
+// a logged image, dirty or not, is imaged when it is evicted and
+// read back from the log.
+//
+// Between begin() and commit() nothing is committed, pages imaged
+// to the log on eviction are uncommitted and rollback() cuts them
+// off again. If the log only holds deltas for such a page, its
+// committed content is kept aside until the transaction ends.
+//
+// In MMAP mode the file is mapped into a reserved address range
+// which is grown in place, views point into the mapping and stay
+// valid, pinning is a no-op.
+//
 class Pager
 {
 public:
     // functions
 
-    explicit Pager(const std::string &filename);
+    explicit Pager(const std::string &filename, const PagerOptions &options = PagerOptions());
     ~Pager();
 
     Pager(const Pager &) = delete;
     Pager &operator=(const Pager &) = delete;
 
-    Node *get_page(uint32_t page_num);
+    Node get_page(uint32_t page_num);
+    LeafNode get_leaf(uint32_t page_num);
+    InternalNode get_internal(uint32_t page_num);
 
     uint32_t get_page_num();
-    uint32_t get_unused_page_num();
+    uint32_t get_free_page_num();
+    uint32_t allocate_page();
+    void free_page(uint32_t page_num);
+    // drop the pages from num_pages on, they must be free or unused
+    void truncate(uint32_t num_pages);
+
+    void pin(uint32_t page_num);
+    void unpin(uint32_t page_num);
 
     void flush(uint32_t page_num);
+    void flush_all();
 
-    Node *set_node_type(uint32_t page_num, NodeType node_type);
+    // transactions need the write-ahead log
+    void begin();
+    void commit(bool sync = false);
+    void rollback();
+    bool in_transaction();
+
+    const PagerStats &get_stats();
+    PagerMode get_mode();
+    bool has_wal();
+    uint32_t get_frame_num();
+
+    Node set_node_type(uint32_t page_num, NodeType node_type);
 
     void copy_node_data(uint32_t src_page_num, uint32_t dst_page_num);
-    void copy_node_cell(LeafNode *src_node, uint32_t src_cell_num, LeafNode *dst_node, uint32_t dst_cell_num);
 
-    void print_tree(uint32_t page_num, uint32_t indentation_level);
+    uint32_t get_node_max_key(uint32_t page_num);
+    uint64_t get_node_row_count(uint32_t page_num);
+
+    // rows are printed by the schema of the table
+    void print_tree(uint32_t page_num, uint32_t indentation_level, const Schema &schema);
 
 private:
     // variables
 
     std::string filename;
-    std::streampos file_length;
+    int fd;
+    off_t file_length;
+    PagerMode mode;
 
     uint32_t num_pages;
+    uint32_t file_pages; // number of pages physically in the file
 
-    std::array<char *, TABLE_MAX_PAGES> page_data;
-    std::array<Node *, TABLE_MAX_PAGES> pages;
+    uint32_t max_frames;
+    std::vector<Frame> frames;
+    std::unordered_map<uint32_t, uint32_t> page_table; // page number -> frame index
+    uint32_t clock_hand;
+
+    char *map_base;
+    uint32_t mapped_pages;
+    std::deque<bool> page_dirty; // dirty bit per mapped page, deque keeps references stable on growth
+
+    Wal *wal; // nullptr unless logging
+    bool transaction;
+    uint32_t committed_num_pages;
+    std::unordered_map<uint32_t, char *> before_images; // page number -> committed content, see write_pages
+
+    PagerStats stats;
 
     // functions
 
+    Frame &get_frame(uint32_t page_num);
+    uint32_t allocate_frame();
+    uint32_t find_victim();
+    void read_page(uint32_t page_num, char *data);
+    void write_pages(Frame *const *frames, uint32_t count);
     char *new_page_data();
     void clean_page_data(uint32_t page_num);
 
-    Node *deserialize(char *page_data);
-    InternalNode *deserialize_internal(char *page_data);
-    LeafNode *deserialize_leaf(char *page_data);
+    void map_file();
+    void grow_mapping(uint32_t page_num);
+    void sync_mapping();
+
+    void print_internal(InternalNode node, uint32_t indentation_level, const Schema &schema);
+    void print_leaf(LeafNode node, uint32_t indentation_level, const Schema &schema);
+};
+
+// Keeps a page resident for the lifetime of the guard
+class PinGuard
+{
+public:
+    // functions
+
+    PinGuard(Pager &pager, uint32_t page_num);
+    ~PinGuard();
+
+    PinGuard(const PinGuard &) = delete;
+    PinGuard &operator=(const PinGuard &) = delete;
+
+private:
+    // variables
 
-    void print_internal(Node *node, uint32_t indentation_level);
-    void print_leaf(Node *node, uint32_t indentation_level);
+    Pager &pager;
+    uint32_t page_num;
 };
\ No newline at end of file
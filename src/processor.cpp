@@ -1,100 +1,681 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
 #include <string>
-#include <sstream>
 
+#include "bulk.hpp"
 #include "processor.hpp"
 
 InputBuffer::InputBuffer() {}
 
+Statement::Statement() : type(StatementType::EXIT), offset(0), count_rows(false), match_value(false) {}
+
 // meta commend
-Statement::Statement(StatementType type) : type(type) {}
+Statement::Statement(StatementType type) : type(type), offset(0), count_rows(false), match_value(false) {}
+
+Tokenizer::Tokenizer(std::string_view text) : text(text), position(0) {}
+
+std::string_view Tokenizer::next()
+{
+    // scan with locals, members would be reloaded after every store
+    const char *position = this->text.data() + this->position;
+    const char *end = this->text.data() + this->text.size();
+    while (position != end && (*position == ' ' || *position == '\t'))
+    {
+        position++;
+    }
+    const char *start = position;
+    while (position != end && *position != ' ' && *position != '\t')
+    {
+        position++;
+    }
+    this->position = position - this->text.data();
+    return std::string_view(start, position - start);
+}
+
+std::string_view Tokenizer::rest()
+{
+    return this->text.substr(this->position);
+}
+
+bool Tokenizer::at_end()
+{
+    size_t position = this->position;
+    bool at_end = this->next().empty();
+    this->position = position;
+    return at_end;
+}
+
+// the whole token has to be an unsigned 32-bit number
+static ParseResult parse_id(std::string_view token, uint32_t &id)
+{
+    const char *end = token.data() + token.size();
+    auto [ptr, error] = std::from_chars(token.data(), end, id);
+    if (error == std::errc() && ptr == end)
+    {
+        return ParseResult::SUCCESS;
+    }
+
+    int64_t value;
+    auto [signed_ptr, signed_error] = std::from_chars(token.data(), end, value);
+    if (signed_error != std::errc::invalid_argument && signed_ptr == end && token[0] == '-')
+    {
+        return ParseResult::NEGATIVE_ID;
+    }
+    return ParseResult::SYNTAX_ERROR;
+}
 
-// normal statement
-Statement::Statement(StatementType type, const Row &row_to_insert) : type(type), row_to_insert(row_to_insert) {}
+static ParseResult to_parse_result(ValueResult result)
+{
+    switch (result)
+    {
+    case ValueResult::SUCCESS:
+        return ParseResult::SUCCESS;
+    case ValueResult::STRING_TOO_LONG:
+        return ParseResult::STRING_TOO_LONG;
+    case ValueResult::INVALID_INTEGER:
+        break;
+    }
+    return ParseResult::SYNTAX_ERROR;
+}
 
-std::tuple<ParseResult, Statement *> CommandProcessor::parse_meta_command(const InputBuffer &input_buffer)
+static bool parse_fill_factor(std::string_view token, double &fill_factor)
 {
-    if (input_buffer.buffer.find(".exit") == 0)
+    const char *end = token.data() + token.size();
+    auto [ptr, error] = std::from_chars(token.data(), end, fill_factor);
+    return error == std::errc() && ptr == end;
+}
+
+ParseResult CommandProcessor::parse_meta_command(std::string_view input, Statement &statement)
+{
+    Tokenizer tokens(input);
+    std::string_view command = tokens.next();
+
+    if (command.starts_with(".exit"))
+    {
+        statement.type = StatementType::EXIT;
+    }
+    else if (command.starts_with(".btree"))
+    {
+        statement.type = StatementType::TREE;
+    }
+    else if (command.starts_with(".constant"))
+    {
+        statement.type = StatementType::CONSTANTS;
+    }
+    else if (command.starts_with(".stats"))
+    {
+        statement.type = StatementType::STATS;
+    }
+    else if (command.starts_with(".tables"))
+    {
+        statement.type = StatementType::TABLES;
+    }
+    else if (command == ".import")
+    {
+        return this->parse_import(tokens, statement);
+    }
+    else if (command == ".export")
     {
-        return std::make_tuple(ParseResult::SUCCESS, new Statement(StatementType::EXIT));
+        return this->parse_export(tokens, statement);
     }
-    else if (input_buffer.buffer.find(".btree") == 0)
+    else if (command == ".split")
     {
-        return std::make_tuple(ParseResult::SUCCESS, new Statement(StatementType::TREE));
+        return this->parse_split(tokens, statement);
     }
-    else if (input_buffer.buffer.find(".constant") == 0)
+    else if (command.starts_with(".vacuum"))
     {
-        return std::make_tuple(ParseResult::SUCCESS, new Statement(StatementType::CONSTANTS));
+        statement.type = StatementType::VACUUM;
     }
     else
     {
-        return std::make_tuple(ParseResult::UNRECOGNIZED_META_COMMAND, nullptr);
+        return ParseResult::UNRECOGNIZED_META_COMMAND;
+    }
+    return ParseResult::SUCCESS;
+}
+
+// .import <filename> [fill_factor]
+ParseResult CommandProcessor::parse_import(Tokenizer &tokens, Statement &statement)
+{
+    std::string_view filename = tokens.next();
+    std::string_view fill = tokens.next();
+    if (filename.empty() || !tokens.at_end())
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    double fill_factor = DEFAULT_BULK_FILL_FACTOR;
+    if (!fill.empty() && (!parse_fill_factor(fill, fill_factor) || !(fill_factor > 0 && fill_factor <= 1)))
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    statement.type = StatementType::IMPORT;
+    statement.filename = filename;
+    statement.fill_factor = fill_factor;
+    return ParseResult::SUCCESS;
+}
+
+// .export <filename> [binary|text], the whole table in id order
+ParseResult CommandProcessor::parse_export(Tokenizer &tokens, Statement &statement)
+{
+    std::string_view filename = tokens.next();
+    std::string_view format = tokens.next();
+    if (filename.empty() || !tokens.at_end())
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+    if (!format.empty() && format != "binary" && format != "text")
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    statement.type = StatementType::EXPORT;
+    statement.filename = filename;
+    statement.format = format == "text" ? ExportFormat::TEXT : ExportFormat::BINARY;
+    statement.low_id = 0;
+    statement.high_id = UINT32_MAX;
+    statement.limit = UINT64_MAX;
+    statement.offset = 0;
+    statement.count_rows = false;
+    statement.match_value = false;
+    return ParseResult::SUCCESS;
+}
+
+// .split <fill_factor>
+ParseResult CommandProcessor::parse_split(Tokenizer &tokens, Statement &statement)
+{
+    std::string_view fill = tokens.next();
+    double fill_factor;
+    if (fill.empty() || !tokens.at_end() || !parse_fill_factor(fill, fill_factor) ||
+        !(fill_factor >= MIN_SPLIT_FILL_FACTOR && fill_factor <= 1))
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    statement.type = StatementType::SPLIT;
+    statement.fill_factor = fill_factor;
+    return ParseResult::SUCCESS;
+}
+
+// the number of values is checked before any of them is parsed
+ParseResult CommandProcessor::parse_row(std::string_view text, Row &row, const Schema &schema)
+{
+    Tokenizer tokens(text);
+    std::string_view id_token = tokens.next();
+    Tokenizer values = tokens;
+    for (uint32_t i = 0; i < schema.columns.size(); i++)
+    {
+        if (values.next().empty())
+        {
+            return ParseResult::SYNTAX_ERROR;
+        }
+    }
+    if (!values.at_end())
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    uint32_t id;
+    ParseResult result = parse_id(id_token, id);
+    if (result != ParseResult::SUCCESS)
+    {
+        return result;
+    }
+
+    row.id = id;
+    row.record_size = 0;
+    for (uint32_t i = 0; i < schema.columns.size(); i++)
+    {
+        result = to_parse_result(schema.append_value(row, i, tokens.next()));
+        if (result != ParseResult::SUCCESS)
+        {
+            return result;
+        }
+    }
+    return ParseResult::SUCCESS;
+}
+
+// insert <id> <value>...[, <id> <value>...]...
+ParseResult CommandProcessor::parse_insert(Tokenizer &tokens, Statement &statement, const Schema &schema)
+{
+    // the rows are kept to reuse their memory for the next insert
+    std::vector<Row> &rows = statement.rows_to_insert;
+    rows.clear();
+    std::string_view values = tokens.rest();
+    while (true)
+    {
+        size_t row_end = values.find(',');
+        rows.emplace_back();
+        ParseResult result = this->parse_row(values.substr(0, row_end), rows.back(), schema);
+        if (result != ParseResult::SUCCESS)
+        {
+            return result;
+        }
+        if (row_end == std::string_view::npos)
+        {
+            break;
+        }
+        values.remove_prefix(row_end + 1);
     }
+
+    auto by_id = [](const Row &a, const Row &b)
+    { return a.id < b.id; };
+    if (!std::is_sorted(rows.begin(), rows.end(), by_id))
+    {
+        std::sort(rows.begin(), rows.end(), by_id);
+    }
+    statement.type = StatementType::INSERT;
+    return ParseResult::SUCCESS;
+}
+
+// delete where id = <id>
+// delete where id between <low> and <high>
+ParseResult CommandProcessor::parse_delete(Tokenizer &tokens, Statement &statement)
+{
+    if (tokens.next() != "where" || tokens.next() != "id")
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    std::string_view op = tokens.next();
+    if (op != "=" && op != "between")
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+    uint32_t low_id, high_id;
+    ParseResult result = parse_id(tokens.next(), low_id);
+    if (result != ParseResult::SUCCESS)
+    {
+        return result;
+    }
+    high_id = low_id;
+    if (op == "between")
+    {
+        if (tokens.next() != "and")
+        {
+            return ParseResult::SYNTAX_ERROR;
+        }
+        result = parse_id(tokens.next(), high_id);
+        if (result != ParseResult::SUCCESS)
+        {
+            return result;
+        }
+    }
+    if (!tokens.at_end())
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    statement.type = StatementType::DELETE;
+    statement.low_id = low_id;
+    statement.high_id = high_id;
+    return ParseResult::SUCCESS;
+}
+
+// letters, digits and underscores, at most max_size of them
+static ParseResult parse_name(std::string_view token, size_t max_size, std::string &name)
+{
+    if (token.empty() || !std::all_of(token.begin(), token.end(), [](char c)
+                                      { return std::isalnum((unsigned char)c) || c == '_'; }))
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+    if (token.size() > max_size)
+    {
+        return ParseResult::STRING_TOO_LONG;
+    }
+    name = token;
+    return ParseResult::SUCCESS;
 }
 
-const uint32_t INSERT_POSITION_ID = 1;
-const uint32_t INSERT_POSITION_USERNAME = 2;
-const uint32_t INSERT_POSITION_EMAIL = 3;
+static ParseResult parse_table_name(std::string_view token, std::string &table_name)
+{
+    return parse_name(token, CATALOG_TABLE_NAME_SIZE, table_name);
+}
 
-std::tuple<ParseResult, Statement *> CommandProcessor::parse_insert(const InputBuffer &input_buffer)
+// integer, text or text(<size>) with a size from 1 to COLUMN_TEXT_MAX_SIZE
+static bool parse_column_type(std::string_view token, Column &column)
 {
-    std::vector<std::string> tokens;
-    std::stringstream inputs(input_buffer.buffer);
-    std::string token;
-    while (std::getline(inputs, token, ' '))
+    if (token == "integer")
     {
-        tokens.push_back(token);
+        column.type = ColumnType::INTEGER;
+        column.size = COLUMN_INTEGER_SIZE;
+        return true;
     }
+    column.type = ColumnType::TEXT;
+    column.size = COLUMN_TEXT_MAX_SIZE;
+    if (token == "text")
+    {
+        return true;
+    }
+    if (!token.starts_with("text(") || !token.ends_with(")"))
+    {
+        return false;
+    }
+    std::string_view size = token.substr(5, token.size() - 6);
+    auto [ptr, error] = std::from_chars(size.data(), size.data() + size.size(), column.size);
+    return error == std::errc() && ptr == size.data() + size.size() && column.size >= 1 && column.size <= COLUMN_TEXT_MAX_SIZE;
+}
 
-    if (tokens.size() != 4)
+//
+// "<column> <type>[, <column> <type>]...)" after the opening
+// parenthesis. Names are unique and not id, and the columns have
+// to fit in a record and on the schema page.
+//
+ParseResult CommandProcessor::parse_columns(std::string_view text, Schema &schema)
+{
+    size_t end = text.rfind(')');
+    if (end == std::string_view::npos || !Tokenizer(text.substr(end + 1)).at_end())
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+    text = text.substr(0, end);
+
+    schema.columns.clear();
+    while (true)
+    {
+        size_t column_end = text.find(',');
+        Tokenizer tokens(text.substr(0, column_end));
+        Column column;
+        ParseResult result = parse_name(tokens.next(), COLUMN_NAME_SIZE, column.name);
+        if (result != ParseResult::SUCCESS)
+        {
+            return result;
+        }
+        if (!parse_column_type(tokens.next(), column) || !tokens.at_end())
+        {
+            return ParseResult::SYNTAX_ERROR;
+        }
+        if (column.name == "id" || schema.find_column(column.name) < schema.columns.size())
+        {
+            return ParseResult::DUPLICATE_COLUMN;
+        }
+        schema.columns.push_back(std::move(column));
+        if (column_end == std::string_view::npos)
+        {
+            break;
+        }
+        text.remove_prefix(column_end + 1);
+    }
+
+    if (schema.columns.size() > SCHEMA_MAX_COLUMNS || schema.get_max_record_size() > ROW_MAX_RECORD_SIZE)
     {
-        return std::make_tuple(ParseResult::SYNTAX_ERROR, nullptr);
+        return ParseResult::ROW_TOO_LARGE;
     }
+    return ParseResult::SUCCESS;
+}
 
-    uint32_t id = std::stoi(tokens[INSERT_POSITION_ID].c_str());
-    if (id < 0)
+// create table <name> [(<column> <type>[, <column> <type>]...)], see parse_columns,
+//   without columns the table has the default ones
+// create index on <column>
+ParseResult CommandProcessor::parse_create(Tokenizer &tokens, Statement &statement, const Schema &schema)
+{
+    std::string_view kind = tokens.next();
+    if (kind == "table")
+    {
+        std::string_view definition = tokens.rest();
+        size_t columns_begin = definition.find('(');
+        Tokenizer name_tokens(definition.substr(0, columns_begin));
+        ParseResult result = parse_table_name(name_tokens.next(), statement.table_name);
+        if (result != ParseResult::SUCCESS)
+        {
+            return result;
+        }
+        if (!name_tokens.at_end())
+        {
+            return ParseResult::SYNTAX_ERROR;
+        }
+        if (columns_begin == std::string_view::npos)
+        {
+            statement.schema = Schema::get_default();
+        }
+        else
+        {
+            result = this->parse_columns(definition.substr(columns_begin + 1), statement.schema);
+            if (result != ParseResult::SUCCESS)
+            {
+                return result;
+            }
+        }
+        statement.type = StatementType::CREATE_TABLE;
+        return ParseResult::SUCCESS;
+    }
+    if (kind != "index" || tokens.next() != "on")
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+    std::string_view column = tokens.next();
+    if (column.empty() || !tokens.at_end())
     {
-        return std::make_tuple(ParseResult::NEGATIVE_ID, nullptr);
+        return ParseResult::SYNTAX_ERROR;
     }
-    if (tokens[INSERT_POSITION_USERNAME].size() > COLUMN_USERNAME_SIZE ||
-        tokens[INSERT_POSITION_EMAIL].size() > COLUMN_EMAIL_SIZE)
+    statement.column = schema.find_column(column);
+    if (statement.column == schema.columns.size())
     {
-        return std::make_tuple(ParseResult::STRING_TOO_LONG, nullptr);
+        return ParseResult::UNKNOWN_COLUMN;
     }
 
-    Statement *statement = new Statement(StatementType::INSERT);
-    statement->row_to_insert.id = id;
-    std::strcpy(statement->row_to_insert.username, tokens[INSERT_POSITION_USERNAME].c_str());
-    std::strcpy(statement->row_to_insert.email, tokens[INSERT_POSITION_EMAIL].c_str());
+    statement.type = StatementType::CREATE_INDEX;
+    return ParseResult::SUCCESS;
+}
 
-    return std::make_tuple(ParseResult::SUCCESS, statement);
+// use <name>, the table later statements work on
+ParseResult CommandProcessor::parse_use(Tokenizer &tokens, Statement &statement)
+{
+    ParseResult result = parse_table_name(tokens.next(), statement.table_name);
+    if (result != ParseResult::SUCCESS)
+    {
+        return result;
+    }
+    if (!tokens.at_end())
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+    statement.type = StatementType::USE;
+    return ParseResult::SUCCESS;
 }
 
-std::tuple<ParseResult, Statement *> CommandProcessor::parse_select(const InputBuffer &input_buffer)
+// select [count(*)] [where <condition> [and <condition>]...] [limit <count>] [offset <count>]
+// with <condition> one of id <op> <id> with <op> one of = > >= < <=,
+// id between <low> and <high> or <column> = <value> for any other column.
+// The id conditions narrow one id range, values are for one column.
+ParseResult CommandProcessor::parse_select(Tokenizer &tokens, Statement &statement, const Schema &schema)
 {
-    return std::make_tuple(ParseResult::SUCCESS, new Statement(StatementType::SELECT));
+    uint32_t low_id = 0;
+    uint32_t high_id = UINT32_MAX;
+    bool is_empty = false;
+    bool match_value = false;
+    std::string_view token = tokens.next();
+    bool count_rows = token == "count(*)";
+    if (count_rows)
+    {
+        token = tokens.next();
+    }
+    if (token == "where")
+    {
+        do
+        {
+            std::string_view column = tokens.next();
+            if (column.empty())
+            {
+                return ParseResult::SYNTAX_ERROR;
+            }
+            if (column != "id")
+            {
+                uint32_t value_column = schema.find_column(column);
+                if (value_column == schema.columns.size())
+                {
+                    return ParseResult::UNKNOWN_COLUMN;
+                }
+                std::string_view text;
+                if (tokens.next() != "=" || (text = tokens.next()).empty())
+                {
+                    return ParseResult::SYNTAX_ERROR;
+                }
+                // a second value of the column either repeats the first or matches nothing
+                if (match_value && value_column != statement.column)
+                {
+                    return ParseResult::SYNTAX_ERROR;
+                }
+                std::string &value = match_value ? this->value : statement.value;
+                ParseResult result = to_parse_result(schema.parse_value(value_column, text, value));
+                if (result != ParseResult::SUCCESS)
+                {
+                    return result;
+                }
+                if (match_value && value != statement.value)
+                {
+                    is_empty = true;
+                }
+                statement.column = value_column;
+                match_value = true;
+                token = tokens.next();
+                continue;
+            }
+            std::string_view op = tokens.next();
+            uint32_t id;
+            ParseResult result = parse_id(tokens.next(), id);
+            if (result != ParseResult::SUCCESS)
+            {
+                return result;
+            }
+
+            if (op == "=" || op == ">=")
+            {
+                low_id = std::max(low_id, id);
+            }
+            if (op == "=" || op == "<=")
+            {
+                high_id = std::min(high_id, id);
+            }
+            if (op == ">")
+            {
+                is_empty = is_empty || id == UINT32_MAX;
+                low_id = std::max<uint32_t>(low_id, id + 1);
+            }
+            if (op == "<")
+            {
+                is_empty = is_empty || id == 0;
+                high_id = std::min<uint32_t>(high_id, id - 1);
+            }
+            if (op == "between")
+            {
+                uint32_t high;
+                if (tokens.next() != "and" || parse_id(tokens.next(), high) != ParseResult::SUCCESS)
+                {
+                    return ParseResult::SYNTAX_ERROR;
+                }
+                low_id = std::max(low_id, id);
+                high_id = std::min(high_id, high);
+            }
+            if (op != "=" && op != ">=" && op != "<=" && op != ">" && op != "<" && op != "between")
+            {
+                return ParseResult::SYNTAX_ERROR;
+            }
+            token = tokens.next();
+        } while (token == "and");
+    }
+
+    uint64_t limit = UINT64_MAX;
+    if (token == "limit")
+    {
+        uint32_t count;
+        if (parse_id(tokens.next(), count) != ParseResult::SUCCESS)
+        {
+            return ParseResult::SYNTAX_ERROR;
+        }
+        limit = count;
+        token = tokens.next();
+    }
+    uint64_t offset = 0;
+    if (token == "offset")
+    {
+        uint32_t count;
+        if (parse_id(tokens.next(), count) != ParseResult::SUCCESS)
+        {
+            return ParseResult::SYNTAX_ERROR;
+        }
+        offset = count;
+        token = tokens.next();
+    }
+    // count(*) returns one row, there is nothing to page through
+    if (!token.empty() || (count_rows && (limit != UINT64_MAX || offset != 0)))
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+
+    statement.type = StatementType::SELECT;
+    statement.low_id = is_empty ? 1 : low_id;
+    statement.high_id = is_empty ? 0 : high_id;
+    statement.limit = limit;
+    statement.offset = offset;
+    statement.count_rows = count_rows;
+    statement.match_value = match_value;
+    return ParseResult::SUCCESS;
 }
 
-std::tuple<ParseResult, Statement *> CommandProcessor::parse_statement(const InputBuffer &input_buffer)
+ParseResult CommandProcessor::parse_statement(std::string_view input, Statement &statement, const Schema &schema)
 {
-    if (input_buffer.buffer.find("insert") == 0)
+    Tokenizer tokens(input);
+    std::string_view keyword = tokens.next();
+
+    if (keyword == "insert")
+    {
+        return this->parse_insert(tokens, statement, schema);
+    }
+    if (keyword == "select")
+    {
+        return this->parse_select(tokens, statement, schema);
+    }
+    if (keyword == "delete")
     {
-        return this->parse_insert(input_buffer);
+        return this->parse_delete(tokens, statement);
     }
-    if (input_buffer.buffer.find("select") == 0)
+    if (keyword == "create")
+    {
+        return this->parse_create(tokens, statement, schema);
+    }
+    if (keyword == "use")
+    {
+        return this->parse_use(tokens, statement);
+    }
+
+    StatementType type;
+    if (keyword == "begin")
     {
-        return this->parse_select(input_buffer);
+        type = StatementType::BEGIN;
     }
-    return std::make_tuple(ParseResult::UNRECOGNIZED_STATEMENT, nullptr);
+    else if (keyword == "commit")
+    {
+        type = StatementType::COMMIT;
+    }
+    else if (keyword == "rollback")
+    {
+        type = StatementType::ROLLBACK;
+    }
+    else
+    {
+        return ParseResult::UNRECOGNIZED_STATEMENT;
+    }
+    if (!tokens.at_end())
+    {
+        return ParseResult::SYNTAX_ERROR;
+    }
+    statement.type = type;
+    return ParseResult::SUCCESS;
 }
 
-std::tuple<ParseResult, Statement *> CommandProcessor::parse(const InputBuffer &input_buffer)
+ParseResult CommandProcessor::parse(const InputBuffer &input_buffer, Statement &statement, const Schema &schema)
 {
-    if (input_buffer.buffer.find(".") == 0)
+    std::string_view input = input_buffer.buffer;
+    if (input.starts_with("."))
     {
-        return this->parse_meta_command(input_buffer);
+        return this->parse_meta_command(input, statement);
     }
     else
     {
-        return this->parse_statement(input_buffer);
+        return this->parse_statement(input, statement, schema);
     }
-}
\ No newline at end of file
+}
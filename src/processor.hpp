@@ -1,7 +1,11 @@
 #pragma once
 
-#include <tuple>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include "index.hpp"
+#include "sink.hpp"
 #include "table.hpp"
 
 struct InputBuffer
@@ -22,6 +26,9 @@ enum class ParseResult
     SYNTAX_ERROR,
     NEGATIVE_ID,
     STRING_TOO_LONG,
+    UNKNOWN_COLUMN,
+    DUPLICATE_COLUMN,
+    ROW_TOO_LARGE,
 };
 
 enum class StatementType
@@ -29,35 +36,101 @@ enum class StatementType
     EXIT,
     TREE,
     CONSTANTS,
+    STATS,
+    TABLES,
+    IMPORT,
+    EXPORT,
+    SPLIT,
+    VACUUM,
     INSERT,
-    SELECT
+    SELECT,
+    DELETE,
+    CREATE_INDEX,
+    CREATE_TABLE,
+    USE,
+    BEGIN,
+    COMMIT,
+    ROLLBACK
 };
 
 struct Statement
 {
     StatementType type;
-    Row row_to_insert;
+    std::vector<Row> rows_to_insert; // insert, sorted by id
+    std::string filename; // .import, .export
+    ExportFormat format;  // .export
+    double fill_factor;   // .import, .split
+    uint32_t low_id;      // select, delete: first id in range
+    uint32_t high_id;     // select, delete: last id in range, the range is empty if below low_id
+    uint64_t limit;       // select, most rows returned
+    uint64_t offset;      // select, rows in range skipped before the first one returned
+    bool count_rows;      // select count(*), the number of rows instead of the rows
+    bool match_value;     // select, only rows whose column is value
+    uint32_t column;      // select, create index
+    std::string value;    // select, as Schema::parse_value has it
+    std::string table_name; // create table, use
+    Schema schema;        // create table
 
-    explicit Statement(StatementType type);                  // meta commend
-    Statement(StatementType type, const Row &row_to_insert); // normal statement
+    Statement();                            // filled in by the parser
+    explicit Statement(StatementType type); // meta commend
 
     Statement(const Statement &) = delete;
     Statement &operator=(const Statement &) = delete;
 };
 
+// Splits text into tokens separated by blanks, the tokens are views into the text
+class Tokenizer
+{
+public:
+    // functions
+
+    explicit Tokenizer(std::string_view text);
+
+    // empty once all tokens are consumed
+    std::string_view next();
+    // the text after the last token returned
+    std::string_view rest();
+    bool at_end();
+
+private:
+    // variables
+
+    std::string_view text;
+    size_t position;
+};
+
+//
+// Statements are parsed into one the caller owns and reuses, so
+// parsing allocates nothing beyond the filename or the value of a
+// statement. Rows and column names are checked against the schema
+// of the table the statement runs on.
+//
 class CommandProcessor
 {
 public:
     // functions
 
-    // build and return an new statement
-    std::tuple<ParseResult, Statement *> parse(const InputBuffer &input_buffer);
+    ParseResult parse(const InputBuffer &input_buffer, Statement &statement, const Schema &schema);
+
+    // parse "<id> <value>..." into row, one value per column of schema
+    ParseResult parse_row(std::string_view text, Row &row, const Schema &schema);
 
 private:
+    // variables
+
+    std::string value; // a select, the value of a repeated column, compared with the first
+
     // functions
 
-    std::tuple<ParseResult, Statement *> parse_meta_command(const InputBuffer &input_buffer);
-    std::tuple<ParseResult, Statement *> parse_statement(const InputBuffer &input_buffer);
-    std::tuple<ParseResult, Statement *> parse_insert(const InputBuffer &input_buffer);
-    std::tuple<ParseResult, Statement *> parse_select(const InputBuffer &input_buffer);
-};
\ No newline at end of file
+    ParseResult parse_meta_command(std::string_view input, Statement &statement);
+    ParseResult parse_import(Tokenizer &tokens, Statement &statement);
+    ParseResult parse_export(Tokenizer &tokens, Statement &statement);
+    ParseResult parse_split(Tokenizer &tokens, Statement &statement);
+    ParseResult parse_statement(std::string_view input, Statement &statement, const Schema &schema);
+    ParseResult parse_insert(Tokenizer &tokens, Statement &statement, const Schema &schema);
+    ParseResult parse_select(Tokenizer &tokens, Statement &statement, const Schema &schema);
+    ParseResult parse_delete(Tokenizer &tokens, Statement &statement);
+    ParseResult parse_create(Tokenizer &tokens, Statement &statement, const Schema &schema);
+    ParseResult parse_columns(std::string_view text, Schema &schema);
+    ParseResult parse_use(Tokenizer &tokens, Statement &statement);
+};
@@ -1,7 +1,14 @@
+#include <cerrno>
+#include <chrono>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
 
 #include "db.hpp"
 #include "runtime.hpp"
+#include "sink.hpp"
 #include "table.hpp"
 #include "vm.hpp"
 
@@ -28,11 +35,12 @@ bool Runtime::read_input(InputBuffer &input_buffer)
 void Runtime::indefinite_loop()
 {
     InputBuffer input_buffer;
+    Statement statement; // reused by every line
     CommandProcessor processor;
-    VirtualMachine vm(this->db->get_table()); // get default table
+    TextSink sink(std::cout);
+    VirtualMachine vm(this->db, &sink);
 
-    bool flag = true;
-    while (flag)
+    while (true)
     {
         print_prompt();
 
@@ -42,41 +50,161 @@ void Runtime::indefinite_loop()
             std::exit(EXIT_FAILURE);
         }
 
-        auto [parse_result, parse_statement] = processor.parse(input_buffer);
+        std::string message;
+        if (this->execute_line(input_buffer, statement, processor, vm, message) == LineResult::EXIT)
+        {
+            break;
+        }
+        std::cout << message << std::endl;
+    }
+}
+
+//
+// Scripts are read in large chunks straight from the file descriptor
+// and split into lines here, blank lines are skipped. The script ends
+// at its end or at .exit.
+//
+bool Runtime::run_batch(int fd)
+{
+    InputBuffer input_buffer;
+    Statement statement; // reused by every line
+    CommandProcessor processor;
+    TextSink sink(std::cout);
+    VirtualMachine vm(this->db, &sink);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t line_num = 0;
+    uint64_t statement_num = 0;
+    uint64_t failure_num = 0;
 
-        switch (parse_result)
+    std::string pending; // input not split into lines yet
+    std::vector<char> chunk(BATCH_READ_SIZE);
+    bool end_of_input = false;
+    bool exit = false;
+    while (!end_of_input && !exit)
+    {
+        ssize_t read_size = read(fd, chunk.data(), chunk.size());
+        if (read_size < 0)
         {
-        case ParseResult::SUCCESS:
-            switch (vm.execute(*parse_statement))
+            if (errno == EINTR)
             {
-            case ExecuteResult::SUCCESS:
-                std::cout << "Executed." << std::endl;
+                continue;
+            }
+            throw std::runtime_error("Error reading script.");
+        }
+        end_of_input = read_size == 0;
+        pending.append(chunk.data(), read_size);
+        if (end_of_input && !pending.empty() && pending.back() != '\n')
+        {
+            pending.push_back('\n');
+        }
+
+        size_t line_start = 0;
+        size_t line_end;
+        while (!exit && (line_end = pending.find('\n', line_start)) != std::string::npos)
+        {
+            line_num++;
+            size_t line_size = line_end - line_start;
+            if (line_size > 0 && pending[line_end - 1] == '\r')
+            {
+                line_size--;
+            }
+            input_buffer.buffer.assign(pending, line_start, line_size);
+            line_start = line_end + 1;
+            if (input_buffer.buffer.find_first_not_of(" \t") == std::string::npos)
+            {
+                continue;
+            }
+
+            std::string message;
+            switch (this->execute_line(input_buffer, statement, processor, vm, message))
+            {
+            case LineResult::SUCCESS:
+                statement_num++;
                 break;
-            case ExecuteResult::DUPLICATE_KEY:
-                std::cout << "Error: Duplicate key." << std::endl;
+            case LineResult::FAILURE:
+                statement_num++;
+                failure_num++;
+                std::cout.flush();
+                std::cerr << "Line " << line_num << ": " << message << std::endl;
                 break;
-            case ExecuteResult::EXIT:
-                flag = false;
+            case LineResult::EXIT:
+                exit = true;
                 break;
             }
+        }
+        pending.erase(0, line_start);
+    }
+
+    std::cout.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Executed " << statement_num << " statements, " << failure_num << " failed, in "
+              << seconds << " s." << std::endl;
+    return failure_num == 0;
+}
+
+LineResult Runtime::execute_line(const InputBuffer &input_buffer, Statement &statement, CommandProcessor &processor, VirtualMachine &vm, std::string &message)
+{
+    switch (processor.parse(input_buffer, statement, vm.get_schema()))
+    {
+    case ParseResult::SUCCESS:
+        switch (vm.execute(statement))
+        {
+        case ExecuteResult::SUCCESS:
+            message = "Executed.";
+            return LineResult::SUCCESS;
+        case ExecuteResult::DUPLICATE_KEY:
+            message = "Error: Duplicate key.";
+            break;
+        case ExecuteResult::DUPLICATE_INDEX:
+            message = "Error: Index already exists.";
             break;
-        case ParseResult::UNRECOGNIZED_META_COMMAND:
-            std::cout << "Unrecognized command " << input_buffer.buffer << std::endl;
+        case ExecuteResult::DUPLICATE_TABLE:
+            message = "Error: Table already exists.";
             break;
-        case ParseResult::NEGATIVE_ID:
-            std::cout << "ID must be positive." << std::endl;
+        case ExecuteResult::UNKNOWN_TABLE:
+            message = "Error: Unknown table.";
             break;
-        case ParseResult::STRING_TOO_LONG:
-            std::cout << "String is too long." << std::endl;
+        case ExecuteResult::CATALOG_FULL:
+            message = "Error: Catalog is full.";
             break;
-        case ParseResult::SYNTAX_ERROR:
-            std::cout << "Syntax error. Could not parse statement." << std::endl;
+        case ExecuteResult::IMPORT_FAILED:
+            message = "Error: Import failed.";
             break;
-        case ParseResult::UNRECOGNIZED_STATEMENT:
-            std::cout << "Unrecognized keyword at start of " << input_buffer.buffer << std::endl;
+        case ExecuteResult::EXPORT_FAILED:
+            message = "Error: Export failed.";
             break;
+        case ExecuteResult::TRANSACTION_FAILED:
+            message = "Error: Transaction failed.";
+            break;
+        case ExecuteResult::EXIT:
+            return LineResult::EXIT;
         }
-
-        delete parse_statement;
+        break;
+    case ParseResult::UNRECOGNIZED_META_COMMAND:
+        message = "Unrecognized command " + input_buffer.buffer;
+        break;
+    case ParseResult::NEGATIVE_ID:
+        message = "ID must be positive.";
+        break;
+    case ParseResult::STRING_TOO_LONG:
+        message = "String is too long.";
+        break;
+    case ParseResult::UNKNOWN_COLUMN:
+        message = "Error: Unknown column.";
+        break;
+    case ParseResult::DUPLICATE_COLUMN:
+        message = "Error: Duplicate column.";
+        break;
+    case ParseResult::ROW_TOO_LARGE:
+        message = "Error: Columns do not fit in a row.";
+        break;
+    case ParseResult::SYNTAX_ERROR:
+        message = "Syntax error. Could not parse statement.";
+        break;
+    case ParseResult::UNRECOGNIZED_STATEMENT:
+        message = "Unrecognized keyword at start of " + input_buffer.buffer;
+        break;
     }
+    return LineResult::FAILURE;
 }
@@ -1,7 +1,19 @@
 #pragma once
 
+#include <string>
+
 #include "db.hpp"
 #include "processor.hpp"
+#include "vm.hpp"
+
+constexpr size_t BATCH_READ_SIZE = 1 << 20; // bytes of script read at once
+
+enum class LineResult
+{
+    SUCCESS,
+    FAILURE,
+    EXIT
+};
 
 // a REPL environment
 class Runtime
@@ -15,6 +27,9 @@ public:
     Runtime &operator=(const Runtime &) = delete;
 
     void indefinite_loop();
+    // run a script without prompts or acknowledgements, errors and a
+    // summary go to stderr, returns false if any statement failed
+    bool run_batch(int fd);
 
 private:
     // variables
@@ -25,4 +40,6 @@ private:
 
     void print_prompt();
     bool read_input(InputBuffer &input_buffer);
-};
\ No newline at end of file
+    // message is the acknowledgement or the error to report
+    LineResult execute_line(const InputBuffer &input_buffer, Statement &statement, CommandProcessor &processor, VirtualMachine &vm, std::string &message);
+};
@@ -0,0 +1,134 @@
+#include <charconv>
+#include <cstring>
+
+#include "schema.hpp"
+
+Schema Schema::get_default()
+{
+    Schema schema;
+    schema.columns.push_back({"username", ColumnType::TEXT, COLUMN_USERNAME_SIZE});
+    schema.columns.push_back({"email", ColumnType::TEXT, COLUMN_EMAIL_SIZE});
+    return schema;
+}
+
+uint32_t Schema::find_column(std::string_view name) const
+{
+    for (uint32_t i = 0; i < this->columns.size(); i++)
+    {
+        if (this->columns[i].name == name)
+        {
+            return i;
+        }
+    }
+    return this->columns.size();
+}
+
+uint32_t Schema::get_max_record_size() const
+{
+    uint32_t record_size = 0;
+    for (const Column &column : this->columns)
+    {
+        record_size += column.type == ColumnType::TEXT ? RECORD_STRING_SIZE_SIZE + column.size : COLUMN_INTEGER_SIZE;
+    }
+    return record_size;
+}
+
+// the whole text has to be a signed 64-bit number
+static bool parse_integer(std::string_view text, int64_t &integer)
+{
+    const char *end = text.data() + text.size();
+    auto [ptr, error] = std::from_chars(text.data(), end, integer);
+    return error == std::errc() && ptr == end;
+}
+
+ValueResult Schema::parse_value(uint32_t column, std::string_view text, std::string &value) const
+{
+    if (this->columns[column].type == ColumnType::TEXT)
+    {
+        if (text.size() > this->columns[column].size)
+        {
+            return ValueResult::STRING_TOO_LONG;
+        }
+        value = text;
+        return ValueResult::SUCCESS;
+    }
+
+    int64_t integer;
+    if (!parse_integer(text, integer))
+    {
+        return ValueResult::INVALID_INTEGER;
+    }
+    value.assign((const char *)&integer, COLUMN_INTEGER_SIZE);
+    return ValueResult::SUCCESS;
+}
+
+ValueResult Schema::append_value(Row &row, uint32_t column, std::string_view text) const
+{
+    char *position = row.record + row.record_size;
+    if (this->columns[column].type == ColumnType::TEXT)
+    {
+        if (text.size() > this->columns[column].size)
+        {
+            return ValueResult::STRING_TOO_LONG;
+        }
+        uint8_t size = text.size();
+        memcpy(position, &size, RECORD_STRING_SIZE_SIZE);
+        memcpy(position + RECORD_STRING_SIZE_SIZE, text.data(), size);
+        row.record_size += RECORD_STRING_SIZE_SIZE + size;
+        return ValueResult::SUCCESS;
+    }
+
+    int64_t integer;
+    if (!parse_integer(text, integer))
+    {
+        return ValueResult::INVALID_INTEGER;
+    }
+    memcpy(position, &integer, COLUMN_INTEGER_SIZE);
+    row.record_size += COLUMN_INTEGER_SIZE;
+    return ValueResult::SUCCESS;
+}
+
+// values before column are skipped, integers by their size and texts by theirs
+std::string_view Schema::get_value(const Row &row, uint32_t column) const
+{
+    const char *position = row.record;
+    for (uint32_t i = 0;; i++)
+    {
+        uint32_t size = COLUMN_INTEGER_SIZE;
+        if (this->columns[i].type == ColumnType::TEXT)
+        {
+            size = (uint8_t)position[0];
+            position += RECORD_STRING_SIZE_SIZE;
+        }
+        if (i == column)
+        {
+            return std::string_view(position, size);
+        }
+        position += size;
+    }
+}
+
+char *Schema::write_text(const Row &row, char *position) const
+{
+    const char *value = row.record;
+    for (uint32_t i = 0; i < this->columns.size(); i++)
+    {
+        if (i > 0)
+        {
+            *position++ = ' ';
+        }
+        if (this->columns[i].type == ColumnType::INTEGER)
+        {
+            int64_t integer;
+            memcpy(&integer, value, COLUMN_INTEGER_SIZE);
+            position = std::to_chars(position, position + ROW_MAX_TEXT_SIZE, integer).ptr;
+            value += COLUMN_INTEGER_SIZE;
+            continue;
+        }
+        uint8_t size = value[0];
+        memcpy(position, value + RECORD_STRING_SIZE_SIZE, size);
+        position += size;
+        value += RECORD_STRING_SIZE_SIZE + size;
+    }
+    return position;
+}
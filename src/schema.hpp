@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "btree.hpp"
+
+//
+// Column Values
+// Every column but the id has a type. An integer is a signed 64-bit
+// number, its value is its 8 bytes in host byte order. A text has
+// at most the size of its column in bytes, its value is those bytes.
+// Records hold the values of a row in column order, integers as
+// they are and texts behind their size in one byte.
+//
+
+enum class ColumnType : uint32_t
+{
+    INTEGER,
+    TEXT
+};
+
+constexpr uint32_t COLUMN_NAME_SIZE = 32;
+constexpr uint32_t COLUMN_INTEGER_SIZE = sizeof(int64_t);
+constexpr uint32_t COLUMN_TEXT_MAX_SIZE = UINT8_MAX;
+// write_text at its longest, an integer takes up to 20 characters for its 8 bytes
+constexpr uint32_t ROW_MAX_TEXT_SIZE = 3 * ROW_MAX_RECORD_SIZE;
+
+static_assert(COLUMN_USERNAME_SIZE <= COLUMN_TEXT_MAX_SIZE && COLUMN_EMAIL_SIZE <= COLUMN_TEXT_MAX_SIZE);
+
+struct Column
+{
+    std::string name;
+    ColumnType type;
+    uint32_t size; // COLUMN_INTEGER_SIZE, or the most bytes of a text
+};
+
+enum class ValueResult
+{
+    SUCCESS,
+    INVALID_INTEGER,
+    STRING_TOO_LONG
+};
+
+// The columns of a table after the id, in the order of their values
+class Schema
+{
+public:
+    // variables
+
+    std::vector<Column> columns;
+
+    // functions
+
+    // username text(32), email text(255), the columns of tables without a declared schema
+    static Schema get_default();
+
+    // index of the column, the number of columns if there is none
+    uint32_t find_column(std::string_view name) const;
+    // the record of a row with every text at its longest
+    uint32_t get_max_record_size() const;
+
+    // the value of column written as text
+    ValueResult parse_value(uint32_t column, std::string_view text, std::string &value) const;
+    // parse the value of column and add it to the record of row,
+    // the values of the columns before it have to be there already
+    ValueResult append_value(Row &row, uint32_t column, std::string_view text) const;
+    // the value of column in the record of row, a view into the row
+    std::string_view get_value(const Row &row, uint32_t column) const;
+    // the values of row as text separated by blanks, returns the end
+    char *write_text(const Row &row, char *position) const;
+};
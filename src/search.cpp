@@ -0,0 +1,124 @@
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "search.hpp"
+
+using CountLess = uint32_t (*)(const char *keys, uint32_t num_keys, uint32_t key);
+
+static uint32_t read_key(const char *keys, uint32_t index)
+{
+    uint32_t key;
+    memcpy(&key, keys + index * sizeof(uint32_t), sizeof(uint32_t));
+    return key;
+}
+
+// number of keys less than key, without branches on the keys
+static uint32_t count_less_scalar(const char *keys, uint32_t num_keys, uint32_t key)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        count += read_key(keys, i) < key;
+    }
+    return count;
+}
+
+#if defined(__x86_64__)
+
+//
+// There is no unsigned compare before AVX-512, flipping the sign
+// bit of both sides makes the signed one order them the same way.
+// A lane that compares true is all ones, minus one, so subtracting
+// the compare results counts the smaller keys of each lane, they
+// are summed once at the end.
+//
+
+static uint32_t count_less_sse2(const char *keys, uint32_t num_keys, uint32_t key)
+{
+    const __m128i sign = _mm_set1_epi32(INT32_MIN);
+    const __m128i needle = _mm_set1_epi32(key ^ 0x80000000u);
+    __m128i counts = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 4 <= num_keys; i += 4)
+    {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(keys + i * sizeof(uint32_t))), sign);
+        counts = _mm_sub_epi32(counts, _mm_cmpgt_epi32(needle, block));
+    }
+    counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(1, 0, 3, 2)));
+    counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(counts) + count_less_scalar(keys + i * sizeof(uint32_t), num_keys - i, key);
+}
+
+__attribute__((target("avx2"))) static uint32_t count_less_avx2(const char *keys, uint32_t num_keys, uint32_t key)
+{
+    const __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    const __m256i needle = _mm256_set1_epi32(key ^ 0x80000000u);
+    __m256i counts = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for (; i + 8 <= num_keys; i += 8)
+    {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + i * sizeof(uint32_t))), sign);
+        counts = _mm256_sub_epi32(counts, _mm256_cmpgt_epi32(needle, block));
+    }
+    __m128i half_counts = _mm_add_epi32(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1));
+    half_counts = _mm_add_epi32(half_counts, _mm_shuffle_epi32(half_counts, _MM_SHUFFLE(1, 0, 3, 2)));
+    half_counts = _mm_add_epi32(half_counts, _mm_shuffle_epi32(half_counts, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half_counts) + count_less_scalar(keys + i * sizeof(uint32_t), num_keys - i, key);
+}
+
+static bool has_avx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static const bool use_avx2 = has_avx2();
+static const CountLess count_less = use_avx2 ? count_less_avx2 : count_less_sse2;
+
+#else
+
+static const CountLess count_less = count_less_scalar;
+
+#endif
+
+//
+// Halve the range until at most SEARCH_BLOCK_KEYS are left, every
+// key before first is less than key and every key after the block
+// is not. The step is a conditional move, so random keys do not
+// cost a mispredicted branch per level.
+//
+static inline uint32_t narrow(const char *keys, uint32_t &num_keys, uint32_t key)
+{
+    uint32_t first = 0;
+    while (num_keys > SEARCH_BLOCK_KEYS)
+    {
+        uint32_t half = num_keys / 2;
+        first = read_key(keys, first + half - 1) < key ? first + half : first;
+        num_keys -= half;
+    }
+    return first;
+}
+
+uint32_t lower_bound_keys(const char *keys, uint32_t num_keys, uint32_t key)
+{
+    uint32_t first = narrow(keys, num_keys, key);
+    return first + count_less(keys + first * sizeof(uint32_t), num_keys, key);
+}
+
+uint32_t lower_bound_keys_scalar(const char *keys, uint32_t num_keys, uint32_t key)
+{
+    uint32_t first = narrow(keys, num_keys, key);
+    return first + count_less_scalar(keys + first * sizeof(uint32_t), num_keys, key);
+}
+
+const char *get_search_implementation()
+{
+#if defined(__x86_64__)
+    return use_avx2 ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
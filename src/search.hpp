@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+// keys left after narrowing by binary search, they are compared all at once
+constexpr uint32_t SEARCH_BLOCK_KEYS = 32;
+
+//
+// Search over the dense key arrays of nodes. Keys are uint32_t in
+// ascending order, read from a page buffer without alignment.
+// Returns the index of the first key not less than key, num_keys
+// if there is none. The range is narrowed by binary search down to
+// a block whose keys are counted with vector compares: AVX2 if the
+// CPU has it (checked once at startup), SSE2 otherwise, and plain
+// loops on other architectures.
+//
+uint32_t lower_bound_keys(const char *keys, uint32_t num_keys, uint32_t key);
+
+// the same without vector instructions
+uint32_t lower_bound_keys_scalar(const char *keys, uint32_t num_keys, uint32_t key);
+
+// name of the implementation lower_bound_keys uses
+const char *get_search_implementation();
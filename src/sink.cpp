@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#include "sink.hpp"
+
+StreamSink::StreamSink(std::ostream &out)
+    : out(out), buffer(new char[STREAM_SINK_BUFFER_SIZE]), size(0) {}
+
+StreamSink::~StreamSink()
+{
+    this->write_buffer();
+    delete[] this->buffer;
+}
+
+void StreamSink::flush()
+{
+    this->write_buffer();
+    this->out.flush();
+}
+
+void StreamSink::reserve(size_t size)
+{
+    if (STREAM_SINK_BUFFER_SIZE - this->size < size)
+    {
+        this->write_buffer();
+    }
+}
+
+void StreamSink::write_buffer()
+{
+    if (this->size > 0)
+    {
+        this->out.write(this->buffer, this->size);
+        this->size = 0;
+    }
+}
+
+TextSink::TextSink(std::ostream &out) : StreamSink(out) {}
+
+void TextSink::write_row(const Schema &schema, const Row &row)
+{
+    this->reserve(TEXT_SINK_MAX_ROW_SIZE);
+
+    char *position = this->buffer + this->size;
+    position = std::to_chars(position, this->buffer + STREAM_SINK_BUFFER_SIZE, row.id).ptr;
+    if (!schema.columns.empty())
+    {
+        *position++ = ' ';
+        position = schema.write_text(row, position);
+    }
+    *position++ = '\n';
+    this->size = position - this->buffer;
+}
+
+// the header goes into the buffer, which has room for every schema
+BinarySink::BinarySink(std::ostream &out, const Schema &schema) : StreamSink(out)
+{
+    uint32_t num_columns = schema.columns.size();
+    memcpy(this->buffer + EXPORT_MAGIC_OFFSET, EXPORT_MAGIC, EXPORT_MAGIC_SIZE);
+    memcpy(this->buffer + EXPORT_VERSION_OFFSET, &EXPORT_FORMAT_VERSION, EXPORT_VERSION_SIZE);
+    memcpy(this->buffer + EXPORT_NUM_COLUMNS_OFFSET, &num_columns, EXPORT_NUM_COLUMNS_SIZE);
+    this->size = EXPORT_HEADER_SIZE;
+    for (const Column &column : schema.columns)
+    {
+        char *entry = this->buffer + this->size;
+        memset(entry, 0, EXPORT_COLUMN_SIZE);
+        memcpy(entry + EXPORT_COLUMN_NAME_OFFSET, column.name.data(), std::min<size_t>(column.name.size(), COLUMN_NAME_SIZE));
+        memcpy(entry + EXPORT_COLUMN_TYPE_OFFSET, &column.type, EXPORT_COLUMN_TYPE_SIZE);
+        memcpy(entry + EXPORT_COLUMN_SIZE_OFFSET, &column.size, EXPORT_COLUMN_SIZE_SIZE);
+        this->size += EXPORT_COLUMN_SIZE;
+    }
+}
+
+void BinarySink::write_row(const Schema &schema, const Row &row)
+{
+    this->reserve(BINARY_SINK_MAX_ROW_SIZE);
+
+    char *position = this->buffer + this->size;
+    memcpy(position, &row.id, EXPORT_ID_SIZE);
+    position += EXPORT_ID_SIZE;
+    memcpy(position, row.record, row.record_size);
+    position += row.record_size;
+    this->size = position - this->buffer;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+#include "schema.hpp"
+
+constexpr size_t STREAM_SINK_BUFFER_SIZE = 64 << 10;
+// "<id> <values>\n" at its longest
+constexpr size_t TEXT_SINK_MAX_ROW_SIZE = 10 + 1 + ROW_MAX_TEXT_SIZE + 1;
+
+//
+// Binary Export Layout
+// A header followed by one record per row in id order, up to the
+// end of the file. The header lists the columns after the id, each
+// as its NUL padded name, its ColumnType and its size. A record is
+// the id, then the values as in the leaves, see Schema. Integers
+// are in host byte order, like the database file.
+//
+
+constexpr char EXPORT_MAGIC[] = "Mini-SQLite ROWS";
+constexpr uint32_t EXPORT_FORMAT_VERSION = 2;
+
+constexpr uint32_t EXPORT_MAGIC_SIZE = 16;
+constexpr uint32_t EXPORT_MAGIC_OFFSET = 0;
+constexpr uint32_t EXPORT_VERSION_SIZE = sizeof(uint32_t);
+constexpr uint32_t EXPORT_VERSION_OFFSET = EXPORT_MAGIC_OFFSET + EXPORT_MAGIC_SIZE;
+constexpr uint32_t EXPORT_NUM_COLUMNS_SIZE = sizeof(uint32_t);
+constexpr uint32_t EXPORT_NUM_COLUMNS_OFFSET = EXPORT_VERSION_OFFSET + EXPORT_VERSION_SIZE;
+constexpr uint32_t EXPORT_HEADER_SIZE = EXPORT_NUM_COLUMNS_OFFSET + EXPORT_NUM_COLUMNS_SIZE;
+
+constexpr uint32_t EXPORT_COLUMN_NAME_OFFSET = 0;
+constexpr uint32_t EXPORT_COLUMN_TYPE_SIZE = sizeof(uint32_t);
+constexpr uint32_t EXPORT_COLUMN_TYPE_OFFSET = EXPORT_COLUMN_NAME_OFFSET + COLUMN_NAME_SIZE;
+constexpr uint32_t EXPORT_COLUMN_SIZE_SIZE = sizeof(uint32_t);
+constexpr uint32_t EXPORT_COLUMN_SIZE_OFFSET = EXPORT_COLUMN_TYPE_OFFSET + EXPORT_COLUMN_TYPE_SIZE;
+constexpr uint32_t EXPORT_COLUMN_SIZE = EXPORT_COLUMN_SIZE_OFFSET + EXPORT_COLUMN_SIZE_SIZE;
+
+constexpr uint32_t EXPORT_ID_SIZE = sizeof(uint32_t);
+constexpr size_t BINARY_SINK_MAX_ROW_SIZE = EXPORT_ID_SIZE + ROW_MAX_RECORD_SIZE;
+
+static_assert(sizeof(EXPORT_MAGIC) - 1 == EXPORT_MAGIC_SIZE);
+// every column takes at least one byte of the record
+static_assert(EXPORT_HEADER_SIZE + ROW_MAX_RECORD_SIZE * EXPORT_COLUMN_SIZE <= STREAM_SINK_BUFFER_SIZE);
+
+enum class ExportFormat
+{
+    BINARY,
+    TEXT
+};
+
+// Receives the rows of a query result
+class ResultSink
+{
+public:
+    // functions
+
+    virtual ~ResultSink() = default;
+
+    // the row has the columns of schema
+    virtual void write_row(const Schema &schema, const Row &row) = 0;
+    // pass on everything written so far, called once a result is complete
+    virtual void flush() = 0;
+};
+
+//
+// Rows are encoded into a buffer which goes out to the stream in
+// one write whenever it fills up, so a result only costs one write
+// per STREAM_SINK_BUFFER_SIZE bytes.
+//
+class StreamSink : public ResultSink
+{
+public:
+    // functions
+
+    explicit StreamSink(std::ostream &out);
+    ~StreamSink() override;
+
+    StreamSink(const StreamSink &) = delete;
+    StreamSink &operator=(const StreamSink &) = delete;
+
+    void flush() override;
+
+protected:
+    // variables
+
+    std::ostream &out;
+    char *buffer;
+    size_t size;
+
+    // functions
+
+    // room for at least size more bytes at buffer + size
+    void reserve(size_t size);
+    void write_buffer();
+};
+
+// Formats rows as "<id> <values>" lines, integers in decimal and texts as they are
+class TextSink : public StreamSink
+{
+public:
+    // functions
+
+    explicit TextSink(std::ostream &out);
+
+    void write_row(const Schema &schema, const Row &row) override;
+};
+
+// Writes the binary export layout for rows of schema, the stream has to be opened in binary mode
+class BinarySink : public StreamSink
+{
+public:
+    // functions
+
+    BinarySink(std::ostream &out, const Schema &schema);
+
+    void write_row(const Schema &schema, const Row &row) override;
+};
@@ -1,47 +1,106 @@
-#include <iostream>
-#include <string>
+#include <stdexcept>
 
+#include "format.hpp"
 #include "table.hpp"
 
-Table::Table(const std::string &filename)
+Table::Table(Pager *pager, uint32_t catalog_index)
+    : pager(pager), catalog_index(catalog_index)
 {
-    this->root_page_num = 0;
-    this->pager = new Pager(filename);
-    
-    if (this->pager->get_page_num() == 0)
-    {
-        // New database file. Initialize page 0 as leaf node.
-        Node *root_node = this->pager->get_page(0);
-        root_node->set_root(true);
-    }
+    this->reload();
+}
+
+// the catalog page may move, so it is looked up through the header
+Catalog Table::get_catalog()
+{
+    uint32_t catalog_page_num = FileHeader(this->pager->get_page(HEADER_PAGE_NUM)).get_catalog_page();
+    return Catalog(this->pager->get_page(catalog_page_num));
 }
 
-Table::~Table()
+// the schema page may move as well, so it is looked up through the catalog
+SchemaPage Table::get_schema_page()
 {
-    for (uint32_t i = 0; i < pager->get_page_num(); i++)
+    uint32_t schema_page_num = this->get_catalog().get_schema_page(this->catalog_index);
+    return SchemaPage(this->pager->get_page(schema_page_num));
+}
+
+uint32_t Table::get_root()
+{
+    return this->root_page_num;
+}
+
+void Table::reload()
+{
+    Catalog catalog = this->get_catalog();
+    this->root_page_num = catalog.get_root_page(this->catalog_index);
+    double fill_factor = catalog.get_split_fill_factor(this->catalog_index);
+    this->split_fill_factor = fill_factor == 0 ? DEFAULT_SPLIT_FILL_FACTOR : fill_factor;
+    this->schema = this->get_schema_page().get_schema();
+    this->rightmost_leaf_page_num = 0;
+}
+
+const Schema &Table::get_schema()
+{
+    return this->schema;
+}
+
+uint32_t Table::get_index_root(uint32_t column)
+{
+    return this->get_schema_page().get_index_root_page(column);
+}
+
+void Table::set_index_root(uint32_t column, uint32_t page_num)
+{
+    this->get_schema_page().set_index_root_page(column, page_num);
+}
+
+//
+// The rightmost leaf receives every key larger than the current
+// max, so it is cached to let appends skip the tree descent.
+// It is found again by following right children when unknown.
+//
+uint32_t Table::get_rightmost_leaf()
+{
+    if (this->rightmost_leaf_page_num == 0)
     {
-        if (pager->get_page(i) == nullptr)
-        {
-            continue;
-        }
-        try
-        {
-            pager->flush(i);
-        }
-        catch(const std::runtime_error &e)
+        uint32_t page_num = this->root_page_num;
+        Node node = this->pager->get_page(page_num);
+        while (node.get_node_type() == NodeType::INTERNAL)
         {
-            std::cerr << e.what() << std::endl;
+            page_num = InternalNode(node).get_right_child();
+            node = this->pager->get_page(page_num);
         }
+        this->rightmost_leaf_page_num = page_num;
     }
-    delete pager;
+    return this->rightmost_leaf_page_num;
 }
 
-uint32_t Table::get_root()
+void Table::set_rightmost_leaf(uint32_t page_num)
 {
-    return this->root_page_num;
+    this->rightmost_leaf_page_num = page_num;
+}
+
+// must be called whenever leaves are moved or rebuilt
+void Table::invalidate_rightmost_leaf()
+{
+    this->rightmost_leaf_page_num = 0;
+}
+
+double Table::get_split_fill_factor()
+{
+    return this->split_fill_factor;
 }
 
-Node &Table::new_root(uint32_t page_num)
+void Table::set_split_fill_factor(double fill_factor)
+{
+    if (fill_factor < MIN_SPLIT_FILL_FACTOR || fill_factor > 1)
+    {
+        throw std::invalid_argument("Split fill factor must be between 0.5 and 1.");
+    }
+    this->get_catalog().set_split_fill_factor(this->catalog_index, fill_factor);
+    this->split_fill_factor = fill_factor;
+}
+
+InternalNode Table::new_root(uint32_t page_num)
 {
     // Handle splitting the root.
     // Old root copied to new page, becomes left child.
@@ -49,19 +108,59 @@ Node &Table::new_root(uint32_t page_num)
     // Re-initialize root page to contain the new root node.
     // New root node points to two children.
 
-    auto old_root = static_cast<LeafNode *>(this->pager->get_page(this->root_page_num));
-    uint32_t left_child_page_num = this->pager->get_unused_page_num();
-    auto left_child = static_cast<LeafNode *>(this->pager->get_page(left_child_page_num));
+    uint32_t left_child_page_num = this->pager->allocate_page();
+    PinGuard root_guard(*this->pager, this->root_page_num);
+    PinGuard left_child_guard(*this->pager, left_child_page_num);
 
     // Left child has data copied from old root
     this->pager->copy_node_data(left_child_page_num, root_page_num);
-    left_child->set_root(false);
+    Node left_child = this->pager->get_page(left_child_page_num);
+    left_child.set_root(false);
+    left_child.set_parent(this->root_page_num);
+
+    if (left_child.get_node_type() == NodeType::INTERNAL)
+    {
+        // children moved along with the old root
+        InternalNode left_internal = InternalNode(left_child);
+        for (uint32_t i = 0; i <= left_internal.get_num_keys(); i++)
+        {
+            this->pager->get_page(left_internal.get_child_at_cell(i)).set_parent(left_child_page_num);
+        }
+    }
+    uint32_t left_child_max_key = this->pager->get_node_max_key(left_child_page_num);
 
     // Root node is a new internal node with one key and two children
-    auto new_root = static_cast<InternalNode *>(this->pager->set_node_type(root_page_num, NodeType::INTERNAL));
-    new_root->set_root(true);
-    new_root->set_num_keys(1);
-    new_root->set_right_child(page_num);
-    new_root->set_cell(0, left_child->get_max_key(), left_child_page_num);
-    return *new_root;
-}
\ No newline at end of file
+    InternalNode new_root = InternalNode(this->pager->set_node_type(root_page_num, NodeType::INTERNAL));
+    new_root.set_root(true);
+    new_root.set_num_keys(1);
+    new_root.set_right_child(page_num);
+    new_root.set_cell(0, left_child_max_key, left_child_page_num);
+    new_root.set_row_count(0, this->pager->get_node_row_count(left_child_page_num));
+    new_root.set_row_count(1, this->pager->get_node_row_count(page_num));
+
+    this->pager->get_page(page_num).set_parent(this->root_page_num);
+    return new_root;
+}
+
+uint64_t Table::get_row_count()
+{
+    return this->pager->get_node_row_count(this->root_page_num);
+}
+
+//
+// Descend towards key adding up the rows of every child left of
+// the path, then the keys before it in the leaf.
+//
+uint64_t Table::count_rows_before(uint32_t key)
+{
+    uint64_t row_count = 0;
+    Node node = this->pager->get_page(this->root_page_num);
+    while (node.get_node_type() == NodeType::INTERNAL)
+    {
+        InternalNode internal = InternalNode(node);
+        uint32_t index = internal.find_child(key);
+        row_count += internal.get_row_count_before(index);
+        node = this->pager->get_page(internal.get_child_at_cell(index));
+    }
+    return row_count + LeafNode(node).find_cell(key);
+}
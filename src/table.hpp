@@ -1,7 +1,18 @@
 #pragma once
 
+#include "format.hpp"
 #include "pager.hpp"
 
+// Share of a node kept on the left when it splits because a key was
+// appended after the largest one, 0.5 splits evenly and 1.0 leaves
+// the left node full and starts a new one.
+constexpr double DEFAULT_SPLIT_FILL_FACTOR = 1.0;
+constexpr double MIN_SPLIT_FILL_FACTOR = 0.5;
+
+//
+// One table of a database, at an entry of the catalog. All tables
+// of a file share the pager of their Database, which owns it.
+//
 class Table
 {
 public:
@@ -11,17 +22,44 @@ public:
 
     // functions
 
-    explicit Table(const std::string &filename);
-    ~Table();
+    Table(Pager *pager, uint32_t catalog_index);
 
     Table(const Table &) = delete;
     Table &operator=(const Table &) = delete;
 
     uint32_t get_root();
-    Node &new_root(uint32_t page_num);
+    InternalNode new_root(uint32_t page_num);
+    // read the root page, the schema and the split fill factor from
+    // the catalog again and forget the rightmost leaf, after a
+    // rollback or after pages moved
+    void reload();
+
+    const Schema &get_schema();
+    uint32_t get_index_root(uint32_t column); // 0 if there is no index
+    void set_index_root(uint32_t column, uint32_t page_num);
+
+    // read from the row counts of the internal nodes on one path
+    uint64_t get_row_count();
+    uint64_t count_rows_before(uint32_t key); // rows with an id less than key
+
+    uint32_t get_rightmost_leaf();
+    void set_rightmost_leaf(uint32_t page_num);
+    void invalidate_rightmost_leaf();
+
+    double get_split_fill_factor();
+    void set_split_fill_factor(double fill_factor);
 
 private:
     // variables
 
+    uint32_t catalog_index;
     uint32_t root_page_num;
+    Schema schema;
+    uint32_t rightmost_leaf_page_num; // 0 if not known yet
+    double split_fill_factor;
+
+    // functions
+
+    Catalog get_catalog();
+    SchemaPage get_schema_page();
 };
\ No newline at end of file
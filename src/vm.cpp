@@ -1,132 +1,292 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
+#include "bulk.hpp"
+#include "delete.hpp"
+#include "format.hpp"
+#include "search.hpp"
 #include "vm.hpp"
 
 Cursor::Cursor(Table &table)
-    : table(table)
+    : table(table), pinned(false), uncounted_rows(0)
 {
     this->page_num = this->table.get_root();
     this->move_begin();
 }
 
+Cursor::Cursor(Table &table, uint32_t key)
+    : table(table), end_of_table(false), pinned(false), uncounted_rows(0)
+{
+    this->find(key);
+}
+
+Cursor::~Cursor()
+{
+    if (this->pinned)
+    {
+        this->table.pager->unpin(this->page_num);
+    }
+}
+
+// move the pin along with the cursor
+void Cursor::set_position(uint32_t page_num, uint32_t cell_num)
+{
+    if (!this->pinned || this->page_num != page_num)
+    {
+        this->table.pager->pin(page_num);
+        if (this->pinned)
+        {
+            this->table.pager->unpin(this->page_num);
+        }
+        this->pinned = true;
+    }
+    this->page_num = page_num;
+    this->cell_num = cell_num;
+}
+
 void Cursor::move_begin()
 {
     this->find(0);
-    auto node = static_cast<LeafNode *>(this->table.pager->get_page(this->page_num));
-    this->end_of_table = (node->get_num_cells() == 0);
+    LeafNode node = this->table.pager->get_leaf(this->page_num);
+    this->end_of_table = (node.get_num_cells() == 0);
 }
 
 void Cursor::advance()
 {
-    auto node = static_cast<LeafNode *>(this->table.pager->get_page(this->page_num));
+    LeafNode node = this->table.pager->get_leaf(this->page_num);
     this->cell_num += 1;
-    if (this->cell_num >= node->get_num_cells())
+    if (this->cell_num >= node.get_num_cells())
     {
-        if (node->get_next_leaf() == 0)
+        if (node.get_next_leaf() == 0)
         {
             // This was rightmost leaf
             this->end_of_table = true;
         }
         else
         {
-            this->page_num = node->get_next_leaf();
-            this->cell_num = 0;
+            this->set_position(node.get_next_leaf(), 0);
         }
     }
 }
 
-void Cursor::insert(uint32_t key, const Row &value)
+//
+// Same as find() for a key after the current position. Keys up to
+// the largest one of the current leaf are searched in that leaf,
+// as are all larger keys if it is the rightmost leaf. Any other key
+// may belong to a later leaf and is found from the root.
+//
+void Cursor::find_forward(uint32_t key)
+{
+    LeafNode node = this->table.pager->get_leaf(this->page_num);
+    uint32_t num_cells = node.get_num_cells();
+    if (num_cells == 0 || key > node.get_key(num_cells - 1))
+    {
+        if (node.get_next_leaf() == 0)
+        {
+            this->cell_num = num_cells;
+        }
+        else
+        {
+            this->find(key);
+        }
+        return;
+    }
+
+    this->cell_num = node.find_cell(key, std::min(this->cell_num, num_cells));
+}
+
+//
+// Set the cursor to the row at the given rank in id order, counted
+// from 0, by descending along the row counts. A rank past the last
+// row ends past the last cell of the rightmost leaf.
+//
+void Cursor::find_rank(uint64_t rank)
 {
-    auto node = static_cast<LeafNode *>(this->table.pager->get_page(this->page_num));
+    uint32_t page_num = this->table.get_root();
+    Node node = this->table.pager->get_page(page_num);
+    while (node.get_node_type() == NodeType::INTERNAL)
+    {
+        InternalNode internal = InternalNode(node);
+        page_num = internal.get_child_at_cell(internal.find_child_by_rank(rank));
+        node = this->table.pager->get_page(page_num);
+    }
+    uint32_t num_cells = LeafNode(node).get_num_cells();
+    this->set_position(page_num, std::min<uint64_t>(rank, num_cells));
+}
 
-    uint32_t num_cells = node->get_num_cells();
-    if (num_cells >= LEAF_NODE_MAX_CELLS)
+//
+// find() leaves the cursor past the last cell of a leaf when the
+// key is larger than every key in it, that is the insert position.
+// Readers want the first row after it, at the start of the next leaf.
+//
+void Cursor::skip_leaf_end()
+{
+    LeafNode node = this->table.pager->get_leaf(this->page_num);
+    if (this->cell_num < node.get_num_cells())
+    {
+        return;
+    }
+    if (node.get_next_leaf() == 0)
+    {
+        this->end_of_table = true;
+    }
+    else
+    {
+        this->set_position(node.get_next_leaf(), 0);
+    }
+}
+
+//
+// Rows going into the same leaf one after another are counted on its
+// path once they are done, so a batch of neighbouring ids costs one
+// walk down the tree per leaf rather than per row. A split needs the
+// counts up to date, the row that causes it is counted right away.
+//
+void Cursor::insert(uint32_t key, const Row &value)
+{
+    if (this->uncounted_rows > 0 && this->uncounted_page_num != this->page_num)
+    {
+        this->count_inserted_rows();
+    }
+    LeafNode node = this->table.pager->get_leaf(this->page_num);
+    if (!node.has_room(LeafNode::get_cell_size(value)))
     {
         // Node full
+        this->count_inserted_rows();
+        this->count_insert(key, 1);
         this->split_and_insert(key, value);
         return;
     }
+    node.insert_cell(this->cell_num, key, value);
+    this->uncounted_rows++;
+    this->uncounted_page_num = this->page_num;
+    this->uncounted_key = key;
+}
 
-    if (this->cell_num < num_cells)
+void Cursor::count_inserted_rows()
+{
+    if (this->uncounted_rows > 0)
     {
-        // Make room for new cell
-        for (uint32_t i = num_cells; i > this->cell_num; i--)
-        {
-            node->copy_cell(i, i - 1);
-        }
+        this->count_insert(this->uncounted_key, this->uncounted_rows);
+        this->uncounted_rows = 0;
     }
-
-    node->set_num_cells(num_cells + 1);
-    LeafNodeCell *cell = node->get_cell(this->cell_num);
-    cell->set_key(key);
-    cell->set_value(value);
 }
 
-constexpr uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-constexpr uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+//
+// Add rows to every internal node on the path find() takes to key,
+// before the leaf changes if it is about to split. Splits below
+// recount the children they touch from the children.
+//
+void Cursor::count_insert(uint32_t key, uint32_t row_count)
+{
+    Node node = this->table.pager->get_page(this->table.get_root());
+    while (node.get_node_type() == NodeType::INTERNAL)
+    {
+        InternalNode internal = InternalNode(node);
+        uint32_t index = internal.find_child(key);
+        internal.set_row_count(index, internal.get_row_count(index) + row_count);
+        node = this->table.pager->get_page(internal.get_child_at_cell(index));
+    }
+}
 
 void Cursor::split_and_insert(uint32_t key, const Row &value)
 {
-    // Create a new node and move half the cells over.
+    // Create a new node and move about half the bytes over.
     // Insert the new value in one of the two nodes.
     // Update parent or create a new parent.
 
-    auto old_node = static_cast<LeafNode *>(this->table.pager->get_page(this->page_num));
-    uint32_t old_max = old_node->get_max_key();
-    uint32_t new_page_num = this->table.pager->get_unused_page_num();
-    auto new_node = static_cast<LeafNode *>(this->table.pager->get_page(new_page_num));
-    new_node->set_parent(old_node->get_parent());
+    LeafNode old_node = this->table.pager->get_leaf(this->page_num);
+    uint32_t old_max = old_node.get_max_key();
+    uint32_t new_page_num = this->table.pager->allocate_page();
+    PinGuard new_node_guard(*this->table.pager, new_page_num);
+    LeafNode new_node = this->table.pager->get_leaf(new_page_num);
+    new_node.set_parent(old_node.get_parent());
 
-    // All existing keys plus new key should be divided
-    // evenly between old (left) and new (right) nodes.
-    // Starting from the right, move each key to correct position.
+    // The cells are rebuilt from a copy of the old node
+    char old_data[PAGE_SIZE];
+    memcpy(old_data, old_node.get_data(), PAGE_SIZE);
+    bool old_dirty = false;
+    LeafNode old_cells(old_data, &old_dirty);
+    uint32_t num_cells = old_cells.get_num_cells();
+    uint32_t new_cell_size = LeafNode::get_cell_size(value);
+    auto cell_size = [&](uint32_t i)
+    {
+        if (i == this->cell_num)
+        {
+            return new_cell_size;
+        }
+        return old_cells.get_cell_size(i > this->cell_num ? i - 1 : i);
+    };
 
-    for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; i--)
+    // All existing cells plus the new one should be divided
+    // evenly by size between old (left) and new (right) nodes,
+    // unless the key is appended to the rightmost leaf.
+    // Then the left node keeps up to the split fill factor,
+    // as it will never receive another key.
+    uint32_t total_size = old_cells.get_used_space() + new_cell_size;
+    uint32_t left_count = 0;
+    uint32_t left_size = 0;
+    while (left_count < num_cells && 2 * left_size + cell_size(left_count) <= total_size)
+    {
+        left_size += cell_size(left_count++);
+    }
+    left_count = std::max<uint32_t>(left_count, 1);
+    if (this->cell_num == num_cells && old_node.get_next_leaf() == 0)
     {
-        LeafNode *destination_node;
-        if (i >= LEAF_NODE_LEFT_SPLIT_COUNT)
+        uint32_t fill_size = LEAF_NODE_SPACE_FOR_CELLS * this->table.get_split_fill_factor();
+        left_size = 0;
+        for (uint32_t i = 0; i < left_count; i++)
         {
-            destination_node = new_node;
+            left_size += cell_size(i);
         }
-        else
+        while (left_count < num_cells && left_size + cell_size(left_count) <= fill_size)
         {
-            destination_node = old_node;
+            left_size += cell_size(left_count++);
         }
+    }
 
+    if (old_node.get_next_leaf() == 0)
+    {
+        this->table.set_rightmost_leaf(new_page_num);
+    }
+
+    old_node.clear();
+    for (uint32_t i = 0; i <= num_cells; i++)
+    {
+        LeafNode destination_node = i < left_count ? old_node : new_node;
+        uint32_t destination_cell_num = destination_node.get_num_cells();
         if (i == this->cell_num)
         {
-            LeafNodeCell *destination = destination_node->get_cell(i % LEAF_NODE_LEFT_SPLIT_COUNT);
-            destination->set_key(key);
-            destination->set_value(value);
+            destination_node.insert_cell(destination_cell_num, key, value);
         }
         else
         {
-            this->table.pager->copy_node_cell(
-                destination_node, i % LEAF_NODE_LEFT_SPLIT_COUNT,
-                old_node, i > this->cell_num ? i - 1 : i);
+            destination_node.insert_cell(destination_cell_num, old_cells, i > this->cell_num ? i - 1 : i);
         }
     }
 
-    // Update cell count on both leaf nodes
-    old_node->set_num_cells(LEAF_NODE_LEFT_SPLIT_COUNT);
-    new_node->set_num_cells(LEAF_NODE_RIGHT_SPLIT_COUNT);
-
     // Update next leaf
-    new_node->set_next_leaf_num(old_node->get_next_leaf());
-    old_node->set_next_leaf_num(new_page_num);
+    new_node.set_next_leaf_num(old_node.get_next_leaf());
+    old_node.set_next_leaf_num(new_page_num);
 
     // Update root node
-    if (old_node->is_root())
+    if (old_node.is_root())
     {
         this->table.new_root(new_page_num);
     }
     else
     {
-        uint32_t parent_page_num = old_node->get_parent();
-        uint32_t new_max = old_node->get_max_key();
-        auto parent = static_cast<InternalNode *>(this->table.pager->get_page(parent_page_num));
+        uint32_t parent_page_num = old_node.get_parent();
+        uint32_t new_max = old_node.get_max_key();
+        InternalNode parent = this->table.pager->get_internal(parent_page_num);
 
-        parent->update_key(old_max, new_max);
+        parent.update_key(old_max, new_max);
         this->insert_internal_node(parent_page_num, new_page_num);
     }
 }
@@ -137,37 +297,145 @@ void Cursor::insert_internal_node(uint32_t parent_page_num, uint32_t child_page_
     // Add a new child/key pair to parent that corresponds to child
     //
 
-    auto parent = static_cast<InternalNode *>(this->table.pager->get_page(parent_page_num));
-    auto child = static_cast<LeafNode *>(this->table.pager->get_page(child_page_num));
-    uint32_t child_max_key = child->get_max_key();
-    uint32_t index = parent->find_child(child_max_key);
-
-    uint32_t original_num_keys = parent->get_num_keys();
-    parent->set_num_keys(original_num_keys + 1);
+    PinGuard parent_guard(*this->table.pager, parent_page_num);
+    InternalNode parent = this->table.pager->get_internal(parent_page_num);
 
+    uint32_t original_num_keys = parent.get_num_keys();
     if (original_num_keys >= INTERNAL_NODE_MAX_CELLS)
     {
-        std::cout << "Need to implement splitting internal node" << std::endl;
-        std::exit(EXIT_FAILURE);
+        this->split_internal_node(parent_page_num, child_page_num);
+        return;
     }
 
-    uint32_t right_child_page_num = parent->get_right_child();
-    auto right_child = static_cast<LeafNode *>(this->table.pager->get_page(right_child_page_num));
+    uint32_t child_max_key = this->table.pager->get_node_max_key(child_page_num);
+    uint32_t index = parent.find_child(child_max_key);
+
+    uint32_t right_child_page_num = parent.get_right_child();
+    uint32_t right_child_max_key = this->table.pager->get_node_max_key(right_child_page_num);
 
-    if (child_max_key > right_child->get_max_key())
+    parent.set_num_keys(original_num_keys + 1);
+
+    if (child_max_key > right_child_max_key)
     {
-        // Replace right child
-        parent->set_cell(original_num_keys, right_child->get_max_key(), right_child_page_num);
-        parent->set_right_child(child_page_num);
+        // Replace right child, its row count stays in place
+        parent.set_cell(original_num_keys, right_child_max_key, right_child_page_num);
+        parent.set_right_child(child_page_num);
+        index = original_num_keys + 1;
     }
     else
     {
-        // Make room for the new cell
+        // Make room for the new cell, the right child's row count first
+        parent.set_row_count(original_num_keys + 1, parent.get_row_count(original_num_keys));
         for (uint32_t i = original_num_keys; i > index; i--)
         {
-            parent->copy_cell(i, i - 1);
+            parent.copy_cell(i, i - 1);
         }
-        parent->set_cell(index, child_max_key, child_page_num);
+        parent.set_cell(index, child_max_key, child_page_num);
+    }
+
+    // The child was split off its left sibling, both are counted again
+    parent.set_row_count(index, this->table.pager->get_node_row_count(child_page_num));
+    if (index > 0)
+    {
+        uint32_t sibling_page_num = parent.get_child_at_cell(index - 1);
+        parent.set_row_count(index - 1, this->table.pager->get_node_row_count(sibling_page_num));
+    }
+}
+
+//
+// Split a full internal node while adding a new child to it.
+// The old node keeps the lower half of the children, a new node
+// takes the upper half, then the new node is added to the parent,
+// which may split in turn up to the root.
+//
+void Cursor::split_internal_node(uint32_t page_num, uint32_t child_page_num)
+{
+    Pager &pager = *this->table.pager;
+
+    PinGuard old_node_guard(pager, page_num);
+    InternalNode old_node = pager.get_internal(page_num);
+    uint32_t old_max = pager.get_node_max_key(page_num);
+    uint32_t child_max_key = pager.get_node_max_key(child_page_num);
+
+    // Gather all children with their keys in order, the new one included.
+    // The key of the rightmost child is never stored. The new child was
+    // split off the one before it, both are counted again.
+
+    uint32_t num_keys = old_node.get_num_keys();
+    std::vector<Child> children;
+    children.reserve(num_keys + 2);
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        children.push_back({old_node.get_key_at_cell(i), old_node.get_child_at_cell(i), old_node.get_row_count(i)});
+    }
+    children.push_back({old_max, old_node.get_right_child(), old_node.get_row_count(num_keys)});
+
+    auto position = std::lower_bound(children.begin(), children.end(), child_max_key,
+                                     [](const Child &child, uint32_t key)
+                                     { return child.max_key < key; });
+    position = children.insert(position, {child_max_key, child_page_num, (uint32_t)pager.get_node_row_count(child_page_num)});
+    if (position != children.begin())
+    {
+        position[-1].row_count = pager.get_node_row_count(position[-1].page_num);
+    }
+
+    uint32_t new_page_num = pager.allocate_page();
+    PinGuard new_node_guard(pager, new_page_num);
+    InternalNode new_node = InternalNode(pager.set_node_type(new_page_num, NodeType::INTERNAL));
+
+    // Left half stays in the old node. A child appended past the
+    // old max only happens on the right spine, so the left node is
+    // filled up to the split fill factor, leaving the new node at
+    // least two children.
+    uint32_t left_count = children.size() / 2;
+    if (child_max_key > old_max)
+    {
+        uint32_t fill_count = (children.size() - 1) * this->table.get_split_fill_factor();
+        left_count = std::clamp<uint32_t>(fill_count, left_count, children.size() - 2);
+    }
+    old_node.set_num_keys(left_count - 1);
+    for (uint32_t i = 0; i + 1 < left_count; i++)
+    {
+        old_node.set_cell(i, children[i].max_key, children[i].page_num);
+    }
+    old_node.set_right_child(children[left_count - 1].page_num);
+    for (uint32_t i = 0; i < left_count; i++)
+    {
+        old_node.set_row_count(i, children[i].row_count);
+    }
+
+    // Right half moves to the new node
+    uint32_t right_count = children.size() - left_count;
+    new_node.set_num_keys(right_count - 1);
+    for (uint32_t i = 0; i + 1 < right_count; i++)
+    {
+        new_node.set_cell(i, children[left_count + i].max_key, children[left_count + i].page_num);
+    }
+    new_node.set_right_child(children.back().page_num);
+    for (uint32_t i = 0; i < right_count; i++)
+    {
+        new_node.set_row_count(i, children[left_count + i].row_count);
+    }
+
+    // Children keep track of their parent
+    for (uint32_t i = 0; i < children.size(); i++)
+    {
+        pager.get_page(children[i].page_num).set_parent(i < left_count ? page_num : new_page_num);
+    }
+
+    if (old_node.is_root())
+    {
+        this->table.new_root(new_page_num);
+    }
+    else
+    {
+        uint32_t parent_page_num = old_node.get_parent();
+        new_node.set_parent(parent_page_num);
+
+        // the subtree max before the split is the max of its last child
+        InternalNode parent = pager.get_internal(parent_page_num);
+        parent.update_key(children.back().max_key, children[left_count - 1].max_key);
+        this->insert_internal_node(parent_page_num, new_page_num);
     }
 }
 
@@ -178,10 +446,20 @@ void Cursor::insert_internal_node(uint32_t parent_page_num, uint32_t child_page_
 //
 void Cursor::find(uint32_t key)
 {
+    // Keys past the current max go to the end of the rightmost leaf
+    uint32_t rightmost_page_num = this->table.get_rightmost_leaf();
+    LeafNode rightmost = this->table.pager->get_leaf(rightmost_page_num);
+    uint32_t num_cells = rightmost.get_num_cells();
+    if (num_cells > 0 && key > rightmost.get_key(num_cells - 1))
+    {
+        this->set_position(rightmost_page_num, num_cells);
+        return;
+    }
+
     uint32_t root_page_num = this->table.get_root();
-    Node *root_node = this->table.pager->get_page(root_page_num);
+    Node root_node = this->table.pager->get_page(root_page_num);
 
-    if (root_node->get_node_type() == NodeType::LEAF)
+    if (root_node.get_node_type() == NodeType::LEAF)
     {
         this->leaf_node_find(root_page_num, key);
     }
@@ -193,45 +471,19 @@ void Cursor::find(uint32_t key)
 
 void Cursor::leaf_node_find(uint32_t page_num, uint32_t key)
 {
-    auto node = static_cast<LeafNode *>(this->table.pager->get_page(page_num));
-    uint32_t num_cells = node->get_num_cells();
-
-    // Binary search
-    uint32_t min_index = 0;
-    uint32_t one_past_max_index = num_cells;
-    while (one_past_max_index != min_index)
-    {
-        uint32_t index = (min_index + one_past_max_index) / 2;
-        uint32_t key_at_index = node->get_cell(index)->get_key();
-        if (key == key_at_index)
-        {
-            this->page_num = page_num;
-            this->cell_num = index;
-            return;
-        }
-        if (key < key_at_index)
-        {
-            one_past_max_index = index;
-        }
-        else
-        {
-            min_index = index + 1;
-        }
-    }
-
-    this->page_num = page_num;
-    this->cell_num = min_index;
+    LeafNode node = this->table.pager->get_leaf(page_num);
+    this->set_position(page_num, node.find_cell(key));
 }
 
 void Cursor::internal_node_find(uint32_t page_num, uint32_t key)
 {
-    auto node = static_cast<InternalNode *>(this->table.pager->get_page(page_num));
+    InternalNode node = this->table.pager->get_internal(page_num);
 
-    uint32_t child_index = node->find_child(key);
-    uint32_t child_num = node->get_child_at_cell(child_index);
-    Node *child = this->table.pager->get_page(child_num);
+    uint32_t child_index = node.find_child(key);
+    uint32_t child_num = node.get_child_at_cell(child_index);
+    Node child = this->table.pager->get_page(child_num);
 
-    switch (child->get_node_type())
+    switch (child.get_node_type())
     {
     case NodeType::LEAF:
         this->leaf_node_find(child_num, key);
@@ -239,6 +491,9 @@ void Cursor::internal_node_find(uint32_t page_num, uint32_t key)
     case NodeType::INTERNAL:
         this->internal_node_find(child_num, key);
         break;
+    case NodeType::INDEX_LEAF:
+    case NodeType::INDEX_INTERNAL:
+        throw std::runtime_error("Table corrupted. Index page in the table tree.");
     }
 }
 
@@ -257,7 +512,7 @@ bool Cursor::is_end_of_table()
     return this->end_of_table;
 }
 
-VirtualMachine::VirtualMachine(Table *table) : table(table) {}
+VirtualMachine::VirtualMachine(Database *db, ResultSink *sink) : db(db), table(db->get_table()), sink(sink) {}
 
 ExecuteResult VirtualMachine::execute(const Statement &statement)
 {
@@ -269,18 +524,48 @@ ExecuteResult VirtualMachine::execute(const Statement &statement)
         return this->print_tree();
     case StatementType::CONSTANTS:
         return this->print_constants();
+    case StatementType::STATS:
+        return this->print_stats();
+    case StatementType::TABLES:
+        return this->print_tables();
+    case StatementType::IMPORT:
+        return this->execute_import(statement);
+    case StatementType::EXPORT:
+        return this->execute_export(statement);
+    case StatementType::SPLIT:
+        return this->execute_split(statement);
+    case StatementType::VACUUM:
+        return this->execute_vacuum();
     case StatementType::INSERT:
         return this->execute_insert(statement);
     case StatementType::SELECT:
         return this->execute_select(statement);
+    case StatementType::DELETE:
+        return this->execute_delete(statement);
+    case StatementType::CREATE_INDEX:
+        return this->execute_create_index(statement);
+    case StatementType::CREATE_TABLE:
+        return this->execute_create_table(statement);
+    case StatementType::USE:
+        return this->execute_use(statement);
+    case StatementType::BEGIN:
+        return this->execute_begin();
+    case StatementType::COMMIT:
+        return this->execute_commit();
+    case StatementType::ROLLBACK:
+        return this->execute_rollback();
     }
 }
 
+const Schema &VirtualMachine::get_schema()
+{
+    return this->table->get_schema();
+}
+
 ExecuteResult VirtualMachine::print_tree()
 {
     std::cout << "Tree:" << std::endl;
-    auto node = static_cast<InternalNode *>(this->table->pager->get_page(0));
-    this->table->pager->print_tree(0, 0);
+    this->table->pager->print_tree(this->table->get_root(), 0, this->table->get_schema());
     return ExecuteResult::SUCCESS;
 }
 
@@ -288,7 +573,7 @@ ExecuteResult VirtualMachine::print_constants()
 {
     std::cout << "Constants:" << std::endl;
 
-    std::cout << "ROW_SIZE: " << ROW_SIZE << std::endl;
+    std::cout << "FILE_FORMAT_VERSION: " << FILE_FORMAT_VERSION << std::endl;
 
     std::cout << "COMMON_NODE_HEADER_SIZE: " << COMMON_NODE_HEADER_SIZE << std::endl;
 
@@ -298,42 +583,566 @@ ExecuteResult VirtualMachine::print_constants()
     std::cout << "INTERNAL_NODE_MAX_CELLS: " << INTERNAL_NODE_MAX_CELLS << std::endl;
 
     std::cout << "LEAF_NODE_HEADER_SIZE: " << LEAF_NODE_HEADER_SIZE << std::endl;
-    std::cout << "LEAF_NODE_CELL_SIZE: " << LEAF_NODE_CELL_SIZE << std::endl;
+    std::cout << "LEAF_NODE_SLOT_SIZE: " << LEAF_NODE_SLOT_SIZE << std::endl;
+    std::cout << "LEAF_NODE_MAX_RECORD_SIZE: " << LEAF_NODE_MAX_RECORD_SIZE << std::endl;
     std::cout << "LEAF_NODE_SPACE_FOR_CELLS: " << LEAF_NODE_SPACE_FOR_CELLS << std::endl;
-    std::cout << "LEAF_NODE_MAX_CELLS: " << LEAF_NODE_MAX_CELLS << std::endl;
+
+    std::cout << "INDEX_LEAF_NODE_MAX_KEYS: " << INDEX_LEAF_NODE_MAX_KEYS << std::endl;
+    std::cout << "INDEX_INTERNAL_NODE_MAX_KEYS: " << INDEX_INTERNAL_NODE_MAX_KEYS << std::endl;
+
+    std::cout << "CATALOG_ENTRY_SIZE: " << CATALOG_ENTRY_SIZE << std::endl;
+    std::cout << "CATALOG_MAX_TABLES: " << CATALOG_MAX_TABLES << std::endl;
+    std::cout << "SCHEMA_MAX_COLUMNS: " << SCHEMA_MAX_COLUMNS << std::endl;
+
+    std::cout << "KEY_SEARCH: " << get_search_implementation() << std::endl;
 
     return ExecuteResult::SUCCESS;
 }
 
-ExecuteResult VirtualMachine::execute_insert(const Statement &statement)
+ExecuteResult VirtualMachine::print_stats()
+{
+    const PagerStats &stats = this->table->pager->get_stats();
+
+    if (this->table->pager->get_mode() == PagerMode::MMAP)
+    {
+        std::cout << "Memory mapped:" << std::endl;
+    }
+    else
+    {
+        std::cout << "Buffer pool:" << std::endl;
+        std::cout << "frames: " << this->table->pager->get_frame_num() << std::endl;
+    }
+    std::cout << "pages: " << this->table->pager->get_page_num() << std::endl;
+    std::cout << "free pages: " << this->table->pager->get_free_page_num() << std::endl;
+    std::cout << "hits: " << stats.hits << std::endl;
+    std::cout << "misses: " << stats.misses << std::endl;
+    std::cout << "evictions: " << stats.evictions << std::endl;
+    std::cout << "write backs: " << stats.write_backs << std::endl;
+    if (this->table->pager->has_wal())
+    {
+        std::cout << "wal records: " << stats.wal_records << std::endl;
+        std::cout << "wal bytes: " << stats.wal_bytes << std::endl;
+        std::cout << "wal commits: " << stats.wal_commits << std::endl;
+        std::cout << "wal syncs: " << stats.wal_syncs << std::endl;
+        std::cout << "checkpoints: " << stats.checkpoints << std::endl;
+    }
+
+    return ExecuteResult::SUCCESS;
+}
+
+// every table in the catalog with its number of rows
+ExecuteResult VirtualMachine::print_tables()
+{
+    std::cout << "Tables:" << std::endl;
+    for (const std::string &table_name : this->db->get_table_names())
+    {
+        std::cout << table_name << ": " << this->db->get_table(table_name)->get_row_count() << " rows" << std::endl;
+    }
+    return ExecuteResult::SUCCESS;
+}
+
+//
+// Bulk load rows from a file into an empty table,
+// one "<id> <value>..." per line in ascending id order.
+//
+ExecuteResult VirtualMachine::execute_import(const Statement &statement)
+{
+    std::ifstream file(statement.filename);
+    if (!file.is_open())
+    {
+        std::cout << "Unable to open file: " << statement.filename << std::endl;
+        return ExecuteResult::IMPORT_FAILED;
+    }
+
+    // a failed import is undone as a whole, unless a transaction is open
+    bool own_transaction = this->table->pager->has_wal() && !this->table->pager->in_transaction();
+    if (own_transaction)
+    {
+        this->table->pager->begin();
+    }
+
+    try
+    {
+        BulkLoader loader(*this->table, statement.fill_factor);
+        CommandProcessor processor;
+        Row row;
+        std::string line;
+        uint64_t line_num = 0;
+        while (std::getline(file, line))
+        {
+            line_num++;
+            if (line.empty())
+            {
+                continue;
+            }
+            if (processor.parse_row(line, row, this->table->get_schema()) != ParseResult::SUCCESS)
+            {
+                this->rollback_statement(own_transaction);
+                std::cout << "Could not parse row at line " << line_num << "." << std::endl;
+                return ExecuteResult::IMPORT_FAILED;
+            }
+            if (!loader.add(row))
+            {
+                this->rollback_statement(own_transaction);
+                std::cout << "Ids must be unique and ascending, at line " << line_num << "." << std::endl;
+                return ExecuteResult::IMPORT_FAILED;
+            }
+        }
+        loader.finish();
+        for (const std::unique_ptr<Index> &index : this->open_indexes())
+        {
+            index->add_table_rows();
+        }
+        if (own_transaction)
+        {
+            this->table->pager->commit();
+        }
+        std::cout << "Imported " << loader.get_row_num() << " rows." << std::endl;
+    }
+    catch (const std::invalid_argument &e)
+    {
+        this->rollback_statement(own_transaction);
+        std::cout << e.what() << std::endl;
+        return ExecuteResult::IMPORT_FAILED;
+    }
+    catch (const std::out_of_range &e)
+    {
+        this->rollback_statement(own_transaction);
+        std::cout << e.what() << std::endl;
+        return ExecuteResult::IMPORT_FAILED;
+    }
+    catch (const std::runtime_error &e)
+    {
+        this->rollback_statement(own_transaction);
+        std::cout << e.what() << std::endl;
+        return ExecuteResult::IMPORT_FAILED;
+    }
+
+    return ExecuteResult::SUCCESS;
+}
+
+ExecuteResult VirtualMachine::execute_export(const Statement &statement)
+{
+    std::ios::openmode mode = std::ios::out | std::ios::trunc;
+    if (statement.format == ExportFormat::BINARY)
+    {
+        mode |= std::ios::binary;
+    }
+    std::ofstream file(statement.filename, mode);
+    if (!file.is_open())
+    {
+        std::cout << "Unable to open file: " << statement.filename << std::endl;
+        return ExecuteResult::EXPORT_FAILED;
+    }
+
+    uint64_t row_num;
+    if (statement.format == ExportFormat::BINARY)
+    {
+        BinarySink sink(file, this->table->get_schema());
+        row_num = this->write_rows(statement, sink);
+    }
+    else
+    {
+        TextSink sink(file);
+        row_num = this->write_rows(statement, sink);
+    }
+    file.close();
+    if (file.fail())
+    {
+        std::cout << "Unable to write file: " << statement.filename << std::endl;
+        return ExecuteResult::EXPORT_FAILED;
+    }
+
+    std::cout << "Exported " << row_num << " rows." << std::endl;
+    return ExecuteResult::SUCCESS;
+}
+
+// set the share of a node kept on the left by append splits
+ExecuteResult VirtualMachine::execute_split(const Statement &statement)
 {
-    auto cursor = std::make_unique<Cursor>(Cursor(*this->table));
-    uint32_t key_to_insert = statement.row_to_insert.id;
-    cursor->find(key_to_insert);
+    this->table->set_split_fill_factor(statement.fill_factor);
+    this->autocommit();
+    return ExecuteResult::SUCCESS;
+}
 
-    auto page = static_cast<LeafNode *>(cursor->table.pager->get_page(cursor->get_page_num()));
-    if (cursor->get_cell_num() < page->get_num_cells())
+ExecuteResult VirtualMachine::execute_vacuum()
+{
+    if (this->table->pager->in_transaction())
     {
-        uint32_t key_at_index = page->get_cell(cursor->get_cell_num())->get_key();
-        if (key_at_index == key_to_insert)
+        std::cout << "Cannot vacuum inside a transaction." << std::endl;
+        return ExecuteResult::TRANSACTION_FAILED;
+    }
+    uint32_t released = this->db->vacuum();
+    std::cout << "Released " << released << " pages." << std::endl;
+    return ExecuteResult::SUCCESS;
+}
+
+//
+// Rows come sorted by id, so one cursor moves forward through the
+// leaves and only descends from the root again after a split or
+// for a key past its leaf. All ids are checked before the first
+// row is inserted, so a duplicate key leaves the table unchanged.
+//
+ExecuteResult VirtualMachine::execute_insert(const Statement &statement)
+{
+    const std::vector<Row> &rows = statement.rows_to_insert;
+    auto cursor = std::make_unique<Cursor>(*this->table, rows[0].id);
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (i > 0)
+        {
+            if (rows[i].id == rows[i - 1].id)
+            {
+                return ExecuteResult::DUPLICATE_KEY;
+            }
+            cursor->find_forward(rows[i].id);
+        }
+        LeafNode page = this->table->pager->get_leaf(cursor->get_page_num());
+        if (cursor->get_cell_num() < page.get_num_cells() && page.get_key(cursor->get_cell_num()) == rows[i].id)
         {
             return ExecuteResult::DUPLICATE_KEY;
         }
     }
 
-    cursor->insert(key_to_insert, statement.row_to_insert);
+    if (rows.size() > 1)
+    {
+        cursor->find(rows[0].id);
+    }
+    bool split = false;
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (i > 0 && split)
+        {
+            cursor->find(rows[i].id);
+        }
+        else if (i > 0)
+        {
+            cursor->find_forward(rows[i].id);
+        }
+
+        // the cursor does not follow the row into a new leaf
+        LeafNode page = this->table->pager->get_leaf(cursor->get_page_num());
+        split = !page.has_room(LeafNode::get_cell_size(rows[i]));
+        cursor->insert(rows[i].id, rows[i]);
+    }
+    cursor->count_inserted_rows();
+    cursor.reset();
 
+    for (const std::unique_ptr<Index> &index : this->open_indexes())
+    {
+        for (const Row &row : rows)
+        {
+            index->insert(row);
+        }
+    }
+
+    this->autocommit();
     return ExecuteResult::SUCCESS;
 }
 
 ExecuteResult VirtualMachine::execute_select(const Statement &statement)
 {
-    auto cursor = std::make_unique<Cursor>(Cursor(*this->table));
-    while (!cursor->is_end_of_table())
+    if (statement.count_rows)
+    {
+        uint64_t row_num = statement.match_value ? this->write_matching_rows(statement, nullptr) : this->count_rows(statement);
+        std::cout << row_num << std::endl;
+        return ExecuteResult::SUCCESS;
+    }
+    if (statement.match_value)
+    {
+        this->write_matching_rows(statement, this->sink);
+        return ExecuteResult::SUCCESS;
+    }
+    this->write_rows(statement, *this->sink);
+    return ExecuteResult::SUCCESS;
+}
+
+// the rows leave the indexes before the table
+ExecuteResult VirtualMachine::execute_delete(const Statement &statement)
+{
+    std::vector<std::unique_ptr<Index>> indexes = this->open_indexes();
+    if (!indexes.empty() && statement.low_id <= statement.high_id)
+    {
+        std::vector<Row> rows;
+        Cursor cursor(*this->table, statement.low_id);
+        cursor.skip_leaf_end();
+        while (!cursor.is_end_of_table())
+        {
+            LeafNode page = this->table->pager->get_leaf(cursor.get_page_num());
+            if (page.get_key(cursor.get_cell_num()) > statement.high_id)
+            {
+                break;
+            }
+            page.get_row(cursor.get_cell_num(), rows.emplace_back());
+            cursor.advance();
+        }
+        for (const std::unique_ptr<Index> &index : indexes)
+        {
+            for (const Row &row : rows)
+            {
+                index->erase(row);
+            }
+        }
+    }
+
+    Deleter deleter(*this->table);
+    uint64_t row_num = deleter.erase(statement.low_id, statement.high_id);
+    this->autocommit();
+
+    std::cout << "Deleted " << row_num << " rows." << std::endl;
+    return ExecuteResult::SUCCESS;
+}
+
+ExecuteResult VirtualMachine::execute_create_index(const Statement &statement)
+{
+    Index index(*this->table, statement.column);
+    if (index.exists())
+    {
+        return ExecuteResult::DUPLICATE_INDEX;
+    }
+    index.create();
+    this->autocommit();
+    return ExecuteResult::SUCCESS;
+}
+
+// the new table is empty, a use statement switches to it
+ExecuteResult VirtualMachine::execute_create_table(const Statement &statement)
+{
+    if (this->table->pager->in_transaction())
+    {
+        std::cout << "Cannot create a table inside a transaction." << std::endl;
+        return ExecuteResult::TRANSACTION_FAILED;
+    }
+    if (this->db->get_table(statement.table_name) != nullptr)
+    {
+        return ExecuteResult::DUPLICATE_TABLE;
+    }
+    if (this->db->get_table_names().size() >= CATALOG_MAX_TABLES)
+    {
+        return ExecuteResult::CATALOG_FULL;
+    }
+    this->db->create_table(statement.table_name, statement.schema);
+    this->autocommit();
+    return ExecuteResult::SUCCESS;
+}
+
+ExecuteResult VirtualMachine::execute_use(const Statement &statement)
+{
+    Table *table = this->db->get_table(statement.table_name);
+    if (table == nullptr)
+    {
+        return ExecuteResult::UNKNOWN_TABLE;
+    }
+    this->table = table;
+    return ExecuteResult::SUCCESS;
+}
+
+ExecuteResult VirtualMachine::execute_begin()
+{
+    if (!this->table->pager->has_wal())
+    {
+        std::cout << "Transactions need the write-ahead log." << std::endl;
+        return ExecuteResult::TRANSACTION_FAILED;
+    }
+    if (this->table->pager->in_transaction())
+    {
+        std::cout << "A transaction is already open." << std::endl;
+        return ExecuteResult::TRANSACTION_FAILED;
+    }
+    this->table->pager->begin();
+    return ExecuteResult::SUCCESS;
+}
+
+// the whole transaction goes out with one sync before this returns
+ExecuteResult VirtualMachine::execute_commit()
+{
+    if (!this->table->pager->in_transaction())
+    {
+        std::cout << "No transaction is open." << std::endl;
+        return ExecuteResult::TRANSACTION_FAILED;
+    }
+    this->table->pager->commit(true);
+    return ExecuteResult::SUCCESS;
+}
+
+ExecuteResult VirtualMachine::execute_rollback()
+{
+    if (!this->table->pager->in_transaction())
+    {
+        std::cout << "No transaction is open." << std::endl;
+        return ExecuteResult::TRANSACTION_FAILED;
+    }
+    this->table->pager->rollback();
+    // the rightmost leaves may have been allocated by the transaction
+    this->db->reload_tables();
+    return ExecuteResult::SUCCESS;
+}
+
+//
+// The rows in range from the row counts on the paths to its two
+// ends, no leaf is read beyond the ones at the ends.
+//
+uint64_t VirtualMachine::count_rows(const Statement &statement)
+{
+    if (statement.low_id > statement.high_id)
     {
-        auto page = static_cast<LeafNode *>((cursor->table.pager->get_page(cursor->get_page_num())));
-        page->get_cell(cursor->get_cell_num())->get_value()->print();
+        return 0;
+    }
+    uint64_t row_count = statement.high_id == UINT32_MAX ? this->table->get_row_count()
+                                                         : this->table->count_rows_before(statement.high_id + 1);
+    return row_count - this->table->count_rows_before(statement.low_id);
+}
+
+//
+// Seek to the first id in range and read on until past the last one
+// or the limit. An offset moves the cursor by rank, so skipped rows
+// are not read. Rows are decoded from the leaf cells into one Row.
+// Returns the number of rows written.
+//
+uint64_t VirtualMachine::write_rows(const Statement &statement, ResultSink &sink)
+{
+    uint64_t row_num = 0;
+    if (statement.low_id > statement.high_id || statement.limit == 0)
+    {
+        return row_num;
+    }
+
+    Row row;
+    auto cursor = std::make_unique<Cursor>(*this->table, statement.low_id);
+    if (statement.offset > 0)
+    {
+        cursor->find_rank(this->table->count_rows_before(statement.low_id) + statement.offset);
+    }
+    cursor->skip_leaf_end();
+    while (!cursor->is_end_of_table() && row_num < statement.limit)
+    {
+        LeafNode page = cursor->table.pager->get_leaf(cursor->get_page_num());
+        if (page.get_key(cursor->get_cell_num()) > statement.high_id)
+        {
+            break;
+        }
+        page.get_row(cursor->get_cell_num(), row);
+        sink.write_row(this->table->get_schema(), row);
+        row_num++;
         cursor->advance();
     };
-    return ExecuteResult::SUCCESS;
-}
\ No newline at end of file
+    sink.flush();
+    return row_num;
+}
+
+//
+// Rows in range whose column holds the value of the statement, in id
+// order. With an index on the column only the rows of the ids it
+// finds are read, one cursor moving forward to each of them, else
+// every row in range is compared. Rows are counted without a sink.
+//
+uint64_t VirtualMachine::write_matching_rows(const Statement &statement, ResultSink *sink)
+{
+    uint64_t row_num = 0;
+    if (statement.low_id > statement.high_id || statement.limit == 0)
+    {
+        return row_num;
+    }
+
+    Row row;
+    uint64_t skipped = 0;
+    const Schema &schema = this->table->get_schema();
+    // false once the limit is reached
+    auto match_row = [&]()
+    {
+        if (schema.get_value(row, statement.column) != statement.value)
+        {
+            return true;
+        }
+        if (skipped < statement.offset)
+        {
+            skipped++;
+            return true;
+        }
+        if (sink != nullptr)
+        {
+            sink->write_row(schema, row);
+        }
+        row_num++;
+        return row_num < statement.limit;
+    };
+
+    Index index(*this->table, statement.column);
+    Cursor cursor(*this->table, statement.low_id);
+    if (index.exists())
+    {
+        std::vector<uint32_t> ids;
+        index.find(statement.value, ids);
+        for (auto id = std::lower_bound(ids.begin(), ids.end(), statement.low_id); id != ids.end() && *id <= statement.high_id; id++)
+        {
+            cursor.find_forward(*id);
+            LeafNode page = this->table->pager->get_leaf(cursor.get_page_num());
+            if (cursor.get_cell_num() >= page.get_num_cells() || page.get_key(cursor.get_cell_num()) != *id)
+            {
+                throw std::runtime_error("Index entry without a row: " + std::to_string(*id));
+            }
+            page.get_row(cursor.get_cell_num(), row);
+            if (!match_row())
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        cursor.skip_leaf_end();
+        while (!cursor.is_end_of_table())
+        {
+            LeafNode page = this->table->pager->get_leaf(cursor.get_page_num());
+            if (page.get_key(cursor.get_cell_num()) > statement.high_id)
+            {
+                break;
+            }
+            page.get_row(cursor.get_cell_num(), row);
+            if (!match_row())
+            {
+                break;
+            }
+            cursor.advance();
+        }
+    }
+    if (sink != nullptr)
+    {
+        sink->flush();
+    }
+    return row_num;
+}
+
+// the indexes which exist, opened for one statement
+std::vector<std::unique_ptr<Index>> VirtualMachine::open_indexes()
+{
+    std::vector<std::unique_ptr<Index>> indexes;
+    for (uint32_t column = 0; column < this->table->get_schema().columns.size(); column++)
+    {
+        auto index = std::make_unique<Index>(*this->table, column);
+        if (index->exists())
+        {
+            indexes.push_back(std::move(index));
+        }
+    }
+    return indexes;
+}
+
+// outside of a transaction every statement is committed on its own
+void VirtualMachine::autocommit()
+{
+    if (!this->table->pager->in_transaction())
+    {
+        this->table->pager->commit();
+    }
+}
+
+// undo a failed statement which ran in a transaction of its own
+void VirtualMachine::rollback_statement(bool own_transaction)
+{
+    if (own_transaction)
+    {
+        this->table->pager->rollback();
+        this->db->reload_tables();
+    }
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <tuple>
+#include <vector>
 
+#include "db.hpp"
 #include "processor.hpp"
+#include "sink.hpp"
 
 enum class CursorPosition
 {
@@ -19,14 +23,26 @@ public:
 
     // functions
 
-    Cursor(Table &table);
+    // positioned at the first row
+    explicit Cursor(Table &table);
+    // positioned at the given key, see find()
+    Cursor(Table &table, uint32_t key);
+    ~Cursor();
+
+    Cursor(const Cursor &) = delete;
+    Cursor &operator=(const Cursor &) = delete;
 
     uint32_t get_page_num();
     uint32_t get_cell_num();
     bool is_end_of_table();
 
     void insert(uint32_t key, const Row &value);
+    // add the rows inserted so far to the row counts of their path
+    void count_inserted_rows();
     void find(uint32_t key);
+    void find_forward(uint32_t key);
+    void find_rank(uint64_t rank);
+    void skip_leaf_end();
     void advance();
 
 private:
@@ -35,22 +51,36 @@ private:
     uint32_t page_num;
     uint32_t cell_num;
     bool end_of_table; // Indicates is the cursor locate in a position after the last element
+    bool pinned;       // the leaf at page_num is pinned while the cursor is on it
+    uint32_t uncounted_rows;     // inserted into the leaf at uncounted_page_num, not counted yet
+    uint32_t uncounted_page_num;
+    uint32_t uncounted_key;      // one of them, it leads to their leaf
 
     // functions
 
     void move_begin();
+    void set_position(uint32_t page_num, uint32_t cell_num);
 
     void leaf_node_find(uint32_t page_num, uint32_t key);
     void internal_node_find(uint32_t page_num, uint32_t key);
 
+    void count_insert(uint32_t key, uint32_t row_count);
     void split_and_insert(uint32_t key, const Row &value);
     void insert_internal_node(uint32_t parent_page_num, uint32_t child_page_num);
+    void split_internal_node(uint32_t page_num, uint32_t child_page_num);
 };
 
 enum class ExecuteResult
 {
     SUCCESS,
     DUPLICATE_KEY,
+    DUPLICATE_INDEX,
+    DUPLICATE_TABLE,
+    UNKNOWN_TABLE,
+    CATALOG_FULL,
+    IMPORT_FAILED,
+    EXPORT_FAILED,
+    TRANSACTION_FAILED,
     EXIT
 };
 
@@ -59,22 +89,48 @@ class VirtualMachine
 public:
     // functions
 
-    explicit VirtualMachine(Table *table);
+    // statements run on the default table until a use statement,
+    // rows of results are written into the sink
+    VirtualMachine(Database *db, ResultSink *sink);
 
     VirtualMachine(const VirtualMachine &) = delete;
     VirtualMachine &operator=(const VirtualMachine &) = delete;
 
     ExecuteResult execute(const Statement &statement);
+    // of the table statements run on, statements are parsed against it
+    const Schema &get_schema();
 
 private:
     // variables
 
-    Table *table;
+    Database *db;
+    Table *table; // the table statements run on
+    ResultSink *sink;
 
     // functions
 
     ExecuteResult print_tree();
     ExecuteResult print_constants();
+    ExecuteResult print_stats();
+    ExecuteResult print_tables();
+    ExecuteResult execute_import(const Statement &statement);
+    ExecuteResult execute_export(const Statement &statement);
+    ExecuteResult execute_split(const Statement &statement);
+    ExecuteResult execute_vacuum();
     ExecuteResult execute_insert(const Statement &statement);
     ExecuteResult execute_select(const Statement &statement);
+    ExecuteResult execute_delete(const Statement &statement);
+    ExecuteResult execute_create_index(const Statement &statement);
+    ExecuteResult execute_create_table(const Statement &statement);
+    ExecuteResult execute_use(const Statement &statement);
+    ExecuteResult execute_begin();
+    ExecuteResult execute_commit();
+    ExecuteResult execute_rollback();
+
+    uint64_t count_rows(const Statement &statement);
+    uint64_t write_rows(const Statement &statement, ResultSink &sink);
+    uint64_t write_matching_rows(const Statement &statement, ResultSink *sink);
+    std::vector<std::unique_ptr<Index>> open_indexes();
+    void autocommit();
+    void rollback_statement(bool own_transaction);
 };
\ No newline at end of file
@@ -0,0 +1,917 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wal.hpp"
+
+static uint16_t read_u16(const char *data, uint32_t offset)
+{
+    uint16_t value;
+    memcpy(&value, data + offset, sizeof(uint16_t));
+    return value;
+}
+
+static uint32_t read_u32(const char *data, uint32_t offset)
+{
+    uint32_t value;
+    memcpy(&value, data + offset, sizeof(uint32_t));
+    return value;
+}
+
+static uint64_t read_u64(const char *data, uint32_t offset)
+{
+    uint64_t value;
+    memcpy(&value, data + offset, sizeof(uint64_t));
+    return value;
+}
+
+static void write_u16(char *data, uint32_t offset, uint16_t value)
+{
+    memcpy(data + offset, &value, sizeof(uint16_t));
+}
+
+static void write_u32(char *data, uint32_t offset, uint32_t value)
+{
+    memcpy(data + offset, &value, sizeof(uint32_t));
+}
+
+static void write_u64(char *data, uint32_t offset, uint64_t value)
+{
+    memcpy(data + offset, &value, sizeof(uint64_t));
+}
+
+// payloads are padded, so records stay 8-byte aligned for the checksum
+static uint32_t get_record_size(uint32_t payload_size)
+{
+    return WAL_RECORD_HEADER_SIZE + (payload_size + 7) / 8 * 8;
+}
+
+// FNV-1a over 64-bit words, chained from the previous record
+static uint64_t record_checksum(uint64_t seed, const char *record, uint32_t record_size)
+{
+    constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+    uint64_t hash = seed ^ 0xcbf29ce484222325ull;
+    for (uint32_t offset = 0; offset < record_size; offset += sizeof(uint64_t))
+    {
+        if (offset == WAL_RECORD_CHECKSUM_OFFSET)
+        {
+            continue;
+        }
+        hash = (hash ^ read_u64(record, offset)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static_assert(WAL_RECORD_CHECKSUM_OFFSET % sizeof(uint64_t) == 0 && WAL_RECORD_HEADER_SIZE % sizeof(uint64_t) == 0);
+
+static void write_all(int fd, const char *data, size_t size, off_t offset, const std::string &path)
+{
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written <= 0)
+        {
+            throw std::runtime_error("Error writing file: " + path);
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+// make creating and removing logs durable
+static void sync_directory(const std::string &filename)
+{
+    std::string directory = std::filesystem::path(filename).parent_path().string();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd == -1)
+    {
+        throw std::runtime_error("Unable to open directory of file: " + filename);
+    }
+    int result = fsync(fd);
+    close(fd);
+    if (result == -1)
+    {
+        throw std::runtime_error("Fail to sync directory of file: " + filename);
+    }
+}
+
+Wal::Wal(const std::string &filename, int db_fd, uint32_t sync_interval_ms, uint32_t checkpoint_size)
+    : filename(filename), db_fd(db_fd), sync_interval_ms(sync_interval_ms), checkpoint_size(checkpoint_size),
+      active{1, -1, 0}, sealed{0, -1, 0}, spare_fd(-1), salt(0), checksum(0), committed_size(0), committed_checksum(0),
+      stopping(false), synced_size(0), sealed_applied(false), sealed_done(false),
+      record_num(0), byte_num(0), commit_num(0), sync_num(0), checkpoint_num(0)
+{
+}
+
+Wal::~Wal()
+{
+    this->stop_worker();
+    if (this->active.fd != -1 && fdatasync(this->active.fd) == -1)
+    {
+        std::cerr << "Fail to sync file: " << get_log_path(this->filename, this->active.generation) << std::endl;
+    }
+    // logs are left in place and replayed on the next open
+    this->close_log(this->active);
+    this->close_log(this->sealed);
+    if (this->spare_fd != -1)
+    {
+        close(this->spare_fd);
+    }
+}
+
+std::string Wal::get_log_path(const std::string &filename, uint64_t generation)
+{
+    return filename + "-wal" + std::to_string(generation % 2);
+}
+
+//
+// Replay the logs of the previous session, oldest generation first.
+// The database file is synced before the logs are removed, so a
+// crash in between only replays them again.
+//
+void Wal::recover(const std::string &filename)
+{
+    std::vector<std::pair<uint64_t, std::string>> logs; // (generation, path)
+    std::vector<std::string> paths;
+    for (uint64_t slot = 0; slot < 2; slot++)
+    {
+        std::string path = get_log_path(filename, slot);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            continue;
+        }
+        paths.push_back(path);
+
+        // an emptied log has no header
+        char header[WAL_HEADER_SIZE];
+        bool valid = pread(fd, header, WAL_HEADER_SIZE, 0) == WAL_HEADER_SIZE &&
+                     memcmp(header + WAL_MAGIC_OFFSET, WAL_MAGIC, sizeof(WAL_MAGIC)) == 0 &&
+                     read_u32(header, WAL_PAGE_SIZE_OFFSET) == PAGE_SIZE;
+        close(fd);
+        if (valid)
+        {
+            logs.emplace_back(read_u64(header, WAL_GENERATION_OFFSET), path);
+        }
+    }
+    if (paths.empty())
+    {
+        return;
+    }
+
+    int db_fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (db_fd == -1)
+    {
+        throw std::runtime_error("Unable to open file: " + filename);
+    }
+
+    try
+    {
+        std::sort(logs.begin(), logs.end());
+        for (const auto &log : logs)
+        {
+            int log_fd = open(log.second.c_str(), O_RDONLY);
+            if (log_fd == -1)
+            {
+                throw std::runtime_error("Unable to open file: " + log.second);
+            }
+            try
+            {
+                checkpoint_log(log_fd, db_fd, log.second);
+            }
+            catch (...)
+            {
+                close(log_fd);
+                throw;
+            }
+            close(log_fd);
+        }
+        if (fdatasync(db_fd) == -1)
+        {
+            throw std::runtime_error("Fail to sync file: " + filename);
+        }
+    }
+    catch (...)
+    {
+        close(db_fd);
+        throw;
+    }
+    close(db_fd);
+
+    for (const auto &path : paths)
+    {
+        unlink(path.c_str());
+    }
+    sync_directory(filename);
+}
+
+//
+// Read and verify the record at offset into record, header included.
+// Return the offset of the next record, or -1 if the log ends here.
+//
+off_t Wal::read_record(int log_fd, off_t offset, uint64_t salt, uint64_t &checksum, std::vector<char> &record)
+{
+    char header[WAL_RECORD_HEADER_SIZE];
+    if (pread(log_fd, header, WAL_RECORD_HEADER_SIZE, offset) != WAL_RECORD_HEADER_SIZE ||
+        read_u64(header, WAL_RECORD_SALT_OFFSET) != salt)
+    {
+        return -1;
+    }
+    uint32_t payload_size = read_u32(header, WAL_RECORD_PAYLOAD_SIZE_OFFSET);
+    if (payload_size > PAGE_SIZE)
+    {
+        return -1;
+    }
+
+    uint32_t record_size = get_record_size(payload_size);
+    record.resize(record_size);
+    memcpy(record.data(), header, WAL_RECORD_HEADER_SIZE);
+    ssize_t rest = record_size - WAL_RECORD_HEADER_SIZE;
+    if (pread(log_fd, record.data() + WAL_RECORD_HEADER_SIZE, rest, offset + WAL_RECORD_HEADER_SIZE) != rest)
+    {
+        return -1;
+    }
+
+    uint64_t record_sum = record_checksum(checksum, record.data(), record_size);
+    if (record_sum != read_u64(header, WAL_RECORD_CHECKSUM_OFFSET))
+    {
+        return -1;
+    }
+    checksum = record_sum;
+    return offset + record_size;
+}
+
+//
+// Apply the committed records of a log to the database file and
+// return the database size of the last commit. Only the latest
+// image of a page and the deltas after it are written. The file
+// is resized to the database size but not synced.
+//
+uint32_t Wal::checkpoint_log(int log_fd, int db_fd, const std::string &path)
+{
+    char header[WAL_HEADER_SIZE];
+    if (pread(log_fd, header, WAL_HEADER_SIZE, 0) != WAL_HEADER_SIZE)
+    {
+        return 0;
+    }
+    uint64_t salt = read_u64(header, WAL_SALT_OFFSET);
+
+    // find where the last commit ends and the latest image of each page
+    std::unordered_map<uint32_t, off_t> images, pending_images;
+    std::vector<char> record;
+    uint32_t db_pages = 0;
+    off_t committed_end = WAL_HEADER_SIZE;
+    uint64_t checksum = salt;
+    off_t offset = WAL_HEADER_SIZE;
+    while (true)
+    {
+        off_t next_offset = read_record(log_fd, offset, salt, checksum, record);
+        if (next_offset == -1)
+        {
+            break;
+        }
+        uint32_t page_num = read_u32(record.data(), WAL_RECORD_PAGE_NUM_OFFSET);
+        if ((WalRecordType)read_u32(record.data(), WAL_RECORD_TYPE_OFFSET) == WalRecordType::IMAGE)
+        {
+            pending_images[page_num] = offset;
+        }
+
+        uint32_t record_db_pages = read_u32(record.data(), WAL_RECORD_DB_PAGES_OFFSET);
+        if (record_db_pages != 0)
+        {
+            for (const auto &image : pending_images)
+            {
+                images[image.first] = image.second;
+            }
+            pending_images.clear();
+            db_pages = record_db_pages;
+            committed_end = next_offset;
+        }
+        offset = next_offset;
+    }
+
+    checksum = salt;
+    offset = WAL_HEADER_SIZE;
+    while (offset < committed_end)
+    {
+        off_t next_offset = read_record(log_fd, offset, salt, checksum, record);
+        if (next_offset == -1)
+        {
+            throw std::runtime_error("Error reading file: " + path);
+        }
+
+        const char *payload = record.data() + WAL_RECORD_HEADER_SIZE;
+        uint32_t payload_size = read_u32(record.data(), WAL_RECORD_PAYLOAD_SIZE_OFFSET);
+        uint32_t page_num = read_u32(record.data(), WAL_RECORD_PAGE_NUM_OFFSET);
+        off_t page_offset = (off_t)page_num * PAGE_SIZE;
+        auto image = images.find(page_num);
+
+        WalRecordType type = (WalRecordType)read_u32(record.data(), WAL_RECORD_TYPE_OFFSET);
+        if (type == WalRecordType::IMAGE)
+        {
+            if (offset == image->second)
+            {
+                write_all(db_fd, payload, PAGE_SIZE, page_offset, path);
+            }
+        }
+        else if (type == WalRecordType::DELTA && (image == images.end() || offset > image->second))
+        {
+            uint32_t position = 0;
+            while (position < payload_size)
+            {
+                uint16_t run_offset = read_u16(payload, position);
+                uint16_t run_length = read_u16(payload, position + WAL_RUN_OFFSET_SIZE);
+                position += WAL_RUN_HEADER_SIZE;
+                write_all(db_fd, payload + position, run_length, page_offset + run_offset, path);
+                position += run_length;
+            }
+        }
+        offset = next_offset;
+    }
+
+    struct stat file_stat;
+    if (fstat(db_fd, &file_stat) == -1)
+    {
+        throw std::runtime_error("Unable to stat database file of: " + path);
+    }
+    if (db_pages > 0 && file_stat.st_size != (off_t)db_pages * PAGE_SIZE && ftruncate(db_fd, (off_t)db_pages * PAGE_SIZE) == -1)
+    {
+        throw std::runtime_error("Fail to resize database file of: " + path);
+    }
+    return db_pages;
+}
+
+bool Wal::read_page(uint32_t page_num, char *data)
+{
+    auto it = this->index.find(page_num);
+    if (it == this->index.end())
+    {
+        return false;
+    }
+
+    std::string path = get_log_path(this->filename, it->second.generation);
+    off_t offset = it->second.offset + WAL_RECORD_HEADER_SIZE;
+    if (it->second.generation == this->active.generation)
+    {
+        if (pread(this->active.fd, data, PAGE_SIZE, offset) != PAGE_SIZE)
+        {
+            throw std::runtime_error("Error reading file: " + path);
+        }
+        return true;
+    }
+
+    // the background thread may be emptying the sealed log, once it
+    // is in the database file the page is read from there instead
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->sealed_applied)
+    {
+        return false;
+    }
+    if (pread(this->sealed.fd, data, PAGE_SIZE, offset) != PAGE_SIZE)
+    {
+        throw std::runtime_error("Error reading file: " + path);
+    }
+    return true;
+}
+
+bool Wal::needs_image(uint32_t page_num)
+{
+    auto it = this->index.find(page_num);
+    return it != this->index.end() && it->second.has_deltas;
+}
+
+void Wal::append(uint32_t page_num, const char *data)
+{
+    this->finish_checkpoint();
+    this->add_record(page_num, WalRecordType::IMAGE, data, PAGE_SIZE);
+    this->write_records(0);
+}
+
+void Wal::commit(const std::vector<WalPage> &pages, uint32_t db_pages, bool sync)
+{
+    this->finish_checkpoint();
+
+    for (const auto &page : pages)
+    {
+        if (!this->add_delta(page))
+        {
+            this->add_record(page.page_num, WalRecordType::IMAGE, page.data, PAGE_SIZE);
+        }
+    }
+    if (this->staged.empty())
+    {
+        // pages imaged since the last commit still need a commit record
+        if (this->active.fd == -1 || this->active.size == this->committed_size)
+        {
+            return;
+        }
+        this->add_record(0, WalRecordType::COMMIT, nullptr, 0);
+    }
+
+    this->write_records(db_pages);
+    this->committed_size = this->active.size;
+    this->committed_checksum = this->checksum;
+    this->undo.clear();
+    this->commit_num++;
+
+    if (sync || this->sync_interval_ms == 0)
+    {
+        if (fdatasync(this->active.fd) == -1)
+        {
+            throw std::runtime_error("Fail to sync file: " + get_log_path(this->filename, this->active.generation));
+        }
+        this->sync_num++;
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->synced_size = this->active.size;
+    }
+
+    if (this->active.size >= this->checkpoint_size && this->sealed.fd == -1)
+    {
+        this->rotate();
+    }
+}
+
+//
+// Cut the active log back to the last commit and point the pages
+// imaged since then at their committed records again. The log is
+// not rotated between commits, so the records are all in it.
+//
+std::vector<uint32_t> Wal::rollback()
+{
+    this->finish_checkpoint();
+
+    std::vector<uint32_t> pages;
+    pages.reserve(this->undo.size());
+    for (const auto &[page_num, entry] : this->undo)
+    {
+        if (entry.generation == 0)
+        {
+            this->index.erase(page_num);
+        }
+        else
+        {
+            this->index[page_num] = entry;
+        }
+        pages.push_back(page_num);
+    }
+    this->undo.clear();
+
+    if (this->active.fd == -1 || this->active.size == this->committed_size)
+    {
+        return pages;
+    }
+    if (ftruncate(this->active.fd, this->committed_size) == -1)
+    {
+        throw std::runtime_error("Fail to truncate file: " + get_log_path(this->filename, this->active.generation));
+    }
+    this->checksum = this->committed_checksum;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->active.size = this->committed_size;
+        this->synced_size = std::min(this->synced_size, this->committed_size);
+    }
+    return pages;
+}
+
+//
+// Stop the background thread, copy both logs into the database
+// file and remove them. Every page is in the database file again
+// afterwards, the next record starts a new log.
+//
+void Wal::checkpoint()
+{
+    if (this->active.fd == -1 && this->sealed.fd == -1)
+    {
+        return;
+    }
+
+    this->stop_worker();
+    if (!this->worker_error.empty())
+    {
+        throw std::runtime_error(this->worker_error);
+    }
+
+    for (Log *log : {&this->sealed, &this->active})
+    {
+        if (log->fd == -1 || (log == &this->sealed && this->sealed_done))
+        {
+            continue;
+        }
+        std::string path = get_log_path(this->filename, log->generation);
+        if (fdatasync(log->fd) == -1)
+        {
+            throw std::runtime_error("Fail to sync file: " + path);
+        }
+        checkpoint_log(log->fd, this->db_fd, path);
+    }
+    if (fdatasync(this->db_fd) == -1)
+    {
+        throw std::runtime_error("Fail to sync file: " + this->filename);
+    }
+
+    uint64_t next_generation = this->active.generation + 1;
+    this->close_log(this->active);
+    this->close_log(this->sealed);
+    if (this->spare_fd != -1)
+    {
+        close(this->spare_fd);
+        this->spare_fd = -1;
+    }
+    for (uint64_t slot = 0; slot < 2; slot++)
+    {
+        unlink(get_log_path(this->filename, slot).c_str());
+    }
+    sync_directory(this->filename);
+
+    this->index.clear();
+    this->undo.clear();
+    this->active = Log{next_generation, -1, 0};
+    this->sealed = Log{0, -1, 0};
+    this->sealed_applied = false;
+    this->sealed_done = false;
+    this->checkpoint_num++;
+}
+
+uint64_t Wal::get_record_num()
+{
+    return this->record_num;
+}
+
+uint64_t Wal::get_byte_num()
+{
+    return this->byte_num;
+}
+
+uint64_t Wal::get_commit_num()
+{
+    return this->commit_num;
+}
+
+uint64_t Wal::get_sync_num()
+{
+    return this->sync_num;
+}
+
+uint64_t Wal::get_checkpoint_num()
+{
+    return this->checkpoint_num;
+}
+
+//
+// Start the active log with a fresh salt. An emptied log is reused,
+// its header gets synced with the first group commit. A new file is
+// synced together with its directory entry right away.
+//
+void Wal::open_log()
+{
+    std::string path = get_log_path(this->filename, this->active.generation);
+    bool is_new = this->spare_fd == -1;
+    int fd = is_new ? open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : this->spare_fd;
+    if (fd == -1)
+    {
+        throw std::runtime_error("Unable to create file: " + path);
+    }
+    this->spare_fd = -1;
+
+    std::random_device device;
+    this->salt = ((uint64_t)device() << 32) ^ device() ^ std::chrono::steady_clock::now().time_since_epoch().count();
+    this->checksum = this->salt;
+    this->committed_checksum = this->salt;
+
+    char header[WAL_HEADER_SIZE] = {};
+    memcpy(header + WAL_MAGIC_OFFSET, WAL_MAGIC, sizeof(WAL_MAGIC));
+    write_u32(header, WAL_VERSION_OFFSET, WAL_FORMAT_VERSION);
+    write_u32(header, WAL_PAGE_SIZE_OFFSET, PAGE_SIZE);
+    write_u64(header, WAL_GENERATION_OFFSET, this->active.generation);
+    write_u64(header, WAL_SALT_OFFSET, this->salt);
+    try
+    {
+        write_all(fd, header, WAL_HEADER_SIZE, 0, path);
+        if (is_new)
+        {
+            if (fdatasync(fd) == -1)
+            {
+                throw std::runtime_error("Fail to sync file: " + path);
+            }
+            sync_directory(this->filename);
+        }
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->active.fd = fd;
+        this->active.size = WAL_HEADER_SIZE;
+        this->synced_size = is_new ? WAL_HEADER_SIZE : 0;
+        this->committed_size = WAL_HEADER_SIZE;
+    }
+    this->start_worker();
+}
+
+// stage a record, the database size and checksum are filled in by write_records
+void Wal::add_record(uint32_t page_num, WalRecordType type, const char *payload, uint32_t payload_size)
+{
+    size_t offset = this->buffer.size();
+    this->buffer.resize(offset + get_record_size(payload_size), 0);
+
+    char *record = this->buffer.data() + offset;
+    write_u32(record, WAL_RECORD_PAGE_NUM_OFFSET, page_num);
+    write_u32(record, WAL_RECORD_TYPE_OFFSET, (uint32_t)type);
+    write_u32(record, WAL_RECORD_PAYLOAD_SIZE_OFFSET, payload_size);
+    if (payload_size > 0)
+    {
+        memcpy(record + WAL_RECORD_HEADER_SIZE, payload, payload_size);
+    }
+
+    this->staged.emplace_back(page_num, type, offset);
+}
+
+//
+// Stage the changes of a page against its base as runs of changed
+// bytes, ranges closer than WAL_RUN_MIN_GAP are joined. Returns
+// false if the page has to be imaged instead, because the log has
+// no image of it to apply deltas to or the delta is too large.
+//
+bool Wal::add_delta(const WalPage &page)
+{
+    auto it = this->index.find(page.page_num);
+    if (page.base == nullptr || it == this->index.end() || it->second.generation != this->active.generation)
+    {
+        return false;
+    }
+
+    char delta[WAL_DELTA_MAX_SIZE];
+    uint32_t delta_size = 0;
+    uint32_t word = 0;
+    constexpr uint32_t WORD_SIZE = sizeof(uint64_t);
+    while (word < PAGE_SIZE)
+    {
+        if (read_u64(page.data, word) == read_u64(page.base, word))
+        {
+            word += WORD_SIZE;
+            continue;
+        }
+
+        uint32_t run_start = word;
+        uint32_t run_end = word + WORD_SIZE;
+        for (word = run_end; word < PAGE_SIZE && word < run_end + WAL_RUN_MIN_GAP; word += WORD_SIZE)
+        {
+            if (read_u64(page.data, word) != read_u64(page.base, word))
+            {
+                run_end = word + WORD_SIZE;
+            }
+        }
+        word = run_end;
+
+        uint32_t run_length = run_end - run_start;
+        if (delta_size + WAL_RUN_HEADER_SIZE + run_length > WAL_DELTA_MAX_SIZE)
+        {
+            return false;
+        }
+        write_u16(delta, delta_size, run_start);
+        write_u16(delta, delta_size + WAL_RUN_OFFSET_SIZE, run_length);
+        memcpy(delta + delta_size + WAL_RUN_HEADER_SIZE, page.data + run_start, run_length);
+        delta_size += WAL_RUN_HEADER_SIZE + run_length;
+    }
+
+    // marked dirty but nothing changed
+    if (delta_size > 0)
+    {
+        this->add_record(page.page_num, WalRecordType::DELTA, delta, delta_size);
+    }
+    return true;
+}
+
+// write the staged records with one write, the last one carries db_pages
+void Wal::write_records(uint32_t db_pages)
+{
+    if (this->active.fd == -1)
+    {
+        this->open_log();
+    }
+
+    for (size_t i = 0; i < this->staged.size(); i++)
+    {
+        size_t offset = std::get<2>(this->staged[i]);
+        size_t end = i + 1 < this->staged.size() ? std::get<2>(this->staged[i + 1]) : this->buffer.size();
+        char *record = this->buffer.data() + offset;
+        write_u32(record, WAL_RECORD_DB_PAGES_OFFSET, i + 1 == this->staged.size() ? db_pages : 0);
+        write_u64(record, WAL_RECORD_SALT_OFFSET, this->salt);
+        this->checksum = record_checksum(this->checksum, record, end - offset);
+        write_u64(record, WAL_RECORD_CHECKSUM_OFFSET, this->checksum);
+    }
+
+    off_t log_offset = this->active.size;
+    write_all(this->active.fd, this->buffer.data(), this->buffer.size(), log_offset, get_log_path(this->filename, this->active.generation));
+
+    for (const auto &[page_num, type, offset] : this->staged)
+    {
+        if (type == WalRecordType::COMMIT)
+        {
+            continue;
+        }
+        if (db_pages == 0 && this->undo.find(page_num) == this->undo.end())
+        {
+            // images written ahead of a commit can be rolled back
+            auto it = this->index.find(page_num);
+            this->undo[page_num] = it != this->index.end() ? it->second : Entry{0, 0, false};
+        }
+        if (type == WalRecordType::IMAGE)
+        {
+            this->index[page_num] = Entry{this->active.generation, log_offset + (off_t)offset, false};
+        }
+        else
+        {
+            this->index[page_num].has_deltas = true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->active.size += this->buffer.size();
+    }
+    this->record_num += this->staged.size();
+    this->byte_num += this->buffer.size();
+    this->staged.clear();
+    this->buffer.clear();
+}
+
+// seal the active log for the background checkpoint, records go to the other log
+void Wal::rotate()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->sealed = this->active;
+        this->sealed_applied = false;
+        this->sealed_done = false;
+        this->active = Log{this->sealed.generation + 1, -1, 0};
+        this->synced_size = 0;
+    }
+    this->wake.notify_one();
+}
+
+// take back a sealed log once the background thread has copied and emptied it
+void Wal::finish_checkpoint()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (!this->worker_error.empty())
+    {
+        throw std::runtime_error(this->worker_error);
+    }
+    if (this->sealed.fd == -1 || !this->sealed_done)
+    {
+        return;
+    }
+    this->spare_fd = this->sealed.fd;
+    this->sealed = Log{0, -1, 0};
+    this->sealed_applied = false;
+    this->sealed_done = false;
+    uint64_t sealed_generation = this->active.generation - 1;
+    lock.unlock();
+
+    // pages still pointing at the sealed log are in the database file now
+    for (auto it = this->index.begin(); it != this->index.end();)
+    {
+        if (it->second.generation == sealed_generation)
+        {
+            it = this->index.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+    for (auto &[page_num, entry] : this->undo)
+    {
+        if (entry.generation == sealed_generation)
+        {
+            entry = Entry{0, 0, false};
+        }
+    }
+    this->checkpoint_num++;
+}
+
+void Wal::close_log(Log &log)
+{
+    if (log.fd != -1)
+    {
+        close(log.fd);
+        log.fd = -1;
+    }
+}
+
+void Wal::start_worker()
+{
+    if (!this->worker.joinable())
+    {
+        this->stopping = false;
+        this->worker = std::thread(&Wal::run_worker, this);
+    }
+}
+
+void Wal::stop_worker()
+{
+    if (!this->worker.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_one();
+    this->worker.join();
+}
+
+//
+// Group commit: every interval, one fdatasync covers all commits
+// written since the last one. A sealed log is synced, applied to
+// the database file, the database file synced and only then the
+// log emptied, so it can never be replayed over newer pages.
+//
+void Wal::run_worker()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stopping && this->worker_error.empty())
+    {
+        bool has_sealed = this->sealed.fd != -1 && !this->sealed_done;
+        if (!has_sealed)
+        {
+            if (this->sync_interval_ms > 0)
+            {
+                this->wake.wait_for(lock, std::chrono::milliseconds(this->sync_interval_ms));
+            }
+            else
+            {
+                this->wake.wait(lock);
+            }
+        }
+
+        if (this->active.fd != -1 && this->active.size > this->synced_size)
+        {
+            int fd = this->active.fd;
+            off_t size = this->active.size;
+            lock.unlock();
+            bool synced = fdatasync(fd) == 0;
+            lock.lock();
+            if (!synced)
+            {
+                this->worker_error = "Fail to sync file: " + get_log_path(this->filename, this->active.generation);
+                break;
+            }
+            if (fd == this->active.fd)
+            {
+                this->synced_size = std::max(this->synced_size, size);
+            }
+            this->sync_num++;
+        }
+
+        if (this->sealed.fd != -1 && !this->sealed_done)
+        {
+            Log log = this->sealed;
+            lock.unlock();
+            std::string error;
+            try
+            {
+                std::string path = get_log_path(this->filename, log.generation);
+                if (fdatasync(log.fd) == -1)
+                {
+                    throw std::runtime_error("Fail to sync file: " + path);
+                }
+                checkpoint_log(log.fd, this->db_fd, path);
+                if (fdatasync(this->db_fd) == -1)
+                {
+                    throw std::runtime_error("Fail to sync file: " + this->filename);
+                }
+                {
+                    std::lock_guard<std::mutex> applied_lock(this->mutex);
+                    this->sealed_applied = true;
+                }
+                if (ftruncate(log.fd, 0) == -1 || fsync(log.fd) == -1)
+                {
+                    throw std::runtime_error("Fail to empty file: " + path);
+                }
+            }
+            catch (const std::runtime_error &e)
+            {
+                error = e.what();
+            }
+            lock.lock();
+            this->worker_error = error;
+            this->sealed_done = error.empty();
+        }
+    }
+}
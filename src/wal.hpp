@@ -0,0 +1,203 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "btree.hpp"
+
+//
+// Write-Ahead Log Layout
+// The log is a header followed by records. An image record holds
+// a whole page, a delta record the byte ranges changed since the
+// previous record of the page, as (offset, length, bytes) runs.
+// A page is imaged before its first delta in every log. A record
+// with a non-zero database size ends a commit, records after the
+// last commit are ignored. A commit record without a page ends a
+// commit whose pages were all imaged before it. Checksums are chained from the salt,
+// so the first torn or stale record ends the log.
+//
+
+constexpr char WAL_MAGIC[] = "Mini-SQLite WAL";
+constexpr uint32_t WAL_FORMAT_VERSION = 1;
+
+constexpr uint32_t WAL_MAGIC_SIZE = 16;
+constexpr uint32_t WAL_MAGIC_OFFSET = 0;
+constexpr uint32_t WAL_VERSION_SIZE = sizeof(uint32_t);
+constexpr uint32_t WAL_VERSION_OFFSET = WAL_MAGIC_OFFSET + WAL_MAGIC_SIZE;
+constexpr uint32_t WAL_PAGE_SIZE_SIZE = sizeof(uint32_t);
+constexpr uint32_t WAL_PAGE_SIZE_OFFSET = WAL_VERSION_OFFSET + WAL_VERSION_SIZE;
+constexpr uint32_t WAL_GENERATION_SIZE = sizeof(uint64_t);
+constexpr uint32_t WAL_GENERATION_OFFSET = WAL_PAGE_SIZE_OFFSET + WAL_PAGE_SIZE_SIZE;
+constexpr uint32_t WAL_SALT_SIZE = sizeof(uint64_t);
+constexpr uint32_t WAL_SALT_OFFSET = WAL_GENERATION_OFFSET + WAL_GENERATION_SIZE;
+constexpr uint32_t WAL_HEADER_SIZE = WAL_SALT_OFFSET + WAL_SALT_SIZE;
+
+enum class WalRecordType : uint32_t
+{
+    IMAGE,
+    DELTA,
+    COMMIT
+};
+
+constexpr uint32_t WAL_RECORD_PAGE_NUM_SIZE = sizeof(uint32_t);
+constexpr uint32_t WAL_RECORD_PAGE_NUM_OFFSET = 0;
+constexpr uint32_t WAL_RECORD_DB_PAGES_SIZE = sizeof(uint32_t);
+constexpr uint32_t WAL_RECORD_DB_PAGES_OFFSET = WAL_RECORD_PAGE_NUM_OFFSET + WAL_RECORD_PAGE_NUM_SIZE;
+constexpr uint32_t WAL_RECORD_TYPE_SIZE = sizeof(WalRecordType);
+constexpr uint32_t WAL_RECORD_TYPE_OFFSET = WAL_RECORD_DB_PAGES_OFFSET + WAL_RECORD_DB_PAGES_SIZE;
+constexpr uint32_t WAL_RECORD_PAYLOAD_SIZE_SIZE = sizeof(uint32_t);
+constexpr uint32_t WAL_RECORD_PAYLOAD_SIZE_OFFSET = WAL_RECORD_TYPE_OFFSET + WAL_RECORD_TYPE_SIZE;
+constexpr uint32_t WAL_RECORD_SALT_SIZE = sizeof(uint64_t);
+constexpr uint32_t WAL_RECORD_SALT_OFFSET = WAL_RECORD_PAYLOAD_SIZE_OFFSET + WAL_RECORD_PAYLOAD_SIZE_SIZE;
+constexpr uint32_t WAL_RECORD_CHECKSUM_SIZE = sizeof(uint64_t);
+constexpr uint32_t WAL_RECORD_CHECKSUM_OFFSET = WAL_RECORD_SALT_OFFSET + WAL_RECORD_SALT_SIZE;
+constexpr uint32_t WAL_RECORD_HEADER_SIZE = WAL_RECORD_CHECKSUM_OFFSET + WAL_RECORD_CHECKSUM_SIZE;
+
+constexpr uint32_t WAL_RUN_OFFSET_SIZE = sizeof(uint16_t);
+constexpr uint32_t WAL_RUN_LENGTH_SIZE = sizeof(uint16_t);
+constexpr uint32_t WAL_RUN_HEADER_SIZE = WAL_RUN_OFFSET_SIZE + WAL_RUN_LENGTH_SIZE;
+constexpr uint32_t WAL_RUN_MIN_GAP = 16;                // closer changed ranges share a run
+constexpr uint32_t WAL_DELTA_MAX_SIZE = PAGE_SIZE / 2; // larger deltas are logged as images
+
+static_assert(sizeof(WAL_MAGIC) <= WAL_MAGIC_SIZE);
+static_assert(PAGE_SIZE <= UINT16_MAX);
+
+constexpr uint32_t DEFAULT_WAL_SYNC_INTERVAL_MS = 10; // 0 syncs every commit before it returns
+constexpr uint32_t DEFAULT_WAL_CHECKPOINT_SIZE = 16 << 20; // bytes of log before it is checkpointed
+
+// a dirty page at commit, base is its content as of its previous
+// record or nullptr if it has to be imaged
+struct WalPage
+{
+    uint32_t page_num;
+    const char *data;
+    const char *base;
+};
+
+//
+// Page log kept next to the database file as <file>-wal0 and
+// <file>-wal1. Commits are appended to the active log and made
+// durable by a background thread that syncs whatever was written
+// in the last interval, so many commits share one fsync.
+//
+// Once the active log is large enough it is sealed and the other
+// one is started, the background thread then copies the sealed
+// log into the database file and empties it for reuse. Until that
+// is done pages are read back from their latest image in the log,
+// the database file is only ever written from a durable log.
+//
+class Wal
+{
+public:
+    // functions
+
+    Wal(const std::string &filename, int db_fd, uint32_t sync_interval_ms, uint32_t checkpoint_size);
+    ~Wal();
+
+    Wal(const Wal &) = delete;
+    Wal &operator=(const Wal &) = delete;
+
+    // copy committed records of leftover logs into the database file
+    static void recover(const std::string &filename);
+
+    // latest logged image of a page, false if it is not in the log
+    bool read_page(uint32_t page_num, char *data);
+    // the log only has deltas past the latest image of the page,
+    // so it has to be imaged before its buffer is dropped
+    bool needs_image(uint32_t page_num);
+
+    // image a page whose changes are not committed yet
+    void append(uint32_t page_num, const char *data);
+    // log the pages of a commit, db_pages is the database size after it,
+    // sync makes it durable before returning instead of within the interval
+    void commit(const std::vector<WalPage> &pages, uint32_t db_pages, bool sync = false);
+    // drop the records written since the last commit and return their pages
+    std::vector<uint32_t> rollback();
+    // copy every log into the database file and remove the logs
+    void checkpoint();
+
+    uint64_t get_record_num();
+    uint64_t get_byte_num();
+    uint64_t get_commit_num();
+    uint64_t get_sync_num();
+    uint64_t get_checkpoint_num();
+
+private:
+    struct Log
+    {
+        uint64_t generation;
+        int fd; // -1 until the first record is written
+        off_t size;
+    };
+
+    struct Entry
+    {
+        uint64_t generation;
+        off_t offset;     // of the latest image record
+        bool has_deltas; // after that image
+    };
+
+    // variables
+
+    std::string filename;
+    int db_fd;
+    uint32_t sync_interval_ms;
+    off_t checkpoint_size;
+
+    Log active;
+    Log sealed;    // being checkpointed, fd is -1 if there is none
+    int spare_fd;  // emptied log to reuse, -1 if there is none
+    uint64_t salt; // of the active log
+    uint64_t checksum;
+    off_t committed_size; // of the active log, where rollback cuts it
+    uint64_t committed_checksum;
+    std::unordered_map<uint32_t, Entry> index; // page number -> latest image
+    std::unordered_map<uint32_t, Entry> undo;  // page number -> entry as of the last commit, generation 0 if none
+
+    // records of the commit being written, (page number, type, offset in buffer)
+    std::vector<std::tuple<uint32_t, WalRecordType, size_t>> staged;
+    std::vector<char> buffer;
+
+    // shared with the background thread
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool stopping;
+    off_t synced_size;   // of the active log
+    bool sealed_applied; // sealed log is in the synced database file
+    bool sealed_done;    // and emptied
+    std::string worker_error;
+
+    std::atomic<uint64_t> record_num;
+    std::atomic<uint64_t> byte_num;
+    std::atomic<uint64_t> commit_num;
+    std::atomic<uint64_t> sync_num;
+    std::atomic<uint64_t> checkpoint_num;
+
+    // functions
+
+    void open_log();
+    void add_record(uint32_t page_num, WalRecordType type, const char *payload, uint32_t payload_size);
+    bool add_delta(const WalPage &page);
+    void write_records(uint32_t db_pages);
+    void rotate();
+    void finish_checkpoint();
+    void close_log(Log &log);
+
+    void start_worker();
+    void stop_worker();
+    void run_worker();
+
+    static std::string get_log_path(const std::string &filename, uint64_t generation);
+    static uint32_t checkpoint_log(int log_fd, int db_fd, const std::string &path);
+    static off_t read_record(int log_fd, off_t offset, uint64_t salt, uint64_t &checksum, std::vector<char> &record);
+};